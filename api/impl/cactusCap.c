@@ -440,13 +440,13 @@ void cap_writeBinaryRepresentation(Cap *cap, void(*writeFn)(const void * ptr, si
     } else if (cap_getSequence(cap) != NULL) {
         binaryRepresentation_writeElementType(CODE_CAP_WITH_COORDINATES, writeFn);
         binaryRepresentation_writeName(cap_getName(cap), writeFn);
-        binaryRepresentation_writeInteger(cap_getCoordinate(cap), writeFn);
+        binaryRepresentation_writeCoordinate(cap_getCoordinate(cap), writeFn);
         binaryRepresentation_writeBool(cap_getStrand(cap), writeFn);
         binaryRepresentation_writeName(sequence_getName(cap_getSequence(cap)), writeFn);
     } else {
         binaryRepresentation_writeElementType(CODE_CAP_WITH_COORDINATES_BUT_NO_SEQUENCE, writeFn);
         binaryRepresentation_writeName(cap_getName(cap), writeFn);
-        binaryRepresentation_writeInteger(cap_getCoordinate(cap), writeFn);
+        binaryRepresentation_writeCoordinate(cap_getCoordinate(cap), writeFn);
         binaryRepresentation_writeBool(cap_getStrand(cap), writeFn);
         binaryRepresentation_writeName(event_getName(cap_getEvent(cap)), writeFn);
     }
@@ -500,7 +500,7 @@ Cap *cap_loadFromBinaryRepresentation(void **binaryString, End *end) {
     } else if (binaryRepresentation_peekNextElementType(*binaryString) == CODE_CAP_WITH_COORDINATES) {
         binaryRepresentation_popNextElementType(binaryString);
         name = binaryRepresentation_getName(binaryString);
-        coordinate = binaryRepresentation_getInteger(binaryString);
+        coordinate = binaryRepresentation_getCoordinate(binaryString);
         strand = binaryRepresentation_getBool(binaryString);
         sequence = flower_getSequence(end_getFlower(end), binaryRepresentation_getName(binaryString));
         cap = cap_construct4(name, end, coordinate, strand, sequence);
@@ -508,7 +508,7 @@ Cap *cap_loadFromBinaryRepresentation(void **binaryString, End *end) {
     } else if (binaryRepresentation_peekNextElementType(*binaryString) == CODE_CAP_WITH_COORDINATES_BUT_NO_SEQUENCE) {
         binaryRepresentation_popNextElementType(binaryString);
         name = binaryRepresentation_getName(binaryString);
-        coordinate = binaryRepresentation_getInteger(binaryString);
+        coordinate = binaryRepresentation_getCoordinate(binaryString);
         strand = binaryRepresentation_getBool(binaryString);
         event = eventTree_getEvent(flower_getEventTree(end_getFlower(end)), binaryRepresentation_getName(binaryString));
         cap = cap_construct3(name, event, end);
@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+#include <limits.h>
+#include <zlib.h>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Record compression codecs.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+const char *CACTUS_COMPRESSION_EXCEPTION_ID = "CACTUS_COMPRESSION_EXCEPTION_ID";
+
+/*
+ * Tags written as the first byte of a non-zlib record. A zlib stream always starts with a CMF byte
+ * whose low four bits are 8 (deflate), so none of these can be mistaken for one.
+ */
+#define CODEC_TAG_NONE 0x01
+#define CODEC_TAG_LZ4 0x02
+#define CODEC_TAG_ZSTD 0x03
+
+/*
+ * Size of the header of a tagged record: the tag, then (except for uncompressed records)
+ * the uncompressed size.
+ */
+#define CODEC_HEADER_SIZE (1 + sizeof(int64_t))
+
+#ifdef HAVE_ZSTD
+#define CODEC_ZSTD_LEVEL 3
+#endif
+
+static const char *codecNames[] = { "zlib", "zlibFast", "none", "lz4", "zstd" };
+
+bool cactusCompression_isAvailable(CactusCodec codec) {
+    switch (codec) {
+        case CACTUS_CODEC_ZLIB:
+        case CACTUS_CODEC_ZLIB_FAST:
+        case CACTUS_CODEC_NONE:
+            return 1;
+        case CACTUS_CODEC_LZ4:
+#ifdef HAVE_LZ4
+            return 1;
+#else
+            return 0;
+#endif
+        case CACTUS_CODEC_ZSTD:
+#ifdef HAVE_ZSTD
+            return 1;
+#else
+            return 0;
+#endif
+    }
+    return 0;
+}
+
+const char *cactusCompression_getCodecName(CactusCodec codec) {
+    assert(codec >= CACTUS_CODEC_ZLIB && codec <= CACTUS_CODEC_ZSTD);
+    return codecNames[codec];
+}
+
+CactusCodec cactusCompression_getCodec(const char *name) {
+    for (int64_t i = CACTUS_CODEC_ZLIB; i <= CACTUS_CODEC_ZSTD; i++) {
+        if (strcmp(name, codecNames[i]) == 0) {
+            if (!cactusCompression_isAvailable(i)) {
+                stThrowNew(CACTUS_COMPRESSION_EXCEPTION_ID,
+                        "The compression codec %s is not available in this build", name);
+            }
+            return i;
+        }
+    }
+    stThrowNew(CACTUS_COMPRESSION_EXCEPTION_ID, "Unrecognised compression codec: %s", name);
+    return CACTUS_CODEC_ZLIB;
+}
+
+CactusCodec cactusCompression_getCodecFromConfString(const char *confString) {
+    const char *attribute = "compression=\"";
+    const char *cA = confString != NULL ? strstr(confString, attribute) : NULL;
+    if (cA == NULL) {
+        return CACTUS_CODEC_ZLIB;
+    }
+    cA += strlen(attribute);
+    const char *cA2 = strchr(cA, '"');
+    if (cA2 == NULL) {
+        stThrowNew(CACTUS_COMPRESSION_EXCEPTION_ID, "Unterminated compression attribute in conf string: %s", confString);
+    }
+    char *name = stString_getSubString(cA, 0, cA2 - cA);
+    CactusCodec codec = cactusCompression_getCodec(name);
+    free(name);
+    return codec;
+}
+
+static void *addHeader(uint8_t tag, int64_t uncompressedSize, int64_t capacity) {
+    uint8_t *record = st_malloc(CODEC_HEADER_SIZE + capacity);
+    record[0] = tag;
+    memcpy(record + 1, &uncompressedSize, sizeof(int64_t));
+    return record;
+}
+
+void *cactusCompression_compress(CactusCodec codec, const void *data, int64_t size, int64_t *compressedSize) {
+    switch (codec) {
+        case CACTUS_CODEC_ZLIB:
+            return stCompression_compress((void *) data, size, compressedSize, -1);
+        case CACTUS_CODEC_ZLIB_FAST:
+            return stCompression_compress((void *) data, size, compressedSize, 1);
+        case CACTUS_CODEC_NONE: {
+            uint8_t *record = st_malloc(size + 1);
+            record[0] = CODEC_TAG_NONE;
+            memcpy(record + 1, data, size);
+            *compressedSize = size + 1;
+            return record;
+        }
+#ifdef HAVE_LZ4
+        case CACTUS_CODEC_LZ4: {
+            if (size > LZ4_MAX_INPUT_SIZE) { //Too big for LZ4, fall back to zlib.
+                return stCompression_compress((void *) data, size, compressedSize, 1);
+            }
+            int64_t bound = LZ4_compressBound(size);
+            uint8_t *record = addHeader(CODEC_TAG_LZ4, size, bound);
+            int64_t i = LZ4_compress_default(data, (char *) record + CODEC_HEADER_SIZE, size, bound);
+            if (i <= 0 && size > 0) {
+                st_errAbort("LZ4 compression of a %" PRIi64 " byte record failed", size);
+            }
+            *compressedSize = CODEC_HEADER_SIZE + i;
+            return record;
+        }
+#endif
+#ifdef HAVE_ZSTD
+        case CACTUS_CODEC_ZSTD: {
+            int64_t bound = ZSTD_compressBound(size);
+            uint8_t *record = addHeader(CODEC_TAG_ZSTD, size, bound);
+            size_t i = ZSTD_compress(record + CODEC_HEADER_SIZE, bound, data, size, CODEC_ZSTD_LEVEL);
+            if (ZSTD_isError(i)) {
+                st_errAbort("Zstd compression failed: %s", ZSTD_getErrorName(i));
+            }
+            *compressedSize = CODEC_HEADER_SIZE + i;
+            return record;
+        }
+#endif
+        default:
+            stThrowNew(CACTUS_COMPRESSION_EXCEPTION_ID, "The compression codec %" PRIi64 " is not available in this build",
+                    (int64_t) codec);
+    }
+    return NULL;
+}
+
+static void *inflateRecord(const void *data, int64_t size, int64_t *uncompressedSize) {
+    /*
+     * Decompresses a zlib stream, as written by stCompression_compress, returning NULL on failure.
+     */
+    if (size <= 0 || size > UINT_MAX) {
+        return NULL;
+    }
+    z_stream stream;
+    memset(&stream, 0, sizeof(z_stream));
+    if (inflateInit(&stream) != Z_OK) {
+        return NULL;
+    }
+    stream.next_in = (Bytef *) data;
+    stream.avail_in = size;
+    int64_t capacity = 4 * size + 64;
+    char *uncompressed = st_malloc(capacity);
+    int i;
+    do {
+        if (stream.total_out == capacity) {
+            capacity *= 2;
+            uncompressed = st_realloc(uncompressed, capacity);
+        }
+        int64_t available = capacity - stream.total_out;
+        stream.next_out = (Bytef *) uncompressed + stream.total_out;
+        stream.avail_out = available > UINT_MAX ? UINT_MAX : available;
+        i = inflate(&stream, Z_NO_FLUSH);
+    } while (i == Z_OK);
+    *uncompressedSize = stream.total_out;
+    inflateEnd(&stream);
+    if (i != Z_STREAM_END) {
+        free(uncompressed);
+        return NULL;
+    }
+    return uncompressed;
+}
+
+void *cactusCompression_tryDecompress(const void *data, int64_t size, int64_t *uncompressedSize) {
+    const uint8_t *record = data;
+    if (size == 0 || (record[0] != CODEC_TAG_NONE && record[0] != CODEC_TAG_LZ4 && record[0] != CODEC_TAG_ZSTD)) {
+        return inflateRecord(data, size, uncompressedSize); //A zlib record.
+    }
+    if (record[0] == CODEC_TAG_NONE) {
+        *uncompressedSize = size - 1;
+        void *uncompressed = st_malloc(*uncompressedSize);
+        memcpy(uncompressed, record + 1, *uncompressedSize);
+        return uncompressed;
+    }
+    if (size < CODEC_HEADER_SIZE) {
+        return NULL;
+    }
+    memcpy(uncompressedSize, record + 1, sizeof(int64_t));
+    if (*uncompressedSize < 0) {
+        return NULL;
+    }
+    char *uncompressed = st_malloc(*uncompressedSize);
+    bool decompressed = 0;
+    if (record[0] == CODEC_TAG_LZ4) {
+#ifdef HAVE_LZ4
+        decompressed = LZ4_decompress_safe((const char *) record + CODEC_HEADER_SIZE, uncompressed,
+                size - CODEC_HEADER_SIZE, *uncompressedSize) == *uncompressedSize;
+#endif
+    } else {
+#ifdef HAVE_ZSTD
+        size_t i = ZSTD_decompress(uncompressed, *uncompressedSize, record + CODEC_HEADER_SIZE,
+                size - CODEC_HEADER_SIZE);
+        decompressed = !ZSTD_isError(i) && (int64_t) i == *uncompressedSize;
+#endif
+    }
+    if (!decompressed) {
+        free(uncompressed);
+        return NULL;
+    }
+    return uncompressed;
+}
+
+void *cactusCompression_decompress(const void *data, int64_t size, int64_t *uncompressedSize) {
+    void *uncompressed = cactusCompression_tryDecompress(data, size, uncompressedSize);
+    if (uncompressed == NULL) {
+        const uint8_t *record = data;
+        const char *codecName = size > 0 && record[0] == CODEC_TAG_NONE ? "uncompressed" :
+                (size > 0 && record[0] == CODEC_TAG_LZ4 ? "LZ4" : (size > 0 && record[0] == CODEC_TAG_ZSTD ? "zstd" : "zlib"));
+        stThrowNew(CACTUS_COMPRESSION_EXCEPTION_ID, "Could not decompress a %s record of %" PRIi64
+                " bytes, it is corrupt or its codec is not available in this build", codecName, size);
+    }
+    return uncompressed;
+}
@@ -12,10 +12,20 @@
 #include <unistd.h>
 #include <math.h>
 #include <time.h>
+#include <pthread.h>
+#include <ctype.h>
 #define CACTUS_DISK_NAME_INCREMENT 16384
+#define CACTUS_DISK_MAX_NAME_INCREMENT 16777216
+#define CACTUS_DISK_NAME_INTERVAL_SECONDS 60.0
 #define CACTUS_DISK_BUCKET_NUMBER 65536
 #define CACTUS_DISK_PARAMETER_KEY -100000
 #define CACTUS_DISK_SEQUENCE_CHUNK_SIZE 500
+#define CACTUS_DISK_SEQUENCE_BLOCK_SIZE 65536
+#define CACTUS_DISK_RECORD_CACHE_SIZE 10000000
+#define CACTUS_DISK_STRING_CACHE_SIZE 100000000
+#define CACTUS_DISK_WRITE_BATCH_RECORDS 1000
+#define CACTUS_DISK_WRITE_BATCH_BYTES 50000000
+#define CACTUS_DISK_WRITE_QUEUE_LENGTH 1000
 
 /*
  * Functions on meta sequences.
@@ -33,24 +43,133 @@ void cactusDisk_removeMetaSequence(CactusDisk *cactusDisk, MetaSequence *metaSeq
 
 /*
  * Functions on strings stored by the flower disk.
+ *
+ * A string is cut into blocks of sequenceBlockSize characters, each stored as a record keyed by the
+ * name of the string plus the index of the block. Disks created before sequence blocks were
+ * introduced store plain CACTUS_DISK_SEQUENCE_CHUNK_SIZE character chunks instead, which is
+ * indicated by a sequenceBlockSize of zero.
+ *
+ * A sequence block record is a SequenceBlockHeader, followed by the runs of characters other than
+ * ACGT (Ns, IUPAC codes, etc.), the runs of lower case (soft-masked) characters, and finally the
+ * bases packed four to a byte, the first base in the low bits. Positions covered by an exception
+ * run are packed as A.
  */
 
-Name cactusDisk_addString(CactusDisk *cactusDisk, const char *string) {
+typedef struct _sequenceBlockHeader {
+    int64_t length;
+    int32_t exceptionRunNumber;
+    int32_t maskRunNumber;
+} SequenceBlockHeader;
+
+typedef struct _exceptionRun {
+    int32_t start;
+    int32_t length;
+    char base;
+} ExceptionRun;
+
+typedef struct _maskRun {
+    int32_t start;
+    int32_t length;
+} MaskRun;
+
+static int64_t baseToCode(char base) {
+    switch (base) {
+        case 'A':
+            return 0;
+        case 'C':
+            return 1;
+        case 'G':
+            return 2;
+        case 'T':
+            return 3;
+        default:
+            return -1;
+    }
+}
+
+static void *encodeSequenceBlock(const char *string, int64_t length, int64_t *recordSize) {
     /*
-     * Adds a string to the database.
+     * Encodes the given characters as a sequence block record.
      */
-    int64_t stringSize = strlen(string);
-    int64_t intervalSize = ceil((double) stringSize / CACTUS_DISK_SEQUENCE_CHUNK_SIZE);
-    Name name = cactusDisk_getUniqueIDInterval(cactusDisk, intervalSize);
-    stList *insertRequests = stList_construct3(0, (void (*)(void *)) stKVDatabaseBulkRequest_destruct);
-    for (int64_t i = 0; i * CACTUS_DISK_SEQUENCE_CHUNK_SIZE < stringSize; i++) {
-        int64_t j =
-            (i + 1) * CACTUS_DISK_SEQUENCE_CHUNK_SIZE < stringSize ?
-            CACTUS_DISK_SEQUENCE_CHUNK_SIZE : stringSize - i * CACTUS_DISK_SEQUENCE_CHUNK_SIZE;
-        char *subString = stString_getSubString(string, i * CACTUS_DISK_SEQUENCE_CHUNK_SIZE, j);
-        stList_append(insertRequests, stKVDatabaseBulkRequest_constructInsertRequest(name + i, subString, j + 1));
-        free(subString);
+    assert(length <= INT32_MAX);
+    int64_t exceptionRunNumber = 0, maskRunNumber = 0;
+    for (int64_t i = 0; i < length; i++) {
+        char base = toupper((unsigned char) string[i]);
+        if (baseToCode(base) == -1 && (i == 0 || toupper((unsigned char) string[i - 1]) != base)) {
+            exceptionRunNumber++;
+        }
+        if (islower((unsigned char) string[i]) && (i == 0 || !islower((unsigned char) string[i - 1]))) {
+            maskRunNumber++;
+        }
+    }
+    *recordSize = sizeof(SequenceBlockHeader) + exceptionRunNumber * sizeof(ExceptionRun)
+            + maskRunNumber * sizeof(MaskRun) + (length + 3) / 4;
+    char *record = st_calloc(*recordSize, 1);
+    SequenceBlockHeader *header = (SequenceBlockHeader *) record;
+    header->length = length;
+    header->exceptionRunNumber = exceptionRunNumber;
+    header->maskRunNumber = maskRunNumber;
+    ExceptionRun *exceptionRuns = (ExceptionRun *) (header + 1);
+    MaskRun *maskRuns = (MaskRun *) (exceptionRuns + exceptionRunNumber);
+    uint8_t *packedBases = (uint8_t *) (maskRuns + maskRunNumber);
+    int64_t exceptionRun = -1, maskRun = -1;
+    for (int64_t i = 0; i < length; i++) {
+        char base = toupper((unsigned char) string[i]);
+        int64_t code = baseToCode(base);
+        if (code == -1) {
+            if (i == 0 || toupper((unsigned char) string[i - 1]) != base) {
+                exceptionRuns[++exceptionRun].start = i;
+                exceptionRuns[exceptionRun].base = base;
+            }
+            exceptionRuns[exceptionRun].length++;
+        } else {
+            packedBases[i >> 2] |= code << ((i & 3) << 1);
+        }
+        if (islower((unsigned char) string[i])) {
+            if (i == 0 || !islower((unsigned char) string[i - 1])) {
+                maskRuns[++maskRun].start = i;
+            }
+            maskRuns[maskRun].length++;
+        }
+    }
+    assert(exceptionRun + 1 == exceptionRunNumber && maskRun + 1 == maskRunNumber);
+    return record;
+}
+
+static void decodeSequenceBlock(const void *record, int64_t start, int64_t length, char *string) {
+    /*
+     * Decodes the characters [start, start + length) of a sequence block record into string.
+     */
+    const SequenceBlockHeader *header = record;
+    const ExceptionRun *exceptionRuns = (const ExceptionRun *) (header + 1);
+    const MaskRun *maskRuns = (const MaskRun *) (exceptionRuns + header->exceptionRunNumber);
+    const uint8_t *packedBases = (const uint8_t *) (maskRuns + header->maskRunNumber);
+    assert(start >= 0 && start + length <= header->length);
+    for (int64_t i = 0; i < length; i++) {
+        int64_t j = start + i;
+        string[i] = "ACGT"[(packedBases[j >> 2] >> ((j & 3) << 1)) & 3];
+    }
+    for (int64_t i = 0; i < header->exceptionRunNumber; i++) {
+        const ExceptionRun *run = &exceptionRuns[i];
+        if (run->start >= start + length) {
+            break;
+        }
+        for (int64_t j = run->start > start ? run->start : start; j < run->start + run->length && j < start + length; j++) {
+            string[j - start] = run->base;
+        }
     }
+    for (int64_t i = 0; i < header->maskRunNumber; i++) {
+        const MaskRun *run = &maskRuns[i];
+        if (run->start >= start + length) {
+            break;
+        }
+        for (int64_t j = run->start > start ? run->start : start; j < run->start + run->length && j < start + length; j++) {
+            string[j - start] = tolower((unsigned char) string[j - start]);
+        }
+    }
+}
+
+static void insertStringRecords(CactusDisk *cactusDisk, stList *insertRequests) {
     stTry
     {
         stKVDatabase_bulkSetRecords(cactusDisk->database, insertRequests);
@@ -61,6 +180,42 @@ Name cactusDisk_addString(CactusDisk *cactusDisk, const char *string) {
                         "An unknown database error occurred when we tried to add a string to the cactus disk");
     }stTryEnd
          ;
+    while (stList_length(insertRequests) > 0) {
+        stKVDatabaseBulkRequest_destruct(stList_pop(insertRequests));
+    }
+}
+
+Name cactusDisk_addString(CactusDisk *cactusDisk, const char *string) {
+    /*
+     * Adds a string to the database.
+     */
+    cactusDisk->sequenceBlockSizeFixed = 1;
+    int64_t stringSize = strlen(string);
+    int64_t blockSize = cactusDisk->sequenceBlockSize > 0 ? cactusDisk->sequenceBlockSize : CACTUS_DISK_SEQUENCE_CHUNK_SIZE;
+    int64_t intervalSize = (stringSize + blockSize - 1) / blockSize;
+    Name name = cactusDisk_getUniqueIDInterval(cactusDisk, intervalSize);
+    stList *insertRequests = stList_construct3(0, (void (*)(void *)) stKVDatabaseBulkRequest_destruct);
+    int64_t bytes = 0;
+    for (int64_t i = 0; i * blockSize < stringSize; i++) {
+        int64_t j = (i + 1) * blockSize < stringSize ? blockSize : stringSize - i * blockSize;
+        if (cactusDisk->sequenceBlockSize > 0) {
+            int64_t recordSize;
+            void *record = encodeSequenceBlock(string + i * blockSize, j, &recordSize);
+            stList_append(insertRequests, stKVDatabaseBulkRequest_constructInsertRequest(name + i, record, recordSize));
+            free(record);
+            bytes += recordSize;
+        } else {
+            char *subString = stString_getSubString(string, i * blockSize, j);
+            stList_append(insertRequests, stKVDatabaseBulkRequest_constructInsertRequest(name + i, subString, j + 1));
+            free(subString);
+            bytes += j + 1;
+        }
+        if (bytes >= CACTUS_DISK_WRITE_BATCH_BYTES) { //Write large strings in pieces.
+            insertStringRecords(cactusDisk, insertRequests);
+            bytes = 0;
+        }
+    }
+    insertStringRecords(cactusDisk, insertRequests);
     stList_destruct(insertRequests);
     return name;
 }
@@ -136,13 +291,107 @@ static stList *mergeSubstrings(stList *substrings, int64_t proximityToMerge) {
     return mergedSubstrings;
 }
 
-static void cacheSubstringsFromDB(CactusDisk *cactusDisk, stList *substrings) {
-    if (cactusDisk->stringCache == NULL) {
-        // No string cache.
-        return;
+static stList *getRecordsFromDB(CactusDisk *cactusDisk, stList *getRequests) {
+    stList *records = NULL;
+    stTry
+    {
+        records = stKVDatabase_bulkGetRecords(cactusDisk->database, getRequests);
+    }
+    stCatch(except)
+    {
+        stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
+                        "An unknown database error occurred when getting a sequence string");
+    }stTryEnd
+         ;
+    assert(records != NULL);
+    assert(stList_length(records) == stList_length(getRequests));
+    return records;
+}
+
+static stList *getBlockRequests(int64_t blockSize, stList *substrings, int64_t *firstRecords) {
+    /*
+     * Gets the keys of the sequence blocks holding the given substrings, setting firstRecords[i]
+     * to the index of the first block of the ith substring. Each block is requested once, even
+     * if it is shared by consecutive substrings.
+     */
+    stList *getRequests = stList_construct3(0, free);
+    for (int64_t i = 0; i < stList_length(substrings); i++) {
+        Substring *substring = stList_get(substrings, i);
+        Name firstBlock = substring->name + substring->start / blockSize;
+        Name lastBlock = substring->name + (substring->start + substring->length - 1) / blockSize;
+        int64_t j = stList_length(getRequests);
+        if (j > 0 && *(int64_t *) stList_peek(getRequests) == firstBlock) {
+            j--; //Shares its first block with the previous substring
+        }
+        firstRecords[i] = j;
+        for (Name k = firstBlock + (j < stList_length(getRequests) ? 1 : 0); k <= lastBlock; k++) {
+            int64_t *key = st_malloc(sizeof(int64_t));
+            key[0] = k;
+            stList_append(getRequests, key);
+        }
     }
+    return getRequests;
+}
+
+static void decodeBlockRecords(int64_t blockSize, stList *substrings, int64_t *firstRecords, stList *records,
+        char **strings) {
     /*
-     * Caches the given set of substrings in the cactusDisk cache.
+     * Decodes each of the given substrings from the fetched sequence blocks into the
+     * corresponding buffer in strings.
+     */
+    for (int64_t i = 0; i < stList_length(substrings); i++) {
+        Substring *substring = stList_get(substrings, i);
+        int64_t k = firstRecords[i];
+        for (int64_t j = substring->start; j < substring->start + substring->length; k++) {
+            int64_t offset = j % blockSize;
+            int64_t length = blockSize - offset < substring->start + substring->length - j ?
+                    blockSize - offset : substring->start + substring->length - j;
+            int64_t recordSize;
+            void *record = stKVDatabaseBulkResult_getRecord(stList_get(records, k), &recordSize);
+            assert(record != NULL);
+            assert(recordSize >= sizeof(SequenceBlockHeader));
+            decodeSequenceBlock(record, offset, length, strings[i] + j - substring->start);
+            j += length;
+        }
+    }
+}
+
+static void getSubstringsFromBlocks(CactusDisk *cactusDisk, stList *substrings, char **strings) {
+    /*
+     * Decodes each of the given substrings from the sequence blocks in the database into the
+     * corresponding buffer in strings.
+     */
+    int64_t *firstRecords = st_malloc(sizeof(int64_t) * (stList_length(substrings) + 1));
+    stList *getRequests = getBlockRequests(cactusDisk->sequenceBlockSize, substrings, firstRecords);
+    if (stList_length(getRequests) > 0) {
+        stList *records = getRecordsFromDB(cactusDisk, getRequests);
+        decodeBlockRecords(cactusDisk->sequenceBlockSize, substrings, firstRecords, records, strings);
+        stList_destruct(records);
+    }
+    stList_destruct(getRequests);
+    free(firstRecords);
+}
+
+static void cacheSubstringBlocksFromDB(CactusDisk *cactusDisk, stList *substrings) {
+    /*
+     * Caches the given set of substrings, stored as sequence blocks, in the cactusDisk cache.
+     */
+    char **strings = st_malloc(sizeof(char *) * (stList_length(substrings) + 1));
+    for (int64_t i = 0; i < stList_length(substrings); i++) {
+        strings[i] = st_malloc(((Substring *) stList_get(substrings, i))->length);
+    }
+    getSubstringsFromBlocks(cactusDisk, substrings, strings);
+    for (int64_t i = 0; i < stList_length(substrings); i++) {
+        Substring *substring = stList_get(substrings, i);
+        stringCache_setString(cactusDisk->stringCache, substring->name, substring->start, substring->length, strings[i]);
+        free(strings[i]);
+    }
+    free(strings);
+}
+
+static void cacheSubstringChunksFromDB(CactusDisk *cactusDisk, stList *substrings) {
+    /*
+     * Caches the given set of substrings, stored as plain chunks, in the cactusDisk cache.
      */
     stList *getRequests = stList_construct3(0, free);
     for (int64_t i = 0; i < stList_length(substrings); i++) {
@@ -160,19 +409,7 @@ static void cacheSubstringsFromDB(CactusDisk *cactusDisk, stList *substrings) {
         stList_destruct(getRequests);
         return;
     }
-    stList *records = NULL;
-    stTry
-    {
-        records = stKVDatabase_bulkGetRecords(cactusDisk->database, getRequests);
-    }
-    stCatch(except)
-    {
-        stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
-                        "An unknown database error occurred when getting a sequence string");
-    }stTryEnd
-         ;
-    assert(records != NULL);
-    assert(stList_length(records) == stList_length(getRequests));
+    stList *records = getRecordsFromDB(cactusDisk, getRequests);
     stList_destruct(getRequests);
     stListIterator *recordsIt = stList_getIterator(records);
     for (int64_t i = 0; i < stList_length(substrings); i++) {
@@ -192,7 +429,7 @@ static void cacheSubstringsFromDB(CactusDisk *cactusDisk, stList *substrings) {
         }
         assert(stList_length(strings) > 0);
         char *joinedString = stString_join2("", strings);
-        stCache_setRecord(cactusDisk->stringCache, substring->name,
+        stringCache_setString(cactusDisk->stringCache, substring->name,
                           (substring->start / CACTUS_DISK_SEQUENCE_CHUNK_SIZE) * CACTUS_DISK_SEQUENCE_CHUNK_SIZE,
                           strlen(joinedString), joinedString);
         free(joinedString);
@@ -203,6 +440,41 @@ static void cacheSubstringsFromDB(CactusDisk *cactusDisk, stList *substrings) {
     stList_destruct(records);
 }
 
+static void cacheSubstringsFromDB(CactusDisk *cactusDisk, stList *substrings) {
+    /*
+     * Caches the given set of substrings in the cactusDisk cache.
+     */
+    if (cactusDisk->stringCache == NULL) {
+        // No string cache.
+        return;
+    }
+    if (cactusDisk->sequenceBlockSize > 0) {
+        cacheSubstringBlocksFromDB(cactusDisk, substrings);
+    } else {
+        cacheSubstringChunksFromDB(cactusDisk, substrings);
+    }
+}
+
+static stList *getSubstringsToCache(CactusDisk *cactusDisk, stList *substrings) {
+    /*
+     * Gets the substrings that need fetching from the database to cache the given substrings,
+     * merged to reduce granularity. Strings in the sequence store needn't be cached.
+     */
+    if (cactusDisk->sequenceStore == NULL) {
+        return mergeSubstrings(substrings, CACTUS_DISK_SEQUENCE_CHUNK_SIZE);
+    }
+    stList *unstoredSubstrings = stList_construct();
+    for (int64_t i = 0; i < stList_length(substrings); i++) {
+        Substring *substring = stList_get(substrings, i);
+        if (!sequenceStore_containsString(cactusDisk->sequenceStore, substring->name)) {
+            stList_append(unstoredSubstrings, substring);
+        }
+    }
+    stList *mergedSubstrings = mergeSubstrings(unstoredSubstrings, CACTUS_DISK_SEQUENCE_CHUNK_SIZE);
+    stList_destruct(unstoredSubstrings);
+    return mergedSubstrings;
+}
+
 void cactusDisk_preCacheStrings2(CactusDisk *cactusDisk, stList *substrings) {
     /*
      * Precaches the given substrings, so that they are all in memory.
@@ -211,9 +483,7 @@ void cactusDisk_preCacheStrings2(CactusDisk *cactusDisk, stList *substrings) {
         // No string cache.
         return;
     }
-    //Now do some simple merging to reduce granularity
-    stList *mergedSubstrings = mergeSubstrings(substrings, CACTUS_DISK_SEQUENCE_CHUNK_SIZE);
-    //Now cache the sequences
+    stList *mergedSubstrings = getSubstringsToCache(cactusDisk, substrings);
     cacheSubstringsFromDB(cactusDisk, mergedSubstrings);
     stList_destruct(mergedSubstrings);
 }
@@ -314,19 +584,28 @@ void cactusDisk_preCacheSegmentStrings(CactusDisk *cactusDisk, stList *flowers)
 
 char *cactusDisk_getStringFromCache(CactusDisk *cactusDisk, Name name, int64_t start, int64_t length, int64_t strand) {
     /*
-     * Gets a sequence from the cache.
+     * Gets a sequence from the sequence store, if it contains it, else from the cache.
      */
+    if (cactusDisk->sequenceStore != NULL) {
+        const char *storedString = sequenceStore_getString(cactusDisk->sequenceStore, name, start, length);
+        if (storedString != NULL) {
+            char *string = st_malloc(sizeof(char) * (length + 1));
+            memcpy(string, storedString, length);
+            string[length] = '\0';
+            if (!strand) {
+                char *string2 = stString_reverseComplementString(string);
+                free(string);
+                string = string2;
+            }
+            return string;
+        }
+    }
     if (cactusDisk->stringCache == NULL) {
         // No cache.
         return NULL;
     }
-    char *string = NULL;
-    if (stCache_containsRecord(cactusDisk->stringCache, name, start, sizeof(char) * length)) {
-        int64_t recordSize;
-        string = stCache_getRecord(cactusDisk->stringCache, name, start, sizeof(char) * length, &recordSize);
-        assert(string != NULL);
-        assert(recordSize == length);
-        string = st_realloc(string, sizeof(char) * (length + 1));
+    char *string = stringCache_getString(cactusDisk->stringCache, name, start, length);
+    if (string != NULL) {
         string[length] = '\0';
         if (!strand) {
             char *string2 = stString_reverseComplementString(string);
@@ -349,7 +628,22 @@ char *cactusDisk_getString(CactusDisk *cactusDisk, Name name, int64_t start, int
     }
     //First try getting it from the cache
     char *string = cactusDisk_getStringFromCache(cactusDisk, name, start, length, strand);
-    if (string == NULL) { //If not in the cache, add it to the cache and then get it from the cache.
+    if (string == NULL && cactusDisk->sequenceBlockSize > 0) { //Decode it straight from the blocks, then cache it.
+        stList *list = stList_construct3(0, (void (*)(void *)) substring_destruct);
+        stList_append(list, substring_construct(name, start, length));
+        string = st_malloc(sizeof(char) * (length + 1));
+        getSubstringsFromBlocks(cactusDisk, list, &string);
+        stList_destruct(list);
+        if (cactusDisk->stringCache != NULL) {
+            stringCache_setString(cactusDisk->stringCache, name, start, length, string);
+        }
+        string[length] = '\0';
+        if (!strand) {
+            char *string2 = stString_reverseComplementString(string);
+            free(string);
+            string = string2;
+        }
+    } else if (string == NULL) { //If not in the cache, add it to the cache and then get it from the cache.
         stList *list = stList_construct3(0, (void (*)(void *)) substring_destruct);
         stList_append(list, substring_construct(name, start, length));
         cacheSubstringsFromDB(cactusDisk, list);
@@ -384,6 +678,10 @@ static void cactusDisk_writeBinaryRepresentation(CactusDisk *cactusDisk,
     if (cactusDisk->eventTree != NULL) {
         eventTree_writeBinaryRepresentation(cactusDisk->eventTree, writeFn);
     }
+    if (cactusDisk->sequenceBlockSize > 0) {
+        binaryRepresentation_writeElementType(CODE_SEQUENCE_BLOCK_SIZE, writeFn);
+        binaryRepresentation_writeInteger(cactusDisk->sequenceBlockSize, writeFn);
+    }
     binaryRepresentation_writeElementType(CODE_CACTUS_DISK, writeFn);
 }
 
@@ -391,18 +689,26 @@ static void cactusDisk_loadFromBinaryRepresentation(void **binaryString, CactusD
     assert(binaryRepresentation_peekNextElementType(*binaryString) == CODE_CACTUS_DISK);
     binaryRepresentation_popNextElementType(binaryString);
     cactusDisk->eventTree = eventTree_loadFromBinaryRepresentation(binaryString, cactusDisk);
+    //Disks written before sequence blocks were introduced store their strings as plain chunks.
+    cactusDisk->sequenceBlockSize = 0;
+    if (binaryRepresentation_peekNextElementType(*binaryString) == CODE_SEQUENCE_BLOCK_SIZE) {
+        binaryRepresentation_popNextElementType(binaryString);
+        cactusDisk->sequenceBlockSize = binaryRepresentation_getInteger(binaryString);
+    }
+    cactusDisk->sequenceBlockSizeFixed = 1;
     assert(binaryRepresentation_peekNextElementType(*binaryString) == CODE_CACTUS_DISK);
     binaryRepresentation_popNextElementType(binaryString);
 }
 
 /*
- * The following two functions compress and decompress the data in the cactus disk..
+ * The following two functions compress and decompress the data in the cactus disk. Records are
+ * written with the cactus disk's codec, and read back whichever codec wrote them.
  */
 
-static void *compress(void *data, int64_t *dataSize) {
+static void *compress(CactusDisk *cactusDisk, void *data, int64_t *dataSize) {
     //Compression
     int64_t compressedSize;
-    void *data2 = stCompression_compress(data, *dataSize, &compressedSize, -1);
+    void *data2 = cactusCompression_compress(cactusDisk->codec, data, *dataSize, &compressedSize);
     free(data);
     *dataSize = compressedSize;
     return data2;
@@ -411,12 +717,72 @@ static void *compress(void *data, int64_t *dataSize) {
 static void *decompress(void *data, int64_t *dataSize) {
     //Decompression
     int64_t uncompressedSize;
-    void *data2 = stCompression_decompress(data, *dataSize, &uncompressedSize);
+    void *data2 = cactusCompression_decompress(data, *dataSize, &uncompressedSize);
     *dataSize = uncompressedSize;
     return data2;
 }
 
-static stList *getRecords(CactusDisk *cactusDisk, stList *objectNames, char *type) {
+/*
+ * Content digests of the flower records. When a flower is loaded we keep a digest of its uncompressed
+ * record, so that on writing an unchanged flower can be detected without refetching and decompressing
+ * the record from the database.
+ */
+
+typedef struct _flowerDigest {
+    Name flowerName;
+    uint64_t digest;
+    int64_t recordSize;
+} FlowerDigest;
+
+static int flowerDigest_cmp(const FlowerDigest *flowerDigest1, const FlowerDigest *flowerDigest2) {
+    return cactusMisc_nameCompare(flowerDigest1->flowerName, flowerDigest2->flowerName);
+}
+
+static uint64_t getDigest(const void *record, int64_t recordSize) {
+    /*
+     * A 64 bit FNV-1a style hash, taken a word at a time.
+     */
+    const char *cA = record;
+    uint64_t digest = 0xcbf29ce484222325ULL ^ (uint64_t) recordSize;
+    int64_t i = 0;
+    for (; i + (int64_t) sizeof(uint64_t) <= recordSize; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, cA + i, sizeof(uint64_t));
+        digest = (digest ^ word) * 0x100000001b3ULL;
+        digest ^= digest >> 32;
+    }
+    for (; i < recordSize; i++) {
+        digest = (digest ^ (unsigned char) cA[i]) * 0x100000001b3ULL;
+    }
+    return digest;
+}
+
+static FlowerDigest *getFlowerDigest(CactusDisk *cactusDisk, Name flowerName) {
+    FlowerDigest flowerDigest;
+    flowerDigest.flowerName = flowerName;
+    return stSortedSet_search(cactusDisk->flowerDigests, &flowerDigest);
+}
+
+static void setFlowerDigest(CactusDisk *cactusDisk, Name flowerName, uint64_t digest, int64_t recordSize) {
+    FlowerDigest *flowerDigest = getFlowerDigest(cactusDisk, flowerName);
+    if (flowerDigest == NULL) {
+        flowerDigest = st_malloc(sizeof(FlowerDigest));
+        flowerDigest->flowerName = flowerName;
+        stSortedSet_insert(cactusDisk->flowerDigests, flowerDigest);
+    }
+    flowerDigest->digest = digest;
+    flowerDigest->recordSize = recordSize;
+}
+
+static void removeFlowerDigest(CactusDisk *cactusDisk, Name flowerName) {
+    FlowerDigest *flowerDigest = getFlowerDigest(cactusDisk, flowerName);
+    if (flowerDigest != NULL) {
+        stSortedSet_remove(cactusDisk->flowerDigests, flowerDigest);
+        free(flowerDigest);
+    }
+}
+
+static stList *getRecords(CactusDisk *cactusDisk, stList *objectNames, char *type, int64_t *recordSizes) {
     if (stList_length(objectNames) == 0) {
         return stList_construct3(0, NULL);
     }
@@ -456,6 +822,7 @@ static stList *getRecords(CactusDisk *cactusDisk, stList *objectNames, char *typ
         }
         stKVDatabaseBulkResult_destruct(result);
         stList_set(records, i, record);
+        recordSizes[i] = recordSize;
     }
     return records;
 }
@@ -511,17 +878,21 @@ static CactusDisk *cactusDisk_constructPrivate(stKVDatabaseConf *conf, bool crea
     cactusDisk->flowerNamesMarkedForDeletion = stSortedSet_construct3((int (*)(const void *, const void *)) strcmp,
             free);
     cactusDisk->updateRequests = stList_construct3(0, (void (*)(void *)) stKVDatabaseBulkRequest_destruct);
+    cactusDisk->flowerDigests = stSortedSet_construct3((int (*)(const void *, const void *)) flowerDigest_cmp, free);
 
     cactusDisk->eventTree = NULL;
+    cactusDisk->writeThreads = 1;
+    cactusDisk->codec = CACTUS_CODEC_ZLIB;
+    cactusDisk->sequenceBlockSize = CACTUS_DISK_SEQUENCE_BLOCK_SIZE;
+    cactusDisk->sequenceBlockSizeFixed = 0;
 
     //Now open the database
     cactusDisk->database = stKVDatabase_construct(conf, create);
     if (cache) {
-        // 10MB for general DB responses
-        cactusDisk->cache = stCache_construct2(10000000);
+        cactusDisk->cache = stCache_construct2(CACTUS_DISK_RECORD_CACHE_SIZE);
     }
-    // 100MB for strings
-    cactusDisk->stringCache = stCache_construct2(10000000);
+    cactusDisk->stringCache = stringCache_construct(CACTUS_DISK_STRING_CACHE_SIZE);
+    cactusDisk->sequenceStore = NULL;
 
     //initialise the unique ids.
     int64_t seed = (clock() << 24) | (time(NULL) << 16) | (getpid() & 65535); //Likely to be unique
@@ -529,6 +900,10 @@ static CactusDisk *cactusDisk_constructPrivate(stKVDatabaseConf *conf, bool crea
     st_randomSeed(seed);
     cactusDisk->uniqueNumber = 0;
     cactusDisk->maxUniqueNumber = 0;
+    cactusDisk->nameIncrement = CACTUS_DISK_NAME_INCREMENT;
+    cactusDisk->nameIntervalStart = 0.0;
+    cactusDisk->nameBucket = 0;
+    cactusDisk->uniqueIDRoundTrips = 0;
 
     //Now load any stuff..
     if (containsRecord(cactusDisk, CACTUS_DISK_PARAMETER_KEY)) {
@@ -561,6 +936,8 @@ void cactusDisk_destruct(CactusDisk *cactusDisk) {
 
     stSortedSet_destruct(cactusDisk->flowerNamesMarkedForDeletion);
 
+    stSortedSet_destruct(cactusDisk->flowerDigests);
+
     while ((metaSequence = stSortedSet_getFirst(cactusDisk->metaSequences)) != NULL) {
         metaSequence_destruct(metaSequence);
     }
@@ -573,7 +950,10 @@ void cactusDisk_destruct(CactusDisk *cactusDisk) {
         stCache_destruct(cactusDisk->cache);
     }
     if (cactusDisk->stringCache != NULL) {
-        stCache_destruct(cactusDisk->stringCache);
+        stringCache_destruct(cactusDisk->stringCache);
+    }
+    if (cactusDisk->sequenceStore != NULL) {
+        sequenceStore_destruct(cactusDisk->sequenceStore);
     }
 
     stList_destruct(cactusDisk->updateRequests);
@@ -581,27 +961,51 @@ void cactusDisk_destruct(CactusDisk *cactusDisk) {
     free(cactusDisk);
 }
 
+static void addUpdateRequest(CactusDisk *cactusDisk, stList *updateRequests, Name flowerName,
+        void *record, int64_t recordSize, void *compressed, int64_t compressedSize) {
+    /*
+     * Adds an insert or update request for the given serialised flower, unless it is identical
+     * to the record already in the database. Flowers that were loaded from the database are
+     * compared by digest, others by fetching the existing record, if any.
+     */
+    FlowerDigest *flowerDigest = getFlowerDigest(cactusDisk, flowerName);
+    if (flowerDigest != NULL) {
+        if (flowerDigest->recordSize != recordSize || flowerDigest->digest != getDigest(record, recordSize)) {
+            stList_append(updateRequests,
+                    stKVDatabaseBulkRequest_constructUpdateRequest(flowerName, compressed, compressedSize));
+        }
+    } else if (containsRecord(cactusDisk, flowerName)) {
+        // Check if this is a redundant update.
+        int64_t recordSize2;
+        void *record2 = getRecord(cactusDisk, flowerName, "flower", &recordSize2);
+        if (!stCache_recordsIdentical(record, recordSize, record2, recordSize2)) { //Only rewrite if we actually did something
+            stList_append(updateRequests,
+                    stKVDatabaseBulkRequest_constructUpdateRequest(flowerName, compressed, compressedSize));
+        }
+        free(record2);
+    } else {
+        stList_append(updateRequests,
+                stKVDatabaseBulkRequest_constructInsertRequest(flowerName, compressed, compressedSize));
+    }
+}
+
 void cactusDisk_addUpdateRequest(CactusDisk *cactusDisk, Flower *flower) {
     int64_t recordSize;
     void *vA = binaryRepresentation_makeBinaryRepresentation(flower,
             (void (*)(void *, void (*)(const void * ptr, size_t size, size_t count))) flower_writeBinaryRepresentation,
             &recordSize);
+    FlowerDigest *flowerDigest = getFlowerDigest(cactusDisk, flower_getName(flower));
+    uint64_t digest = getDigest(vA, recordSize);
+    if (flowerDigest != NULL && flowerDigest->recordSize == recordSize && flowerDigest->digest == digest) {
+        free(vA); // Unchanged, so there is nothing to write.
+        return;
+    }
     //Compression
     int64_t compressedSize;
-    void *compressed = stCompression_compress(vA, recordSize, &compressedSize, -1);
-    if (containsRecord(cactusDisk, flower_getName(flower))) {
-        // Check if this is a redundant update.
-        int64_t recordSize2;
-        void *vA2 = getRecord(cactusDisk, flower_getName(flower), "flower", &recordSize2);
-        if (!stCache_recordsIdentical(vA, recordSize, vA2, recordSize2)) { //Only rewrite if we actually did something
-            stList_append(cactusDisk->updateRequests,
-                    stKVDatabaseBulkRequest_constructUpdateRequest(flower_getName(flower), compressed, compressedSize));
-        }
-        free(vA2);
-    } else {
-        stList_append(cactusDisk->updateRequests,
-                stKVDatabaseBulkRequest_constructInsertRequest(flower_getName(flower), compressed, compressedSize));
-    }
+    void *compressed = cactusCompression_compress(cactusDisk->codec, vA, recordSize, &compressedSize);
+    addUpdateRequest(cactusDisk, cactusDisk->updateRequests, flower_getName(flower), vA, recordSize, compressed,
+            compressedSize);
+    setFlowerDigest(cactusDisk, flower_getName(flower), digest, recordSize);
     free(vA);
     free(compressed);
 }
@@ -613,7 +1017,7 @@ void cactusDisk_forceParameterUpdate(CactusDisk *cactusDisk, bool keyAlreadyExis
                                                       (void (*)(void *, void (*)(const void * ptr, size_t size, size_t count))) cactusDisk_writeBinaryRepresentation,
                                                       &recordSize);
     //Compression
-    cactusDiskParameters = compress(cactusDiskParameters, &recordSize);
+    cactusDiskParameters = compress(cactusDisk, cactusDiskParameters, &recordSize);
     if (keyAlreadyExists) {
         stList_append(cactusDisk->updateRequests,
                       stKVDatabaseBulkRequest_constructUpdateRequest(CACTUS_DISK_PARAMETER_KEY, cactusDiskParameters,
@@ -626,25 +1030,269 @@ void cactusDisk_forceParameterUpdate(CactusDisk *cactusDisk, bool keyAlreadyExis
     free(cactusDiskParameters);
 }
 
-void cactusDisk_write(CactusDisk *cactusDisk) {
-    Flower *flower;
+/*
+ * Functions used to write the flowers and meta sequences in memory to the database. A pool of
+ * worker threads serialises and compresses the objects, while a single committer thread
+ * checks for redundant updates and streams the finished requests to the database in bounded
+ * batches. Only the committer touches the database (and the record cache) while the workers
+ * are running.
+ */
+
+typedef struct _writeCommitter {
+    CactusDisk *cactusDisk;
+    pthread_mutex_t mutex;
+    pthread_cond_t jobAvailable;
+    pthread_cond_t spaceAvailable;
+    stList *pendingJobs; // Serialised objects waiting to be committed.
+    bool finished; // Set once every job has been handed to the committer.
+    stList *batch; // Requests waiting to be sent to the database.
+    int64_t batchBytes;
+    int64_t recordsWritten;
+    stList *flowerDigests; // Digests of the flowers written, applied once the workers are done.
+    stExcept *except; // The first exception raised by the committer, rethrown by the writing thread.
+} WriteCommitter;
+
+typedef struct _writeJob {
+    WriteCommitter *committer;
+    void *object;
+    Name name;
+    void (*writeBinaryRepresentation)(void *, void (*writeFn)(const void * ptr, size_t size, size_t count));
+    bool isFlower;
+    void *record;
     int64_t recordSize;
+    uint64_t digest;
+    bool unchanged; // The flower is identical to the record it was loaded from.
+    void *compressed;
+    int64_t compressedSize;
+} WriteJob;
+
+static WriteJob *writeJob_construct(WriteCommitter *committer, void *object, Name name,
+        void (*writeBinaryRepresentation)(void *, void (*writeFn)(const void * ptr, size_t size, size_t count)),
+        bool isFlower) {
+    WriteJob *job = st_calloc(1, sizeof(WriteJob));
+    job->committer = committer;
+    job->object = object;
+    job->name = name;
+    job->writeBinaryRepresentation = writeBinaryRepresentation;
+    job->isFlower = isFlower;
+    return job;
+}
 
-    stList *removeRequests = stList_construct3(0, (void (*)(void *)) stIntTuple_destruct);
+static void writeJob_destruct(WriteJob *job) {
+    free(job->record);
+    free(job->compressed);
+    free(job);
+}
 
-    st_logDebug("Starting to write the cactus to disk\n");
+static WriteJob *writeJob_serialise(WriteJob *job) {
+    /*
+     * Run by the worker threads: serialises and compresses the object. The flower digests are
+     * only read while the workers run.
+     */
+    job->record = binaryRepresentation_makeBinaryRepresentation(job->object, job->writeBinaryRepresentation,
+            &job->recordSize);
+    if (job->isFlower) {
+        job->digest = getDigest(job->record, job->recordSize);
+        FlowerDigest *flowerDigest = getFlowerDigest(job->committer->cactusDisk, job->name);
+        if (flowerDigest != NULL && flowerDigest->recordSize == job->recordSize && flowerDigest->digest == job->digest) {
+            job->unchanged = 1;
+            free(job->record);
+            job->record = NULL;
+            return job;
+        }
+    }
+    job->compressed = cactusCompression_compress(job->committer->cactusDisk->codec, job->record, job->recordSize,
+            &job->compressedSize);
+    if (!job->isFlower) { // Only flowers are checked for redundant updates.
+        free(job->record);
+        job->record = NULL;
+    }
+    return job;
+}
+
+static void writeJob_handToCommitter(WriteJob *job) {
+    /*
+     * Run (serially) as the worker pool's finish function. Blocks while the committer's queue
+     * is full, so that the serialised records held in memory stay bounded.
+     */
+    WriteCommitter *committer = job->committer;
+    pthread_mutex_lock(&committer->mutex);
+    while (stList_length(committer->pendingJobs) >= CACTUS_DISK_WRITE_QUEUE_LENGTH) {
+        pthread_cond_wait(&committer->spaceAvailable, &committer->mutex);
+    }
+    stList_append(committer->pendingJobs, job);
+    pthread_cond_signal(&committer->jobAvailable);
+    pthread_mutex_unlock(&committer->mutex);
+}
+
+static void writeCommitter_flush(WriteCommitter *committer) {
+    if (stList_length(committer->batch) > 0) {
+        st_logDebug("Writing a batch of %" PRIi64 " updates\n", stList_length(committer->batch));
+        stKVDatabase_bulkSetRecords(committer->cactusDisk->database, committer->batch);
+        committer->recordsWritten += stList_length(committer->batch);
+        stList_destruct(committer->batch);
+        committer->batch = stList_construct3(0, (void (*)(void *)) stKVDatabaseBulkRequest_destruct);
+        committer->batchBytes = 0;
+    }
+}
+
+static void writeCommitter_commit(WriteCommitter *committer, WriteJob *job) {
+    CactusDisk *cactusDisk = committer->cactusDisk;
+    if (job->unchanged) {
+        return;
+    }
+    int64_t i = stList_length(committer->batch);
+    if (job->isFlower) {
+        addUpdateRequest(cactusDisk, committer->batch, job->name, job->record, job->recordSize, job->compressed,
+                job->compressedSize);
+        FlowerDigest *flowerDigest = st_malloc(sizeof(FlowerDigest));
+        flowerDigest->flowerName = job->name;
+        flowerDigest->digest = job->digest;
+        flowerDigest->recordSize = job->recordSize;
+        stList_append(committer->flowerDigests, flowerDigest);
+    } else if (!containsRecord(cactusDisk, job->name)) {
+        stList_append(committer->batch,
+                stKVDatabaseBulkRequest_constructInsertRequest(job->name, job->compressed, job->compressedSize));
+    } else {
+        stList_append(committer->batch,
+                stKVDatabaseBulkRequest_constructUpdateRequest(job->name, job->compressed, job->compressedSize));
+    }
+    if (stList_length(committer->batch) > i) {
+        committer->batchBytes += job->compressedSize;
+    }
+    if (stList_length(committer->batch) >= CACTUS_DISK_WRITE_BATCH_RECORDS
+            || committer->batchBytes >= CACTUS_DISK_WRITE_BATCH_BYTES) {
+        writeCommitter_flush(committer);
+    }
+}
+
+static void *writeCommitter_run(WriteCommitter *committer) {
+    /*
+     * The committer thread. The writing thread is blocked waiting on the workers while this
+     * runs, so this is the only thread using the exception handling machinery.
+     */
+    while (1) {
+        pthread_mutex_lock(&committer->mutex);
+        while (stList_length(committer->pendingJobs) == 0 && !committer->finished) {
+            pthread_cond_wait(&committer->jobAvailable, &committer->mutex);
+        }
+        if (stList_length(committer->pendingJobs) == 0) {
+            pthread_mutex_unlock(&committer->mutex);
+            break;
+        }
+        WriteJob *job = stList_pop(committer->pendingJobs);
+        pthread_cond_signal(&committer->spaceAvailable);
+        pthread_mutex_unlock(&committer->mutex);
+
+        if (committer->except == NULL) { // After a failure we just drain the queue.
+            stTry
+                {
+                    writeCommitter_commit(committer, job);
+                }
+                stCatch(except)
+                    {
+                        committer->except = except;
+                    }stTryEnd
+            ;
+        }
+        writeJob_destruct(job);
+    }
+    if (committer->except == NULL) {
+        stTry
+            {
+                writeCommitter_flush(committer);
+            }
+            stCatch(except)
+                {
+                    committer->except = except;
+                }stTryEnd
+        ;
+    }
+    return NULL;
+}
+
+static void writeFlowersAndMetaSequences(CactusDisk *cactusDisk) {
+    WriteCommitter committer;
+    committer.cactusDisk = cactusDisk;
+    pthread_mutex_init(&committer.mutex, NULL);
+    pthread_cond_init(&committer.jobAvailable, NULL);
+    pthread_cond_init(&committer.spaceAvailable, NULL);
+    committer.pendingJobs = stList_construct();
+    committer.finished = 0;
+    // Any requests made before the write are sent first, so later requests take precedence.
+    committer.batch = cactusDisk->updateRequests;
+    cactusDisk->updateRequests = stList_construct3(0, (void (*)(void *)) stKVDatabaseBulkRequest_destruct);
+    committer.batchBytes = 0;
+    committer.recordsWritten = 0;
+    committer.flowerDigests = stList_construct3(0, free);
+    committer.except = NULL;
+
+    pthread_t committerThread;
+    if (pthread_create(&committerThread, NULL, (void *(*)(void *)) writeCommitter_run, &committer) != 0) {
+        st_errnoAbort("Failed to start the cactus disk committer thread");
+    }
+    stThreadPool *workers = stThreadPool_construct(cactusDisk->writeThreads,
+            (void *(*)(void *)) writeJob_serialise, (void (*)(void *)) writeJob_handToCommitter);
 
     stSortedSetIterator *it = stSortedSet_getIterator(cactusDisk->flowers);
-    //Sort flowers to update.
+    Flower *flower;
     while ((flower = stSortedSet_getNext(it)) != NULL) {
-        cactusDisk_addUpdateRequest(cactusDisk, flower);
+        stThreadPool_push(workers, writeJob_construct(&committer, flower, flower_getName(flower),
+                (void (*)(void *, void (*)(const void * ptr, size_t size, size_t count))) flower_writeBinaryRepresentation, 1));
+    }
+    stSortedSet_destructIterator(it);
+
+    it = stSortedSet_getIterator(cactusDisk->metaSequences);
+    MetaSequence *metaSequence;
+    while ((metaSequence = stSortedSet_getNext(it)) != NULL) {
+        stThreadPool_push(workers, writeJob_construct(&committer, metaSequence, metaSequence_getName(metaSequence),
+                (void (*)(void *, void (*)(const void * ptr, size_t size, size_t count))) metaSequence_writeBinaryRepresentation, 0));
     }
     stSortedSet_destructIterator(it);
 
-    st_logDebug("Got the flowers to update\n");
+    stThreadPool_wait(workers);
+    stThreadPool_destruct(workers);
+
+    pthread_mutex_lock(&committer.mutex);
+    committer.finished = 1;
+    pthread_cond_signal(&committer.jobAvailable);
+    pthread_mutex_unlock(&committer.mutex);
+    pthread_join(committerThread, NULL);
+
+    st_logDebug("Wrote %" PRIi64 " flower and sequence updates using %" PRIi64 " threads\n",
+            committer.recordsWritten, cactusDisk->writeThreads);
+
+    if (committer.except == NULL) {
+        for (int64_t i = 0; i < stList_length(committer.flowerDigests); i++) {
+            FlowerDigest *flowerDigest = stList_get(committer.flowerDigests, i);
+            setFlowerDigest(cactusDisk, flowerDigest->flowerName, flowerDigest->digest, flowerDigest->recordSize);
+        }
+    }
+
+    stList_destruct(committer.flowerDigests);
+    stList_destruct(committer.pendingJobs);
+    stList_destruct(committer.batch);
+    pthread_cond_destroy(&committer.jobAvailable);
+    pthread_cond_destroy(&committer.spaceAvailable);
+    pthread_mutex_destroy(&committer.mutex);
+
+    if (committer.except != NULL) {
+        stThrowNewCause(committer.except, ST_KV_DATABASE_EXCEPTION_ID,
+                "Failed when trying to set records in updating the cactus disk");
+    }
+}
+
+void cactusDisk_write(CactusDisk *cactusDisk) {
+    stList *removeRequests = stList_construct3(0, (void (*)(void *)) stIntTuple_destruct);
+
+    st_logDebug("Starting to write the cactus to disk\n");
+
+    writeFlowersAndMetaSequences(cactusDisk);
+
+    st_logDebug("Wrote the flowers and sequences to the database\n");
 
     //Remove nets that are marked for deletion..
-    it = stSortedSet_getIterator(cactusDisk->flowerNamesMarkedForDeletion);
+    stSortedSetIterator *it = stSortedSet_getIterator(cactusDisk->flowerNamesMarkedForDeletion);
     char *nameString;
     while ((nameString = stSortedSet_getNext(it)) != NULL) {
         Name name = cactusMisc_stringToName(nameString);
@@ -657,29 +1305,6 @@ void cactusDisk_write(CactusDisk *cactusDisk) {
 
     st_logDebug("Avoided updating nets marked for deletion\n");
 
-    // Insert and/or update meta-sequences.
-    it = stSortedSet_getIterator(cactusDisk->metaSequences);
-    MetaSequence *metaSequence;
-    while ((metaSequence = stSortedSet_getNext(it)) != NULL) {
-        void *vA =
-                binaryRepresentation_makeBinaryRepresentation(metaSequence,
-                        (void (*)(void *, void (*)(const void * ptr, size_t size, size_t count))) metaSequence_writeBinaryRepresentation,
-                        &recordSize);
-        //Compression
-        vA = compress(vA, &recordSize);
-        if (!containsRecord(cactusDisk, metaSequence_getName(metaSequence))) {
-            stList_append(cactusDisk->updateRequests,
-                    stKVDatabaseBulkRequest_constructInsertRequest(metaSequence_getName(metaSequence), vA, recordSize));
-        } else {
-            stList_append(cactusDisk->updateRequests,
-                    stKVDatabaseBulkRequest_constructUpdateRequest(metaSequence_getName(metaSequence), vA, recordSize));
-        }
-        free(vA);
-    }
-    stSortedSet_destructIterator(it);
-
-    st_logDebug("Got the sequences we are going to add to the database.\n");
-
     if (!containsRecord(cactusDisk, CACTUS_DISK_PARAMETER_KEY)) { //We only write the parameters once.
         cactusDisk_forceParameterUpdate(cactusDisk, false);
     }
@@ -726,8 +1351,10 @@ void cactusDisk_write(CactusDisk *cactusDisk) {
     st_logDebug("Finished writing to the database\n");
 }
 
-stList *cactusDisk_getFlowers(CactusDisk *cactusDisk, stList *flowerNames) {
-    stList *records = getRecords(cactusDisk, flowerNames, "flowers");
+static stList *loadFlowers(CactusDisk *cactusDisk, stList *flowerNames, stList *records, int64_t *recordSizes) {
+    /*
+     * Gets the given flowers, loading those not already in memory from their uncompressed records.
+     */
     assert(stList_length(flowerNames) == stList_length(records));
     stList *flowers = stList_construct();
     for (int64_t i = 0; i < stList_length(flowerNames); i++) {
@@ -741,10 +1368,19 @@ stList *cactusDisk_getFlowers(CactusDisk *cactusDisk, stList *flowerNames) {
             void *cA = record;
             flower2 = flower_loadFromBinaryRepresentation(&cA, cactusDisk);
             assert(flower2 != NULL);
+            setFlowerDigest(cactusDisk, flowerName, getDigest(record, recordSizes[i]), recordSizes[i]);
         }
         stList_append(flowers, flower2);
     }
+    return flowers;
+}
+
+stList *cactusDisk_getFlowers(CactusDisk *cactusDisk, stList *flowerNames) {
+    int64_t *recordSizes = st_malloc(sizeof(int64_t) * (stList_length(flowerNames) + 1));
+    stList *records = getRecords(cactusDisk, flowerNames, "flowers", recordSizes);
+    stList *flowers = loadFlowers(cactusDisk, flowerNames, records, recordSizes);
     stList_destruct(records);
+    free(recordSizes);
     return flowers;
 }
 
@@ -755,13 +1391,15 @@ Flower *cactusDisk_getFlower(CactusDisk *cactusDisk, Name flowerName) {
     if ((flower2 = stSortedSet_search(cactusDisk->flowers, &flower)) != NULL) {
         return flower2;
     }
-    void *cA = getRecord(cactusDisk, flowerName, "flower", NULL);
+    int64_t recordSize;
+    void *cA = getRecord(cactusDisk, flowerName, "flower", &recordSize);
 
     if (cA == NULL) {
         return NULL;
     }
     void *cA2 = cA;
     flower2 = flower_loadFromBinaryRepresentation(&cA2, cactusDisk);
+    setFlowerDigest(cactusDisk, flowerName, getDigest(cA, recordSize), recordSize);
     free(cA);
     return flower2;
 }
@@ -778,11 +1416,343 @@ MetaSequence *cactusDisk_getMetaSequence(CactusDisk *cactusDisk, Name metaSequen
         return NULL;
     }
     void *cA2 = cA;
+    //Meta sequences are loaded while loading flowers, whose format differs.
+    BinaryRepresentationFormat format = binaryRepresentation_setFormat(0, 0);
     metaSequence2 = metaSequence_loadFromBinaryRepresentation(&cA2, cactusDisk);
+    binaryRepresentation_restoreFormat(format);
     free(cA);
     return metaSequence2;
 }
 
+/*
+ * Decompressing flowers ahead of use. The calling thread reads the records of the next few batches
+ * of flowers, and the sequence blocks of the next batch, from the database in bulk, and a helper thread
+ * decompresses the records and decodes the sequence while the caller works on the current batch.
+ * sonLib's exception stack is shared between threads, so a throw on the helper could unwind into
+ * the caller's stack: the helper only runs code that can't throw (the database is only touched by
+ * the caller), records any failure in the job, and the caller raises it when it collects the job.
+ * The flowers are deserialised and the caches filled by the calling thread. The reads happen at
+ * batch boundaries, so database latency is not hidden, only the decompression and decoding.
+ */
+
+typedef struct _decompressionJob {
+    stList *flowerNames; // The flowers to fetch, or NULL if the job decodes sequence.
+    stList *results; // The bulk results read from the database, freed by the helper.
+    stList *records; // The uncompressed records of the flowers.
+    int64_t *recordSizes;
+    stList *substrings; // The substrings to decode, or NULL if the job fetches flowers.
+    int64_t *firstRecords; // The index of the first block record of each substring.
+    char **strings; // The decoded substrings.
+    int64_t failedRecord; // The index of a record that could not be decompressed, or -1.
+    bool done;
+} DecompressionJob;
+
+struct _flowerDecompressor {
+    CactusDisk *cactusDisk;
+    int64_t sequenceBlockSize;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t jobAvailable;
+    pthread_cond_t jobDone;
+    stList *pendingStringJobs; // Jobs waiting for the helper. Sequence is needed sooner, so goes first.
+    stList *pendingFlowerJobs;
+    bool finished; // Set when the helper should exit.
+    stList *flowerNames;
+    int64_t nextFlower; // The index of the first flower not yet handed to the helper.
+    int64_t batchSize;
+    int64_t batchNumber; // The maximum number of batches of records fetched ahead.
+    stList *flowerJobs; // The flower jobs handed to the helper, in order.
+    stList *nextFlowerNames; // The names of the next batch, which has been deserialised.
+    DecompressionJob *stringJob; // Decoding the sequence of the next batch, or NULL.
+};
+
+static DecompressionJob *decompressionJob_construct(void) {
+    DecompressionJob *job = st_calloc(1, sizeof(DecompressionJob));
+    job->failedRecord = -1;
+    return job;
+}
+
+static void decompressionJob_destruct(DecompressionJob *job) {
+    if (job->flowerNames != NULL) {
+        stList_destruct(job->flowerNames);
+    }
+    if (job->results != NULL) {
+        stList_destruct(job->results);
+    }
+    if (job->records != NULL) {
+        stList_destruct(job->records);
+    }
+    free(job->recordSizes);
+    free(job->firstRecords);
+    if (job->strings != NULL) {
+        for (int64_t i = 0; i < stList_length(job->substrings); i++) {
+            free(job->strings[i]);
+        }
+        free(job->strings);
+    }
+    if (job->substrings != NULL) {
+        stList_destruct(job->substrings);
+    }
+    free(job);
+}
+
+static void decompressionJob_run(FlowerDecompressor *decompressor, DecompressionJob *job) {
+    /*
+     * Run by the helper thread, so must not throw.
+     */
+    if (job->flowerNames != NULL) {
+        job->records = stList_construct3(0, free);
+        job->recordSizes = st_malloc(sizeof(int64_t) * (stList_length(job->results) + 1));
+        for (int64_t i = 0; i < stList_length(job->results); i++) {
+            int64_t recordSize;
+            void *record = stKVDatabaseBulkResult_getRecord(stList_get(job->results, i), &recordSize);
+            void *uncompressed = NULL;
+            if (record != NULL) {
+                uncompressed = cactusCompression_tryDecompress(record, recordSize, &recordSize);
+                if (uncompressed == NULL && job->failedRecord == -1) {
+                    job->failedRecord = i;
+                }
+            }
+            stList_append(job->records, uncompressed);
+            job->recordSizes[i] = recordSize;
+        }
+    } else {
+        job->strings = st_malloc(sizeof(char *) * (stList_length(job->substrings) + 1));
+        for (int64_t i = 0; i < stList_length(job->substrings); i++) {
+            job->strings[i] = st_malloc(((Substring *) stList_get(job->substrings, i))->length);
+        }
+        if (job->results != NULL) {
+            decodeBlockRecords(decompressor->sequenceBlockSize, job->substrings, job->firstRecords, job->results,
+                    job->strings);
+        }
+    }
+    if (job->results != NULL) {
+        stList_destruct(job->results);
+        job->results = NULL;
+    }
+}
+
+static void *flowerDecompressor_run(FlowerDecompressor *decompressor) {
+    while (1) {
+        pthread_mutex_lock(&decompressor->mutex);
+        while (stList_length(decompressor->pendingStringJobs) == 0
+                && stList_length(decompressor->pendingFlowerJobs) == 0 && !decompressor->finished) {
+            pthread_cond_wait(&decompressor->jobAvailable, &decompressor->mutex);
+        }
+        if (decompressor->finished) {
+            pthread_mutex_unlock(&decompressor->mutex);
+            break;
+        }
+        DecompressionJob *job = stList_remove(stList_length(decompressor->pendingStringJobs) > 0 ?
+                decompressor->pendingStringJobs : decompressor->pendingFlowerJobs, 0);
+        pthread_mutex_unlock(&decompressor->mutex);
+
+        decompressionJob_run(decompressor, job);
+
+        pthread_mutex_lock(&decompressor->mutex);
+        job->done = 1;
+        pthread_cond_broadcast(&decompressor->jobDone);
+        pthread_mutex_unlock(&decompressor->mutex);
+    }
+    return NULL;
+}
+
+static void flowerDecompressor_submit(FlowerDecompressor *decompressor, stList *pendingJobs, DecompressionJob *job) {
+    pthread_mutex_lock(&decompressor->mutex);
+    stList_append(pendingJobs, job);
+    pthread_cond_signal(&decompressor->jobAvailable);
+    pthread_mutex_unlock(&decompressor->mutex);
+}
+
+static void flowerDecompressor_wait(FlowerDecompressor *decompressor, DecompressionJob *job) {
+    pthread_mutex_lock(&decompressor->mutex);
+    while (!job->done) {
+        pthread_cond_wait(&decompressor->jobDone, &decompressor->mutex);
+    }
+    pthread_mutex_unlock(&decompressor->mutex);
+}
+
+static void flowerDecompressor_fill(FlowerDecompressor *decompressor) {
+    /*
+     * Reads batches of flower records and hands them to the helper until it has batchNumber batches in hand.
+     */
+    while (stList_length(decompressor->flowerJobs) < decompressor->batchNumber
+            && decompressor->nextFlower < stList_length(decompressor->flowerNames)) {
+        DecompressionJob *job = decompressionJob_construct();
+        job->flowerNames = stList_construct3(0, free);
+        for (int64_t i = 0;
+                i < decompressor->batchSize && decompressor->nextFlower < stList_length(decompressor->flowerNames); i++) {
+            int64_t *flowerName = st_malloc(sizeof(int64_t));
+            flowerName[0] = *((int64_t *) stList_get(decompressor->flowerNames, decompressor->nextFlower++));
+            stList_append(job->flowerNames, flowerName);
+        }
+        stTry
+        {
+            job->results = stKVDatabase_bulkGetRecords(decompressor->cactusDisk->database, job->flowerNames);
+        }
+        stCatch(except)
+        {
+            decompressionJob_destruct(job);
+            stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
+                            "An unknown database error occurred when reading flowers");
+        }stTryEnd
+             ;
+        stList_append(decompressor->flowerJobs, job);
+        flowerDecompressor_submit(decompressor, decompressor->pendingFlowerJobs, job);
+    }
+}
+
+static DecompressionJob *getStringJob(FlowerDecompressor *decompressor, stList *substrings) {
+    /*
+     * Reads the sequence blocks holding the substrings, checking they are all there, so that the
+     * helper can decode them without failing.
+     */
+    DecompressionJob *job = decompressionJob_construct();
+    job->substrings = substrings;
+    job->firstRecords = st_malloc(sizeof(int64_t) * (stList_length(substrings) + 1));
+    stList *getRequests = getBlockRequests(decompressor->sequenceBlockSize, substrings, job->firstRecords);
+    if (stList_length(getRequests) > 0) {
+        job->results = getRecordsFromDB(decompressor->cactusDisk, getRequests);
+        for (int64_t i = 0; i < stList_length(job->results); i++) {
+            int64_t recordSize;
+            void *record = stKVDatabaseBulkResult_getRecord(stList_get(job->results, i), &recordSize);
+            if (record == NULL || recordSize < sizeof(SequenceBlockHeader)) {
+                int64_t blockName = *(int64_t *) stList_get(getRequests, i);
+                stList_destruct(getRequests);
+                decompressionJob_destruct(job);
+                stThrowNew(CACTUS_DISK_EXCEPTION_ID, "The sequence block %" PRIi64 " is missing or truncated", blockName);
+            }
+        }
+    }
+    stList_destruct(getRequests);
+    return job;
+}
+
+static void flowerDecompressor_loadNextBatch(FlowerDecompressor *decompressor) {
+    /*
+     * Deserialises the next batch of flowers and has the helper start decoding their sequence, or
+     * caches it directly if the strings are stored as plain chunks.
+     */
+    flowerDecompressor_fill(decompressor);
+    if (stList_length(decompressor->flowerJobs) == 0) {
+        return;
+    }
+    DecompressionJob *job = stList_remove(decompressor->flowerJobs, 0);
+    flowerDecompressor_fill(decompressor);
+    flowerDecompressor_wait(decompressor, job);
+
+    CactusDisk *cactusDisk = decompressor->cactusDisk;
+    for (int64_t i = 0; i < stList_length(job->flowerNames); i++) {
+        Name flowerName = *((int64_t *) stList_get(job->flowerNames, i));
+        if (i == job->failedRecord) {
+            decompressionJob_destruct(job);
+            stThrowNew(CACTUS_DISK_EXCEPTION_ID, "The record of flower %" PRIi64 " could not be decompressed", flowerName);
+        }
+        void *record = stList_get(job->records, i);
+        if (record == NULL) {
+            st_errAbort("The flower %" PRIi64 " is not in the cactus disk", flowerName);
+        }
+        if (cactusDisk->cache != NULL && !stCache_containsRecord(cactusDisk->cache, flowerName, 0, INT64_MAX)) {
+            stCache_setRecord(cactusDisk->cache, flowerName, 0, job->recordSizes[i], record);
+        }
+    }
+    stList *flowers = loadFlowers(cactusDisk, job->flowerNames, job->records, job->recordSizes);
+    if (cactusDisk->stringCache != NULL) {
+        stList *substrings = getSubstringsForFlowers(flowers);
+        if (decompressor->sequenceBlockSize > 0) {
+            stList *mergedSubstrings = getSubstringsToCache(cactusDisk, substrings);
+            if (stList_length(mergedSubstrings) > 0) {
+                decompressor->stringJob = getStringJob(decompressor, mergedSubstrings);
+                flowerDecompressor_submit(decompressor, decompressor->pendingStringJobs, decompressor->stringJob);
+            } else {
+                stList_destruct(mergedSubstrings);
+            }
+        } else { //Strings stored as plain chunks have nothing to decode, so are cached in bulk here.
+            cactusDisk_preCacheStrings2(cactusDisk, substrings);
+        }
+        stList_destruct(substrings);
+    }
+    stList_destruct(flowers);
+    decompressor->nextFlowerNames = job->flowerNames;
+    job->flowerNames = NULL;
+    decompressionJob_destruct(job);
+}
+
+FlowerDecompressor *flowerDecompressor_construct(CactusDisk *cactusDisk, stList *flowerNames, int64_t batchSize,
+        int64_t batchNumber) {
+    assert(batchSize > 0 && batchNumber > 0);
+    FlowerDecompressor *decompressor = st_calloc(1, sizeof(FlowerDecompressor));
+    decompressor->cactusDisk = cactusDisk;
+    decompressor->sequenceBlockSize = cactusDisk->sequenceBlockSize;
+    pthread_mutex_init(&decompressor->mutex, NULL);
+    pthread_cond_init(&decompressor->jobAvailable, NULL);
+    pthread_cond_init(&decompressor->jobDone, NULL);
+    decompressor->pendingStringJobs = stList_construct();
+    decompressor->pendingFlowerJobs = stList_construct();
+    decompressor->flowerNames = flowerNames;
+    decompressor->batchSize = batchSize;
+    decompressor->batchNumber = batchNumber;
+    decompressor->flowerJobs = stList_construct3(0, (void (*)(void *)) decompressionJob_destruct);
+    if (pthread_create(&decompressor->thread, NULL, (void *(*)(void *)) flowerDecompressor_run, decompressor) != 0) {
+        st_errnoAbort("Failed to start the flower decompression thread");
+    }
+    return decompressor;
+}
+
+void flowerDecompressor_destruct(FlowerDecompressor *decompressor) {
+    pthread_mutex_lock(&decompressor->mutex);
+    decompressor->finished = 1;
+    pthread_cond_signal(&decompressor->jobAvailable);
+    pthread_mutex_unlock(&decompressor->mutex);
+    pthread_join(decompressor->thread, NULL);
+
+    stList_destruct(decompressor->flowerJobs);
+    if (decompressor->stringJob != NULL) {
+        decompressionJob_destruct(decompressor->stringJob);
+    }
+    if (decompressor->nextFlowerNames != NULL) {
+        stList_destruct(decompressor->nextFlowerNames);
+    }
+    stList_destruct(decompressor->pendingStringJobs);
+    stList_destruct(decompressor->pendingFlowerJobs);
+    pthread_cond_destroy(&decompressor->jobAvailable);
+    pthread_cond_destroy(&decompressor->jobDone);
+    pthread_mutex_destroy(&decompressor->mutex);
+    free(decompressor);
+}
+
+stList *flowerDecompressor_getNextBatch(FlowerDecompressor *decompressor) {
+    if (decompressor->nextFlowerNames == NULL) { // Nothing has been loaded yet, or we are done.
+        flowerDecompressor_loadNextBatch(decompressor);
+        if (decompressor->nextFlowerNames == NULL) {
+            return NULL;
+        }
+    }
+    stList *flowerNames = decompressor->nextFlowerNames;
+    decompressor->nextFlowerNames = NULL;
+    CactusDisk *cactusDisk = decompressor->cactusDisk;
+    if (decompressor->stringJob != NULL) {
+        flowerDecompressor_wait(decompressor, decompressor->stringJob);
+        for (int64_t i = 0; i < stList_length(decompressor->stringJob->substrings); i++) {
+            Substring *substring = stList_get(decompressor->stringJob->substrings, i);
+            stringCache_setString(cactusDisk->stringCache, substring->name, substring->start, substring->length,
+                    decompressor->stringJob->strings[i]);
+        }
+        decompressionJob_destruct(decompressor->stringJob);
+        decompressor->stringJob = NULL;
+    }
+    // The caller may have unloaded some of the batch since it was deserialised, so get them by name.
+    stList *flowers = stList_construct();
+    for (int64_t i = 0; i < stList_length(flowerNames); i++) {
+        Flower *flower = cactusDisk_getFlower(cactusDisk, *((int64_t *) stList_get(flowerNames, i)));
+        assert(flower != NULL);
+        stList_append(flowers, flower);
+    }
+    stList_destruct(flowerNames);
+    flowerDecompressor_loadNextBatch(decompressor);
+    return flowers;
+}
+
 /*
  * Private functions.
  */
@@ -801,6 +1771,7 @@ void cactusDisk_addFlower(CactusDisk *cactusDisk, Flower *flower) {
 void cactusDisk_removeFlower(CactusDisk *cactusDisk, Flower *flower) {
     assert(cactusDisk_flowerIsLoaded(cactusDisk, flower_getName(flower)));
     stSortedSet_remove(cactusDisk->flowers, flower);
+    removeFlowerDigest(cactusDisk, flower_getName(flower));
 }
 
 void cactusDisk_deleteFlowerFromDisk(CactusDisk *cactusDisk, Flower *flower) {
@@ -818,16 +1789,45 @@ void cactusDisk_setEventTree(CactusDisk *cactusDisk, EventTree *eventTree) {
 
 /*
  * Function to get unique ID.
+ *
+ * IDs are reserved from the database in intervals. Each process picks a random bucket and
+ * then keeps reserving from it, so after the first reservation each one is a single
+ * increment. The size of the interval adapts to how fast IDs are being used: it doubles
+ * while intervals are used up in under CACTUS_DISK_NAME_INTERVAL_SECONDS, and halves when
+ * they last much longer, so that busy jobs go back to the database rarely.
  */
 
+static double getSeconds(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1.0e9;
+}
+
+static void adaptNameIncrement(CactusDisk *cactusDisk) {
+    double now = getSeconds();
+    if (cactusDisk->nameIntervalStart > 0.0) {
+        double elapsed = now - cactusDisk->nameIntervalStart;
+        if (elapsed < CACTUS_DISK_NAME_INTERVAL_SECONDS
+                && cactusDisk->nameIncrement < CACTUS_DISK_MAX_NAME_INCREMENT) {
+            cactusDisk->nameIncrement *= 2;
+        } else if (elapsed > 4 * CACTUS_DISK_NAME_INTERVAL_SECONDS
+                && cactusDisk->nameIncrement > CACTUS_DISK_NAME_INCREMENT) {
+            cactusDisk->nameIncrement /= 2;
+        }
+    }
+    cactusDisk->nameIntervalStart = now;
+}
+
 void cactusDisk_getBlockOfUniqueIDs(CactusDisk *cactusDisk, int64_t intervalSize) {
-    intervalSize = intervalSize < CACTUS_DISK_NAME_INCREMENT ? CACTUS_DISK_NAME_INCREMENT : intervalSize;
+    adaptNameIncrement(cactusDisk);
+    intervalSize = intervalSize < cactusDisk->nameIncrement ? cactusDisk->nameIncrement : intervalSize;
     bool done = 0;
     int64_t collisionCount = 0;
     while (!done) {
         stTry
             {
-                Name keyName = st_randomInt(-CACTUS_DISK_BUCKET_NUMBER, 0);
+                Name keyName = cactusDisk->nameBucket != 0 ? cactusDisk->nameBucket :
+                        st_randomInt(-CACTUS_DISK_BUCKET_NUMBER, 0);
                 assert(keyName >= -CACTUS_DISK_BUCKET_NUMBER);
                 assert(keyName < 0);
                 int64_t bucketSize = INT64_MAX / CACTUS_DISK_BUCKET_NUMBER;
@@ -836,7 +1836,14 @@ void cactusDisk_getBlockOfUniqueIDs(CactusDisk *cactusDisk, int64_t intervalSize
                 assert(minimumValue >= 1);
                 assert(maximumValue <= INT64_MAX);
                 assert(minimumValue < maximumValue);
-                if (stKVDatabase_containsRecord(cactusDisk->database, keyName)) {
+                bool bucketExists = cactusDisk->nameBucket != 0;
+                if (!bucketExists) {
+                    cactusDisk->uniqueIDRoundTrips++;
+                    bucketExists = stKVDatabase_containsRecord(cactusDisk->database, keyName);
+                }
+                if (bucketExists) {
+                    cactusDisk->nameBucket = 0; // In case the increment fails.
+                    cactusDisk->uniqueIDRoundTrips++;
                     cactusDisk->maxUniqueNumber = stKVDatabase_incrementInt64(cactusDisk->database, keyName,
                             intervalSize);
                     cactusDisk->uniqueNumber = cactusDisk->maxUniqueNumber - intervalSize;
@@ -851,6 +1858,7 @@ void cactusDisk_getBlockOfUniqueIDs(CactusDisk *cactusDisk, int64_t intervalSize
                 } else {
                     stTry
                         {
+                            cactusDisk->uniqueIDRoundTrips++;
                             stKVDatabase_insertInt64(cactusDisk->database, keyName, minimumValue);
                         }
                         stCatch(except)
@@ -866,11 +1874,16 @@ void cactusDisk_getBlockOfUniqueIDs(CactusDisk *cactusDisk, int64_t intervalSize
                                 }
                             }stTryEnd
                     ;
+                    cactusDisk->nameBucket = keyName; // Either we or another job created it, so now increment it.
                     continue;
                 }
                 if (cactusDisk->maxUniqueNumber >= maximumValue) {
                     st_errAbort("We have exhausted a bucket, which seems really unlikely");
                 }
+                // Only keep the bucket while it has plenty of room left.
+                if (maximumValue - cactusDisk->maxUniqueNumber > bucketSize / 2) {
+                    cactusDisk->nameBucket = keyName;
+                }
                 done = 1;
             }
             stCatch(except)
@@ -886,6 +1899,8 @@ void cactusDisk_getBlockOfUniqueIDs(CactusDisk *cactusDisk, int64_t intervalSize
                 }stTryEnd
         ;
     }
+    st_logDebug("Reserved %" PRIi64 " unique IDs, having made %" PRIi64 " round trips to do so\n", intervalSize,
+            cactusDisk->uniqueIDRoundTrips);
 }
 
 int64_t cactusDisk_getUniqueIDInterval(CactusDisk *cactusDisk, int64_t intervalSize) {
@@ -902,8 +1917,88 @@ int64_t cactusDisk_getUniqueID(CactusDisk *cactusDisk) {
     return cactusDisk_getUniqueIDInterval(cactusDisk, 1);
 }
 
+int64_t cactusDisk_getUniqueIDRoundTrips(CactusDisk *cactusDisk) {
+    return cactusDisk->uniqueIDRoundTrips;
+}
+
+void cactusDisk_setWriteThreads(CactusDisk *cactusDisk, int64_t writeThreads) {
+    if (writeThreads < 1) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "The number of write threads must be at least one, got %" PRIi64 "",
+                writeThreads);
+    }
+    cactusDisk->writeThreads = writeThreads;
+}
+
+void cactusDisk_setCodec(CactusDisk *cactusDisk, CactusCodec codec) {
+    if (!cactusCompression_isAvailable(codec)) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "The compression codec %s is not available in this build",
+                cactusCompression_getCodecName(codec));
+    }
+    cactusDisk->codec = codec;
+}
+
+CactusCodec cactusDisk_getCodec(CactusDisk *cactusDisk) {
+    return cactusDisk->codec;
+}
+
+void cactusDisk_writeSequenceStore(CactusDisk *cactusDisk, stList *metaSequences, const char *fileName) {
+    sequenceStore_write(cactusDisk, fileName, metaSequences);
+}
+
+void cactusDisk_useSequenceStore(CactusDisk *cactusDisk, const char *fileName) {
+    if (cactusDisk->sequenceStore != NULL) {
+        sequenceStore_destruct(cactusDisk->sequenceStore);
+    }
+    cactusDisk->sequenceStore = sequenceStore_construct(fileName);
+}
+
+void cactusDisk_setSequenceBlockSize(CactusDisk *cactusDisk, int64_t sequenceBlockSize) {
+    if (cactusDisk->sequenceBlockSizeFixed) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID,
+                "The sequence block size can only be set on a new cactus disk, before any strings are added");
+    }
+    if (sequenceBlockSize < 1 || sequenceBlockSize > INT32_MAX) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Invalid sequence block size: %" PRIi64 "", sequenceBlockSize);
+    }
+    cactusDisk->sequenceBlockSize = sequenceBlockSize;
+}
+
 void cactusDisk_clearStringCache(CactusDisk *cactusDisk) {
-    stCache_clear(cactusDisk->stringCache);
+    stringCache_clear(cactusDisk->stringCache);
+}
+
+void cactusDisk_setStringCacheSize(CactusDisk *cactusDisk, int64_t stringCacheSize) {
+    if (stringCacheSize < 0) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "The string cache size can not be negative, got %" PRIi64 "",
+                stringCacheSize);
+    }
+    stringCache_setMaxSize(cactusDisk->stringCache, stringCacheSize);
+}
+
+void cactusDisk_getStringCacheStats(CactusDisk *cactusDisk, CactusDiskStringCacheStats *stats) {
+    stringCache_getStats(cactusDisk->stringCache, stats);
+}
+
+void cactusDisk_logStringCacheStats(CactusDisk *cactusDisk) {
+    CactusDiskStringCacheStats stats;
+    cactusDisk_getStringCacheStats(cactusDisk, &stats);
+    st_logInfo("String cache: %" PRIi64 " hits, %" PRIi64 " misses, %" PRIi64 " bytes fetched, %" PRIi64
+            " evictions, %" PRIi64 " of %" PRIi64 " bytes used\n", stats.hits, stats.misses, stats.bytesFetched,
+            stats.evictions, stats.size, stats.maxSize);
+}
+
+void cactusDisk_setOptionsFromConfString(CactusDisk *cactusDisk, const char *confString) {
+    cactusDisk_setCodec(cactusDisk, cactusCompression_getCodecFromConfString(confString));
+    const char *attribute = "stringCacheSize=\"";
+    const char *cA = confString != NULL ? strstr(confString, attribute) : NULL;
+    if (cA != NULL) {
+        int64_t stringCacheSize;
+        if (sscanf(cA + strlen(attribute), "%" PRIi64 "", &stringCacheSize) != 1) {
+            stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Could not parse the stringCacheSize attribute of the conf string: %s",
+                    confString);
+        }
+        cactusDisk_setStringCacheSize(cactusDisk, stringCacheSize);
+    }
 }
 
 void cactusDisk_clearCache(CactusDisk *cactusDisk) {
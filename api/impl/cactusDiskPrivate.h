@@ -15,11 +15,21 @@ struct _cactusDisk {
     stSortedSet *flowers;
     stSortedSet *flowerNamesMarkedForDeletion;
     stList *updateRequests;
+    stSortedSet *flowerDigests;
     stCache *cache;
-    stCache *stringCache;
+    struct _stringCache *stringCache;
+    struct _sequenceStore *sequenceStore;
     EventTree *eventTree;
     Name uniqueNumber;
     Name maxUniqueNumber;
+    int64_t nameIncrement; // The current size of the intervals of unique IDs reserved.
+    double nameIntervalStart; // When the last interval was reserved.
+    Name nameBucket; // The bucket IDs are reserved from, or 0 if not yet chosen.
+    int64_t uniqueIDRoundTrips;
+    int64_t writeThreads;
+    CactusCodec codec;
+    int64_t sequenceBlockSize;
+    bool sequenceBlockSizeFixed;
 };
 
 ////////////////////////////////////////////////
@@ -90,6 +100,34 @@ char *cactusDisk_getString(CactusDisk *cactusDisk, Name name,
  */
 char *cactusDisk_getStringFromCache(CactusDisk *cactusDisk, Name name, int64_t start, int64_t length, int64_t strand);
 
+/*
+ * Functions to decompress flowers in a helper thread. Only the decompression and decoding are
+ * moved off the calling thread: the database is still read on the calling thread, between
+ * batches, so its latency is not hidden.
+ */
+
+typedef struct _flowerDecompressor FlowerDecompressor;
+
+/*
+ * Starts decompressing the given flowers, in batches of batchSize, keeping up to batchNumber
+ * batches of records in memory ahead of the batch being used. The records are read from the
+ * cactus disk's database by the calling thread, and decompressed and decoded by a helper thread.
+ * The flowerNames list must outlive the decompressor.
+ */
+FlowerDecompressor *flowerDecompressor_construct(CactusDisk *cactusDisk, stList *flowerNames, int64_t batchSize,
+        int64_t batchNumber);
+
+/*
+ * Stops the helper thread and frees the decompressor. Flowers already returned stay loaded.
+ */
+void flowerDecompressor_destruct(FlowerDecompressor *decompressor);
+
+/*
+ * Gets the next batch of flowers, loaded and with their sequence cached, in the order of the
+ * names given to the decompressor. Returns NULL when there are no more.
+ */
+stList *flowerDecompressor_getNextBatch(FlowerDecompressor *decompressor);
+
 /*
  * Set the event tree for this disk. (Hopefully this only happens once.)
  */
@@ -905,8 +905,11 @@ void flower_writeBinaryRepresentation(Flower *flower, void(*writeFn)(const void
     Group *group;
     Chain *chain;
 
-    binaryRepresentation_writeElementType(CODE_FLOWER, writeFn);
+    binaryRepresentation_writeElementType(CODE_FLOWER_COMPACT, writeFn);
+    //The flower's name is written in full, then the names within it relative to it.
+    BinaryRepresentationFormat format = binaryRepresentation_setFormat(1, 0);
     binaryRepresentation_writeName(flower_getName(flower), writeFn);
+    binaryRepresentation_setFormat(1, flower_getName(flower));
     binaryRepresentation_writeBool(flower_builtBlocks(flower), writeFn);
     binaryRepresentation_writeBool(flower_builtTrees(flower), writeFn);
     binaryRepresentation_writeBool(flower_builtFaces(flower), writeFn);
@@ -943,14 +946,19 @@ void flower_writeBinaryRepresentation(Flower *flower, void(*writeFn)(const void
     flower_destructChainIterator(chainIterator);
 
     binaryRepresentation_writeElementType(CODE_FLOWER, writeFn); //this avoids interpretting things wrong.
+    binaryRepresentation_restoreFormat(format);
 }
 
 Flower *flower_loadFromBinaryRepresentation(void **binaryString, CactusDisk *cactusDisk) {
     Flower *flower = NULL;
     bool buildFaces;
-    if (binaryRepresentation_peekNextElementType(*binaryString) == CODE_FLOWER) {
+    char elementType = binaryRepresentation_peekNextElementType(*binaryString);
+    if (elementType == CODE_FLOWER || elementType == CODE_FLOWER_COMPACT) {
         binaryRepresentation_popNextElementType(binaryString);
+        bool compact = elementType == CODE_FLOWER_COMPACT;
+        BinaryRepresentationFormat format = binaryRepresentation_setFormat(compact, 0);
         flower = flower_construct3(binaryRepresentation_getName(binaryString), cactusDisk);
+        binaryRepresentation_setFormat(compact, flower_getName(flower));
         flower_setBuiltBlocks(flower, binaryRepresentation_getBool(binaryString));
         flower_setBuiltTrees(flower, binaryRepresentation_getBool(binaryString));
         buildFaces = binaryRepresentation_getBool(binaryString);
@@ -967,6 +975,7 @@ Flower *flower_loadFromBinaryRepresentation(void **binaryString, CactusDisk *cac
             ;
         flower_setBuildFaces(flower, buildFaces);
         assert(binaryRepresentation_popNextElementType(binaryString) == CODE_FLOWER);
+        binaryRepresentation_restoreFormat(format);
     }
     return flower;
 }
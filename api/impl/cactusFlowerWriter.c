@@ -181,6 +181,9 @@ static FlowerStream *flowerStream_construct(stList *flowerNames, CactusDisk *cac
     ret->curFlower = NULL;
     ret->nextIdx = 0;
     ret->cactusDisk = cactusDisk;
+    ret->decompressor = NULL;
+    ret->unloadFlowers = 1;
+    ret->preCacheStrings = 0;
     return ret;
 }
 
@@ -189,8 +192,24 @@ FlowerStream *flowerWriter_getFlowerStream(CactusDisk *cactusDisk, FILE *file) {
     return flowerStream_construct(flowerNamesList, cactusDisk);
 }
 
+FlowerStream *flowerWriter_getDecompressingFlowerStream(CactusDisk *cactusDisk, FILE *file,
+        int64_t decompressionBatches, bool unloadFlowers) {
+    FlowerStream *flowerStream = flowerWriter_getFlowerStream(cactusDisk, file);
+    flowerStream->unloadFlowers = unloadFlowers;
+    if (decompressionBatches > 0) {
+        flowerStream->decompressor = flowerDecompressor_construct(cactusDisk, flowerStream->flowerNames,
+                FLOWER_STREAM_BATCH_SIZE, decompressionBatches);
+    } else {
+        flowerStream->preCacheStrings = 1;
+    }
+    return flowerStream;
+}
+
 void flowerStream_destruct(FlowerStream *flowerStream) {
-    if (flowerStream->curFlower != NULL) {
+    if (flowerStream->decompressor != NULL) {
+        flowerDecompressor_destruct(flowerStream->decompressor);
+    }
+    if (flowerStream->curFlower != NULL && flowerStream->unloadFlowers) {
         flower_destruct(flowerStream->curFlower, false);
     }
     stList_destruct(flowerStream->flowerBatch);
@@ -198,8 +217,32 @@ void flowerStream_destruct(FlowerStream *flowerStream) {
     free(flowerStream);
 }
 
+static stList *getNextBatch(FlowerStream *flowerStream) {
+    if (flowerStream->decompressor != NULL) {
+        stList *flowers = flowerDecompressor_getNextBatch(flowerStream->decompressor);
+        assert(flowers != NULL);
+        return flowers;
+    }
+    // Get the next batch of names.
+    int64_t batchStart = flowerStream->nextIdx;
+    int64_t batchEnd = flowerStream->nextIdx + FLOWER_STREAM_BATCH_SIZE;
+    if (batchEnd > stList_length(flowerStream->flowerNames)) {
+        batchEnd = stList_length(flowerStream->flowerNames);
+    }
+    stList *namesBatch = stList_construct2(batchEnd - batchStart);
+    for (int64_t i = batchStart; i < batchEnd; i++) {
+        stList_set(namesBatch, i - batchStart, stList_get(flowerStream->flowerNames, i));
+    }
+    stList *flowers = cactusDisk_getFlowers(flowerStream->cactusDisk, namesBatch);
+    stList_destruct(namesBatch);
+    if (flowerStream->preCacheStrings) {
+        cactusDisk_preCacheStrings(flowerStream->cactusDisk, flowers);
+    }
+    return flowers;
+}
+
 Flower *flowerStream_getNext(FlowerStream *flowerStream) {
-    if (flowerStream->curFlower != NULL) {
+    if (flowerStream->curFlower != NULL && flowerStream->unloadFlowers) {
         // Unload the previously loaded flower.
         flower_destruct(flowerStream->curFlower, false);
     }
@@ -209,22 +252,11 @@ Flower *flowerStream_getNext(FlowerStream *flowerStream) {
     }
     if (stList_length(flowerStream->flowerBatch) == 0) {
         // Time to load the next batch of flowers from the DB.
-        // Get the next batch of names.
-        int64_t batchStart = flowerStream->nextIdx;
-        int64_t batchEnd = flowerStream->nextIdx + FLOWER_STREAM_BATCH_SIZE;
-        if (batchEnd > stList_length(flowerStream->flowerNames)) {
-            batchEnd = stList_length(flowerStream->flowerNames);
-        }
-        stList *namesBatch = stList_construct2(batchEnd - batchStart);
-        for (int64_t i = batchStart; i < batchEnd; i++) {
-            stList_set(namesBatch, i - batchStart, stList_get(flowerStream->flowerNames, i));
-        }
+        stList_destruct(flowerStream->flowerBatch);
+        flowerStream->flowerBatch = getNextBatch(flowerStream);
         // We want to be able to treat the batch like a stack and get
         // the same order, so we reverse it.
-        stList_reverse(namesBatch);
-        stList_destruct(flowerStream->flowerBatch);
-        flowerStream->flowerBatch = cactusDisk_getFlowers(flowerStream->cactusDisk, namesBatch);
-        stList_destruct(namesBatch);
+        stList_reverse(flowerStream->flowerBatch);
     }
     flowerStream->curFlower = stList_pop(flowerStream->flowerBatch);
     flowerStream->nextIdx++;
@@ -60,5 +60,8 @@
 #include "cactusSerialisation.h"
 #include "cactusTestCommon.h"
 #include "cactusFlowerWriter.h"
+#include "cactusCompression.h"
+#include "cactusSequenceStorePrivate.h"
+#include "cactusStringCachePrivate.h"
 
 #endif
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Read-only, memory mapped store of the strings of a cactus disk.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+/*
+ * The file starts with a SequenceStoreHeader, the strings follow, each starting on a
+ * SEQUENCE_STORE_ALIGNMENT byte boundary, and the index, an array of SequenceStoreEntry sorted
+ * by name, comes last. The store is meant to be mapped read-only by all the processes on a node,
+ * so that they share one copy of the strings in the page cache.
+ */
+
+#define SEQUENCE_STORE_MAGIC "CACTUSSQ"
+#define SEQUENCE_STORE_VERSION 1
+#define SEQUENCE_STORE_ALIGNMENT 4096
+
+typedef struct _sequenceStoreHeader {
+    char magic[8];
+    int64_t version;
+    int64_t stringNumber;
+    int64_t indexOffset;
+} SequenceStoreHeader;
+
+typedef struct _sequenceStoreEntry {
+    Name name;
+    int64_t offset;
+    int64_t length;
+} SequenceStoreEntry;
+
+struct _sequenceStore {
+    char *file;
+    int64_t fileSize;
+    const SequenceStoreEntry *entries;
+    int64_t stringNumber;
+};
+
+SequenceStore *sequenceStore_construct(const char *fileName) {
+    int fd = open(fileName, O_RDONLY);
+    if (fd == -1) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Could not open the sequence store: %s", fileName);
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < sizeof(SequenceStoreHeader)) {
+        close(fd);
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "The sequence store %s is truncated", fileName);
+    }
+    char *file = mmap(NULL, fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); //The mapping holds its own reference to the file.
+    if (file == MAP_FAILED) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Could not map the sequence store: %s", fileName);
+    }
+    const SequenceStoreHeader *header = (const SequenceStoreHeader *) file;
+    if (memcmp(header->magic, SEQUENCE_STORE_MAGIC, 8) != 0 || header->version != SEQUENCE_STORE_VERSION
+            || header->indexOffset + header->stringNumber * (int64_t) sizeof(SequenceStoreEntry) > fileStat.st_size) {
+        munmap(file, fileStat.st_size);
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "The file %s is not a valid sequence store", fileName);
+    }
+    SequenceStore *sequenceStore = st_malloc(sizeof(SequenceStore));
+    sequenceStore->file = file;
+    sequenceStore->fileSize = fileStat.st_size;
+    sequenceStore->entries = (const SequenceStoreEntry *) (file + header->indexOffset);
+    sequenceStore->stringNumber = header->stringNumber;
+    st_logDebug("Mapped the sequence store %s, containing %" PRIi64 " strings\n", fileName,
+            sequenceStore->stringNumber);
+    return sequenceStore;
+}
+
+void sequenceStore_destruct(SequenceStore *sequenceStore) {
+    munmap(sequenceStore->file, sequenceStore->fileSize);
+    free(sequenceStore);
+}
+
+static const SequenceStoreEntry *getEntry(SequenceStore *sequenceStore, Name name) {
+    int64_t i = 0, j = sequenceStore->stringNumber - 1;
+    while (i <= j) {
+        int64_t k = i + (j - i) / 2;
+        const SequenceStoreEntry *entry = &sequenceStore->entries[k];
+        if (entry->name == name) {
+            return entry;
+        }
+        if (entry->name < name) {
+            i = k + 1;
+        } else {
+            j = k - 1;
+        }
+    }
+    return NULL;
+}
+
+bool sequenceStore_containsString(SequenceStore *sequenceStore, Name name) {
+    return getEntry(sequenceStore, name) != NULL;
+}
+
+const char *sequenceStore_getString(SequenceStore *sequenceStore, Name name, int64_t start, int64_t length) {
+    const SequenceStoreEntry *entry = getEntry(sequenceStore, name);
+    if (entry == NULL) {
+        return NULL;
+    }
+    if (start < 0 || length < 0 || start + length > entry->length) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "The substring %" PRIi64 ":%" PRIi64 " is out of the bounds of the stored string %"
+                PRIi64 " of length %" PRIi64 "", start, length, name, entry->length);
+    }
+    return sequenceStore->file + entry->offset + start;
+}
+
+static int entry_cmp(const SequenceStoreEntry *entry1, const SequenceStoreEntry *entry2) {
+    return cactusMisc_nameCompare(entry1->name, entry2->name);
+}
+
+static void writeToFile(FILE *fileHandle, const void *data, int64_t size, const char *fileName) {
+    if (size > 0 && fwrite(data, size, 1, fileHandle) != 1) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Error writing the sequence store %s", fileName);
+    }
+}
+
+void sequenceStore_write(CactusDisk *cactusDisk, const char *fileName, stList *metaSequences) {
+    for (int64_t i = 0; i < stList_length(metaSequences); i++) {
+        if (((MetaSequence *) stList_get(metaSequences, i))->cactusDisk != cactusDisk) {
+            stThrowNew(CACTUS_DISK_EXCEPTION_ID, "The meta sequences written to the sequence store %s must belong to its cactus disk",
+                    fileName);
+        }
+    }
+    FILE *fileHandle = fopen(fileName, "wb");
+    if (fileHandle == NULL) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Could not create the sequence store: %s", fileName);
+    }
+    SequenceStoreEntry *entries = st_malloc(sizeof(SequenceStoreEntry) * (stList_length(metaSequences) + 1));
+    int64_t stringNumber = 0;
+    stSortedSet *namesWritten = stSortedSet_construct3((int (*)(const void *, const void *)) stIntTuple_cmpFn,
+            (void (*)(void *)) stIntTuple_destruct);
+    char padding[SEQUENCE_STORE_ALIGNMENT];
+    memset(padding, 0, SEQUENCE_STORE_ALIGNMENT);
+    //Leave the first page for the header, written last.
+    writeToFile(fileHandle, padding, SEQUENCE_STORE_ALIGNMENT, fileName);
+    int64_t offset = SEQUENCE_STORE_ALIGNMENT;
+    for (int64_t i = 0; i < stList_length(metaSequences); i++) {
+        MetaSequence *metaSequence = stList_get(metaSequences, i);
+        stIntTuple *name = stIntTuple_construct1(metaSequence->stringName);
+        if (stSortedSet_search(namesWritten, name) != NULL) {
+            stIntTuple_destruct(name);
+            continue;
+        }
+        stSortedSet_insert(namesWritten, name);
+        char *string = cactusDisk_getString(cactusDisk, metaSequence->stringName, 0,
+                metaSequence_getLength(metaSequence), 1, metaSequence_getLength(metaSequence));
+        SequenceStoreEntry *entry = &entries[stringNumber++];
+        entry->name = metaSequence->stringName;
+        entry->offset = offset;
+        entry->length = metaSequence_getLength(metaSequence);
+        writeToFile(fileHandle, string, entry->length, fileName);
+        free(string);
+        cactusDisk_clearStringCache(cactusDisk); //Don't hold the whole genome in memory.
+        offset += entry->length;
+        int64_t paddingLength = (SEQUENCE_STORE_ALIGNMENT - offset % SEQUENCE_STORE_ALIGNMENT) % SEQUENCE_STORE_ALIGNMENT;
+        writeToFile(fileHandle, padding, paddingLength, fileName);
+        offset += paddingLength;
+    }
+    stSortedSet_destruct(namesWritten);
+    qsort(entries, stringNumber, sizeof(SequenceStoreEntry), (int (*)(const void *, const void *)) entry_cmp);
+    writeToFile(fileHandle, entries, sizeof(SequenceStoreEntry) * stringNumber, fileName);
+    SequenceStoreHeader header;
+    memset(&header, 0, sizeof(SequenceStoreHeader));
+    memcpy(header.magic, SEQUENCE_STORE_MAGIC, 8);
+    header.version = SEQUENCE_STORE_VERSION;
+    header.stringNumber = stringNumber;
+    header.indexOffset = offset;
+    if (fseek(fileHandle, 0, SEEK_SET) != 0) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Error writing the sequence store %s", fileName);
+    }
+    writeToFile(fileHandle, &header, sizeof(SequenceStoreHeader), fileName);
+    if (fclose(fileHandle) != 0) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Error closing the sequence store %s", fileName);
+    }
+    free(entries);
+}
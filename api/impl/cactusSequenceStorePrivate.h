@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef CACTUS_SEQUENCE_STORE_PRIVATE_H_
+#define CACTUS_SEQUENCE_STORE_PRIVATE_H_
+
+#include "cactusGlobals.h"
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Read-only, memory mapped store of the strings of a cactus disk.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+typedef struct _sequenceStore SequenceStore;
+
+/*
+ * Maps the sequence store file into memory. Throws an exception if the file can not be
+ * mapped or is not a sequence store.
+ */
+SequenceStore *sequenceStore_construct(const char *fileName);
+
+/*
+ * Unmaps the sequence store.
+ */
+void sequenceStore_destruct(SequenceStore *sequenceStore);
+
+/*
+ * Returns non-zero if the store contains the string with the given name.
+ */
+bool sequenceStore_containsString(SequenceStore *sequenceStore, Name name);
+
+/*
+ * Gets a pointer to the characters [start, start + length) of the string with the given name,
+ * which points into the mapped file and must not be freed, or NULL if the store does not contain
+ * the string.
+ */
+const char *sequenceStore_getString(SequenceStore *sequenceStore, Name name, int64_t start, int64_t length);
+
+/*
+ * Writes a sequence store containing the strings of the given meta sequences, fetching
+ * them one at a time from the cactus disk, which must be the one the meta sequences belong to.
+ */
+void sequenceStore_write(CactusDisk *cactusDisk, const char *fileName, stList *metaSequences);
+
+#endif
@@ -14,22 +14,99 @@
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
 
+/*
+ * The format of the record being read or written on this thread. In the compact format integers
+ * are written as LEB128 varints (zigzag encoded, so small negative numbers are short too), names
+ * as differences from the base name and coordinates as differences from the last coordinate.
+ * Differences are taken modulo 2^64, so any value round trips.
+ */
+static __thread BinaryRepresentationFormat binaryRepresentation_format = { 0, 0, 0 };
+
+BinaryRepresentationFormat binaryRepresentation_setFormat(bool compact, Name baseName) {
+	BinaryRepresentationFormat format = binaryRepresentation_format;
+	binaryRepresentation_format.compact = compact;
+	binaryRepresentation_format.baseName = baseName;
+	binaryRepresentation_format.lastCoordinate = 0;
+	return format;
+}
+
+void binaryRepresentation_restoreFormat(BinaryRepresentationFormat format) {
+	binaryRepresentation_format = format;
+}
+
+static uint64_t zigzag(int64_t i) {
+	return ((uint64_t) i << 1) ^ (uint64_t) (i >> 63);
+}
+
+static int64_t unzigzag(uint64_t i) {
+	return (int64_t) (i >> 1) ^ -(int64_t) (i & 1);
+}
+
+static void writeVarint(uint64_t i, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
+	uint8_t buffer[10];
+	int64_t j = 0;
+	while (i >= 0x80) {
+		buffer[j++] = (uint8_t) (i | 0x80);
+		i >>= 7;
+	}
+	buffer[j++] = (uint8_t) i;
+	writeFn(buffer, sizeof(uint8_t), j);
+}
+
+static uint64_t getVarint(void **binaryString) {
+	uint8_t *cA = *binaryString;
+	uint64_t i = 0;
+	int64_t shift = 0;
+	while (*cA & 0x80) {
+		i |= (uint64_t) (*cA++ & 0x7F) << shift;
+		shift += 7;
+	}
+	i |= (uint64_t) *cA++ << shift;
+	*binaryString = cA;
+	return i;
+}
+
+static int64_t difference(int64_t i, int64_t j) {
+	return (int64_t) ((uint64_t) i - (uint64_t) j);
+}
+
+static int64_t sum(int64_t i, int64_t j) {
+	return (int64_t) ((uint64_t) i + (uint64_t) j);
+}
+
 void binaryRepresentation_writeElementType(char elementCode, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
 	writeFn(&elementCode, sizeof(char), 1);
 }
 
 void binaryRepresentation_writeString(const char *name, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
 	int64_t i = strlen(name);
-	writeFn(&i, sizeof(int64_t), 1);
+	binaryRepresentation_writeInteger(i, writeFn);
 	writeFn(name, sizeof(char), i);
 }
 
 void binaryRepresentation_writeInteger(int64_t i, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
-	writeFn(&i, sizeof(int64_t), 1);
+	if (binaryRepresentation_format.compact) {
+		writeVarint(zigzag(i), writeFn);
+	} else {
+		writeFn(&i, sizeof(int64_t), 1);
+	}
 }
 
 void binaryRepresentation_writeName(Name name, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
-	binaryRepresentation_writeInteger(name, writeFn);
+	if (binaryRepresentation_format.compact) {
+		writeVarint(zigzag(difference(name, binaryRepresentation_format.baseName)), writeFn);
+	} else {
+		binaryRepresentation_writeInteger(name, writeFn);
+	}
+}
+
+void binaryRepresentation_writeCoordinate(int64_t coordinate, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
+	if (binaryRepresentation_format.compact) {
+		writeVarint(zigzag(difference(coordinate, binaryRepresentation_format.lastCoordinate)), writeFn);
+		binaryRepresentation_format.lastCoordinate = coordinate;
+	} else {
+		binaryRepresentation_writeInteger(coordinate, writeFn);
+	}
 }
 
 void binaryRepresentation_writeFloat(float f, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
@@ -62,7 +139,14 @@ char *binaryRepresentation_getString(void **binaryString) {
 	return cA;
 }
 
-char *binaryRepresentation_getStringStatic_cA = NULL;
+const char *binaryRepresentation_getStringView(void **binaryString, int64_t *length) {
+	*length = binaryRepresentation_getInteger(binaryString);
+	const char *cA = *binaryString;
+	*binaryString = *((char **)binaryString) + *length;
+	return cA;
+}
+
+static __thread char *binaryRepresentation_getStringStatic_cA = NULL;
 const char *binaryRepresentation_getStringStatic(void **binaryString) {
 	if(binaryRepresentation_getStringStatic_cA != NULL) {
 		free(binaryRepresentation_getStringStatic_cA);
@@ -72,6 +156,9 @@ const char *binaryRepresentation_getStringStatic(void **binaryString) {
 }
 
 int64_t binaryRepresentation_getInteger(void **binaryString) {
+	if (binaryRepresentation_format.compact) {
+		return unzigzag(getVarint(binaryString));
+	}
 	int64_t *i;
 	i = *binaryString;
 	*binaryString = i + 1;
@@ -79,6 +166,18 @@ int64_t binaryRepresentation_getInteger(void **binaryString) {
 }
 
 Name binaryRepresentation_getName(void **binaryString) {
+	if (binaryRepresentation_format.compact) {
+		return sum(binaryRepresentation_format.baseName, unzigzag(getVarint(binaryString)));
+	}
+	return binaryRepresentation_getInteger(binaryString);
+}
+
+int64_t binaryRepresentation_getCoordinate(void **binaryString) {
+	if (binaryRepresentation_format.compact) {
+		binaryRepresentation_format.lastCoordinate = sum(binaryRepresentation_format.lastCoordinate,
+				unzigzag(getVarint(binaryString)));
+		return binaryRepresentation_format.lastCoordinate;
+	}
 	return binaryRepresentation_getInteger(binaryString);
 }
 
@@ -96,34 +195,55 @@ bool binaryRepresentation_getBool(void **binaryString) {
 	return *i;
 }
 
-int64_t binaryRepresentation_makeBinaryRepresentationP_i = 0;
-void binaryRepresentation_makeBinaryRepresentationP(const void * ptr, size_t size, size_t count) {
-	/*
-	 * Records the cummulative size of the substrings written out in creating the flower.
-	 */
-	assert(ptr != NULL);
-	binaryRepresentation_makeBinaryRepresentationP_i += size * count;
+/*
+ * Records are written in a single pass into a growable buffer. The writeFn passed to the
+ * object's write function has no context argument, so the buffer being written is kept per
+ * thread, and saved and restored around each write so that writes can be nested.
+ */
+#define BINARY_REPRESENTATION_INITIAL_BUFFER_SIZE 256
+
+static __thread BinaryRepresentationBuffer *binaryRepresentation_currentBuffer = NULL;
+
+void binaryRepresentation_initialiseBuffer(BinaryRepresentationBuffer *buffer) {
+	buffer->capacity = BINARY_REPRESENTATION_INITIAL_BUFFER_SIZE;
+	buffer->size = 0;
+	buffer->data = st_malloc(buffer->capacity);
+}
+
+void binaryRepresentation_freeBuffer(BinaryRepresentationBuffer *buffer) {
+	free(buffer->data);
+	buffer->data = NULL;
+	buffer->size = 0;
+	buffer->capacity = 0;
+}
+
+static void binaryRepresentation_writeToCurrentBuffer(const void * ptr, size_t size, size_t count) {
+	BinaryRepresentationBuffer *buffer = binaryRepresentation_currentBuffer;
+	assert(buffer != NULL);
+	int64_t length = size * count;
+	if (buffer->size + length > buffer->capacity) {
+		while (buffer->size + length > buffer->capacity) {
+			buffer->capacity = buffer->capacity > 0 ? buffer->capacity * 2 : BINARY_REPRESENTATION_INITIAL_BUFFER_SIZE;
+		}
+		buffer->data = st_realloc(buffer->data, buffer->capacity);
+	}
+	memcpy(buffer->data + buffer->size, ptr, length);
+	buffer->size += length;
 }
 
-char *binaryRepresentation_makeBinaryRepresentationP2_vA = NULL;
-void binaryRepresentation_makeBinaryRepresentationP2(const void * ptr, size_t size, size_t count) {
-	/*
-	 * Cummulates all the binary data into one array
-	 */
-	memcpy(binaryRepresentation_makeBinaryRepresentationP2_vA, ptr, size*count);
-	binaryRepresentation_makeBinaryRepresentationP2_vA += size * count;
+void binaryRepresentation_writeToBuffer(BinaryRepresentationBuffer *buffer, void *object, void (*writeBinaryRepresentation)(void *, void (*writeFn)(const void * ptr, size_t size, size_t count))) {
+	BinaryRepresentationBuffer *previousBuffer = binaryRepresentation_currentBuffer;
+	binaryRepresentation_currentBuffer = buffer;
+	writeBinaryRepresentation(object, binaryRepresentation_writeToCurrentBuffer);
+	binaryRepresentation_currentBuffer = previousBuffer;
 }
 
 void *binaryRepresentation_makeBinaryRepresentation(void *object, void (*writeBinaryRepresentation)(void *, void (*writeFn)(const void * ptr, size_t size, size_t count)), int64_t *recordSize) {
-	void *vA;
-	binaryRepresentation_makeBinaryRepresentationP_i = 0;
-	writeBinaryRepresentation(object, binaryRepresentation_makeBinaryRepresentationP);
-	assert(binaryRepresentation_makeBinaryRepresentationP_i < INT64_MAX);
-	vA = st_malloc(binaryRepresentation_makeBinaryRepresentationP_i);
-	binaryRepresentation_makeBinaryRepresentationP2_vA = vA;
-	writeBinaryRepresentation(object, binaryRepresentation_makeBinaryRepresentationP2);
-	*recordSize = binaryRepresentation_makeBinaryRepresentationP_i;
-	return vA;
+	BinaryRepresentationBuffer buffer;
+	binaryRepresentation_initialiseBuffer(&buffer);
+	binaryRepresentation_writeToBuffer(&buffer, object, writeBinaryRepresentation);
+	*recordSize = buffer.size;
+	return buffer.data;
 }
 
 void *binaryRepresentation_resizeObjectAsPowerOf2(void *vA, int64_t *recordSize) {
@@ -46,6 +46,32 @@
 #define CODE_PSEUDO_CHROMOSOME 23
 #define CODE_PSEUDO_ADJACENCY 24
 #define CODE_CACTUS_DISK 25
+#define CODE_SEQUENCE_BLOCK_SIZE 26
+#define CODE_FLOWER_COMPACT 27
+
+/*
+ * The format of a record. Records are written with fixed width integers and names, except
+ * flowers, which are written compactly (see binaryRepresentation_setFormat) from
+ * CODE_FLOWER_COMPACT onwards. Flowers written before that start with CODE_FLOWER and
+ * are still read in the fixed width format.
+ */
+typedef struct _binaryRepresentationFormat {
+    bool compact; // Integers are written as varints.
+    Name baseName; // Names are written as differences from this name.
+    int64_t lastCoordinate; // Coordinates are written as differences from the previous one.
+} BinaryRepresentationFormat;
+
+/*
+ * Sets the format used by this thread to read and write integers, names, coordinates and strings,
+ * returning the previous format, which should be restored when the record is finished with.
+ * In the compact format names are written relative to baseName.
+ */
+BinaryRepresentationFormat binaryRepresentation_setFormat(bool compact, Name baseName);
+
+/*
+ * Restores a format returned by binaryRepresentation_setFormat.
+ */
+void binaryRepresentation_restoreFormat(BinaryRepresentationFormat format);
 
 /*
  * Writes a code for the element type.
@@ -67,6 +93,12 @@ void binaryRepresentation_writeInteger(int64_t i, void (*writeFn)(const void * p
  */
 void binaryRepresentation_writeName(Name name, void (*writeFn)(const void * ptr, size_t size, size_t count));
 
+/*
+ * Writes a coordinate to the binary stream. In the compact format coordinates are written
+ * relative to the previous coordinate, so they must be read back in the order written.
+ */
+void binaryRepresentation_writeCoordinate(int64_t coordinate, void (*writeFn)(const void * ptr, size_t size, size_t count));
+
 /*
  * Writes a float to the binary stream.
  */
@@ -94,10 +126,17 @@ char *binaryRepresentation_getString(void **binaryString);
 
 /*
  * Parses out a string, placing the memory in a buffer owned by the function. Thid buffer
- * will be overidden by the next call to the function.
+ * will be overidden by the next call to the function on the same thread.
  */
 const char *binaryRepresentation_getStringStatic(void **binaryString);
 
+/*
+ * Parses out a string without copying it, returning a pointer into the binary string and
+ * setting length. The string is not NUL terminated, and is only valid while the binary
+ * string is.
+ */
+const char *binaryRepresentation_getStringView(void **binaryString, int64_t *length);
+
 /*
  * Parses an integer from binary string.
  */
@@ -108,6 +147,11 @@ int64_t binaryRepresentation_getInteger(void **binaryString);
  */
 Name binaryRepresentation_getName(void **binaryString);
 
+/*
+ * Parses a coordinate from a binary string.
+ */
+int64_t binaryRepresentation_getCoordinate(void **binaryString);
+
 /*
  * Parses a float from the binary string.
  */
@@ -118,9 +162,34 @@ float binaryRepresentation_getFloat(void **binaryString);
  */
 bool binaryRepresentation_getBool(void **binaryString);
 
+/*
+ * A growable, caller owned buffer that objects are serialised into.
+ */
+typedef struct _binaryRepresentationBuffer {
+    char *data;
+    int64_t size; // The number of bytes written.
+    int64_t capacity;
+} BinaryRepresentationBuffer;
+
+/*
+ * Initialises an empty buffer.
+ */
+void binaryRepresentation_initialiseBuffer(BinaryRepresentationBuffer *buffer);
+
+/*
+ * Frees the memory of a buffer.
+ */
+void binaryRepresentation_freeBuffer(BinaryRepresentationBuffer *buffer);
+
+/*
+ * Appends the binary representation of an object to the buffer, in a single pass. Is
+ * re-entrant, and can be used on several threads at once, each with its own buffer.
+ */
+void binaryRepresentation_writeToBuffer(BinaryRepresentationBuffer *buffer, void *object, void (*writeBinaryRepresentation)(void *, void (*writeFn)(const void * ptr, size_t size, size_t count)));
+
 /*
  * Makes a binary representation of an object, using a passed function which writes
- * out the representation of the considered object.
+ * out the representation of the considered object. The returned record must be freed.
  */
 void *binaryRepresentation_makeBinaryRepresentation(void *object, void (*writeBinaryRepresentation)(void *, void (*writeFn)(const void * ptr, size_t size, size_t count)), int64_t *recordSize);
 
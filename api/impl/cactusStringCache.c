@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Size bounded cache of substrings of the strings in a cactus disk.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+/*
+ * The cache holds disjoint ranges of strings, kept in a sorted set ordered by name and start,
+ * and in a doubly linked list ordered by how recently they were used.
+ */
+
+typedef struct _stringCacheRange StringCacheRange;
+
+struct _stringCacheRange {
+    Name name;
+    int64_t start;
+    int64_t length;
+    char *string;
+    StringCacheRange *moreRecentlyUsed;
+    StringCacheRange *lessRecentlyUsed;
+};
+
+struct _stringCache {
+    stSortedSet *ranges;
+    StringCacheRange *mostRecentlyUsed;
+    StringCacheRange *leastRecentlyUsed;
+    int64_t size;
+    int64_t maxSize;
+    int64_t hits;
+    int64_t misses;
+    int64_t bytesFetched;
+    int64_t evictions;
+};
+
+static int stringCacheRange_cmp(const StringCacheRange *range1, const StringCacheRange *range2) {
+    int i = cactusMisc_nameCompare(range1->name, range2->name);
+    if (i != 0) {
+        return i;
+    }
+    return range1->start < range2->start ? -1 : (range1->start > range2->start ? 1 : 0);
+}
+
+static void stringCacheRange_destruct(StringCacheRange *range) {
+    free(range->string);
+    free(range);
+}
+
+StringCache *stringCache_construct(int64_t maxSize) {
+    StringCache *stringCache = st_calloc(1, sizeof(StringCache));
+    stringCache->ranges = stSortedSet_construct3((int (*)(const void *, const void *)) stringCacheRange_cmp,
+            (void (*)(void *)) stringCacheRange_destruct);
+    stringCache->maxSize = maxSize;
+    return stringCache;
+}
+
+void stringCache_destruct(StringCache *stringCache) {
+    stSortedSet_destruct(stringCache->ranges);
+    free(stringCache);
+}
+
+void stringCache_clear(StringCache *stringCache) {
+    stSortedSet_destruct(stringCache->ranges);
+    stringCache->ranges = stSortedSet_construct3((int (*)(const void *, const void *)) stringCacheRange_cmp,
+            (void (*)(void *)) stringCacheRange_destruct);
+    stringCache->mostRecentlyUsed = NULL;
+    stringCache->leastRecentlyUsed = NULL;
+    stringCache->size = 0;
+}
+
+/*
+ * Functions on the list of ranges ordered by use.
+ */
+
+static void unlinkRange(StringCache *stringCache, StringCacheRange *range) {
+    if (range->moreRecentlyUsed != NULL) {
+        range->moreRecentlyUsed->lessRecentlyUsed = range->lessRecentlyUsed;
+    } else {
+        stringCache->mostRecentlyUsed = range->lessRecentlyUsed;
+    }
+    if (range->lessRecentlyUsed != NULL) {
+        range->lessRecentlyUsed->moreRecentlyUsed = range->moreRecentlyUsed;
+    } else {
+        stringCache->leastRecentlyUsed = range->moreRecentlyUsed;
+    }
+    range->moreRecentlyUsed = NULL;
+    range->lessRecentlyUsed = NULL;
+}
+
+static void linkRangeAsMostRecentlyUsed(StringCache *stringCache, StringCacheRange *range) {
+    range->lessRecentlyUsed = stringCache->mostRecentlyUsed;
+    range->moreRecentlyUsed = NULL;
+    if (stringCache->mostRecentlyUsed != NULL) {
+        stringCache->mostRecentlyUsed->moreRecentlyUsed = range;
+    } else {
+        stringCache->leastRecentlyUsed = range;
+    }
+    stringCache->mostRecentlyUsed = range;
+}
+
+static void removeRange(StringCache *stringCache, StringCacheRange *range) {
+    unlinkRange(stringCache, range);
+    stringCache->size -= range->length;
+    stSortedSet_remove(stringCache->ranges, range);
+    stringCacheRange_destruct(range);
+}
+
+static void evict(StringCache *stringCache) {
+    /*
+     * Evicts the least recently used ranges until the cache is within its size, always keeping
+     * the most recently used range.
+     */
+    while (stringCache->size > stringCache->maxSize && stringCache->leastRecentlyUsed != stringCache->mostRecentlyUsed) {
+        removeRange(stringCache, stringCache->leastRecentlyUsed);
+        stringCache->evictions++;
+    }
+}
+
+void stringCache_setMaxSize(StringCache *stringCache, int64_t maxSize) {
+    stringCache->maxSize = maxSize;
+    evict(stringCache);
+}
+
+static StringCacheRange *getContainingRange(StringCache *stringCache, Name name, int64_t start, int64_t length) {
+    StringCacheRange key;
+    key.name = name;
+    key.start = start;
+    StringCacheRange *range = stSortedSet_searchLessThanOrEqual(stringCache->ranges, &key);
+    if (range != NULL && range->name == name && range->start + range->length >= start + length) {
+        return range;
+    }
+    return NULL;
+}
+
+void stringCache_setString(StringCache *stringCache, Name name, int64_t start, int64_t length, const char *string) {
+    stringCache->bytesFetched += length;
+    if (length == 0) {
+        return;
+    }
+    //Find the ranges that overlap or abut the new range, and the extent of their union.
+    stList *mergedRanges = stList_construct();
+    StringCacheRange key;
+    key.name = name;
+    key.start = start;
+    int64_t end = start + length;
+    StringCacheRange *range = stSortedSet_searchLessThanOrEqual(stringCache->ranges, &key);
+    if (range != NULL && range->name == name && range->start + range->length >= start) {
+        stList_append(mergedRanges, range);
+    }
+    range = stSortedSet_searchGreaterThan(stringCache->ranges, &key);
+    while (range != NULL && range->name == name && range->start <= end) {
+        stList_append(mergedRanges, range);
+        range = stSortedSet_searchGreaterThan(stringCache->ranges, range);
+    }
+    int64_t newStart = start, newEnd = end;
+    for (int64_t i = 0; i < stList_length(mergedRanges); i++) {
+        range = stList_get(mergedRanges, i);
+        newStart = range->start < newStart ? range->start : newStart;
+        newEnd = range->start + range->length > newEnd ? range->start + range->length : newEnd;
+    }
+    //Build the merged range.
+    StringCacheRange *newRange = st_calloc(1, sizeof(StringCacheRange));
+    newRange->name = name;
+    newRange->start = newStart;
+    newRange->length = newEnd - newStart;
+    newRange->string = st_malloc(newRange->length + 1);
+    for (int64_t i = 0; i < stList_length(mergedRanges); i++) {
+        range = stList_get(mergedRanges, i);
+        memcpy(newRange->string + range->start - newStart, range->string, range->length);
+        removeRange(stringCache, range);
+    }
+    memcpy(newRange->string + start - newStart, string, length);
+    stList_destruct(mergedRanges);
+    stSortedSet_insert(stringCache->ranges, newRange);
+    linkRangeAsMostRecentlyUsed(stringCache, newRange);
+    stringCache->size += newRange->length;
+    evict(stringCache);
+}
+
+bool stringCache_containsString(StringCache *stringCache, Name name, int64_t start, int64_t length) {
+    return getContainingRange(stringCache, name, start, length) != NULL;
+}
+
+char *stringCache_getString(StringCache *stringCache, Name name, int64_t start, int64_t length) {
+    StringCacheRange *range = getContainingRange(stringCache, name, start, length);
+    if (range == NULL) {
+        stringCache->misses++;
+        return NULL;
+    }
+    stringCache->hits++;
+    unlinkRange(stringCache, range);
+    linkRangeAsMostRecentlyUsed(stringCache, range);
+    char *string = st_malloc(length + 1);
+    memcpy(string, range->string + start - range->start, length);
+    return string;
+}
+
+void stringCache_getStats(StringCache *stringCache, CactusDiskStringCacheStats *stats) {
+    stats->hits = stringCache->hits;
+    stats->misses = stringCache->misses;
+    stats->bytesFetched = stringCache->bytesFetched;
+    stats->evictions = stringCache->evictions;
+    stats->size = stringCache->size;
+    stats->maxSize = stringCache->maxSize;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef CACTUS_STRING_CACHE_PRIVATE_H_
+#define CACTUS_STRING_CACHE_PRIVATE_H_
+
+#include "cactusGlobals.h"
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Size bounded cache of substrings of the strings in a cactus disk.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+typedef struct _stringCache StringCache;
+
+/*
+ * Constructs a cache holding at most (approximately) maxSize bytes of strings.
+ */
+StringCache *stringCache_construct(int64_t maxSize);
+
+void stringCache_destruct(StringCache *stringCache);
+
+/*
+ * Removes all the strings from the cache. The counters are not reset.
+ */
+void stringCache_clear(StringCache *stringCache);
+
+/*
+ * Sets the maximum number of bytes held by the cache, evicting strings if needed.
+ */
+void stringCache_setMaxSize(StringCache *stringCache, int64_t maxSize);
+
+/*
+ * Adds the substring [start, start + length) of the string with the given name to the cache,
+ * merging it with any cached ranges of the string it overlaps or abuts. The least recently used
+ * ranges are then evicted until the cache is within its size, though the range just added is
+ * always kept.
+ */
+void stringCache_setString(StringCache *stringCache, Name name, int64_t start, int64_t length, const char *string);
+
+/*
+ * Returns non-zero if the cache contains the given substring, without counting it as a hit or miss.
+ */
+bool stringCache_containsString(StringCache *stringCache, Name name, int64_t start, int64_t length);
+
+/*
+ * Gets a copy (which must be freed) of the given substring, which is not NUL terminated, or NULL
+ * if it is not in the cache.
+ */
+char *stringCache_getString(StringCache *stringCache, Name name, int64_t start, int64_t length);
+
+/*
+ * Gets the cache's counters.
+ */
+void stringCache_getStats(StringCache *stringCache, CactusDiskStringCacheStats *stats);
+
+#endif
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef CACTUS_COMPRESSION_H_
+#define CACTUS_COMPRESSION_H_
+
+#include "cactusGlobals.h"
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Record compression codecs.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+/*
+ * Records compressed with zlib are written as plain zlib streams, exactly as before codecs
+ * were introduced. Every other codec prefixes the record with a one byte tag, which can never
+ * be confused with the first byte of a zlib stream, so records written with any codec can be
+ * read back without knowing which codec wrote them.
+ */
+typedef enum {
+    CACTUS_CODEC_ZLIB = 0, //zlib, default level. The default.
+    CACTUS_CODEC_ZLIB_FAST = 1, //zlib, fastest level.
+    CACTUS_CODEC_NONE = 2, //Stored uncompressed.
+    CACTUS_CODEC_LZ4 = 3, //LZ4, only available if built with HAVE_LZ4.
+    CACTUS_CODEC_ZSTD = 4 //Zstandard, only available if built with HAVE_ZSTD.
+} CactusCodec;
+
+extern const char *CACTUS_COMPRESSION_EXCEPTION_ID;
+
+/*
+ * Compresses the data using the given codec, returning a new buffer (which must be freed)
+ * and setting compressedSize. Throws an exception if the codec is not available in this build.
+ */
+void *cactusCompression_compress(CactusCodec codec, const void *data, int64_t size, int64_t *compressedSize);
+
+/*
+ * Decompresses a record written by cactusCompression_compress with any codec, returning
+ * a new buffer (which must be freed) and setting uncompressedSize.
+ */
+void *cactusCompression_decompress(const void *data, int64_t size, int64_t *uncompressedSize);
+
+/*
+ * As cactusCompression_decompress, but returns NULL instead of throwing an exception if the
+ * record can't be decompressed, so it can be used from threads other than the main one.
+ */
+void *cactusCompression_tryDecompress(const void *data, int64_t size, int64_t *uncompressedSize);
+
+/*
+ * Returns non-zero if the codec is available in this build.
+ */
+bool cactusCompression_isAvailable(CactusCodec codec);
+
+/*
+ * Gets the codec with the given name ("zlib", "zlibFast", "none", "lz4" or "zstd").
+ * Throws an exception if the name is not recognised or the codec is not available.
+ */
+CactusCodec cactusCompression_getCodec(const char *name);
+
+/*
+ * Gets the name of the codec.
+ */
+const char *cactusCompression_getCodecName(CactusCodec codec);
+
+/*
+ * Gets the codec named by the compression="..." attribute of a database conf string, returning
+ * CACTUS_CODEC_ZLIB if the attribute is not present.
+ */
+CactusCodec cactusCompression_getCodecFromConfString(const char *confString);
+
+#endif
@@ -8,6 +8,7 @@
 #define CACTUS_DISK_H_
 
 #include "cactusGlobals.h"
+#include "cactusCompression.h"
 
 // General database exception id
 extern const char *CACTUS_DISK_EXCEPTION_ID;
@@ -46,12 +47,55 @@ int64_t cactusDisk_getUniqueID(CactusDisk *cactusDisk);
  */
 int64_t cactusDisk_getUniqueIDInterval(CactusDisk *cactusDisk, int64_t intervalSize);
 
+/*
+ * Gets the number of database round trips made so far to reserve unique IDs.
+ */
+int64_t cactusDisk_getUniqueIDRoundTrips(CactusDisk *cactusDisk);
+
 /*
  * Writes the updated state of the parts of the cactus disk in memory to disk.
  *
  */
 void cactusDisk_write(CactusDisk *cactusDisk);
 
+/*
+ * Sets the number of worker threads used to serialise and compress flowers and meta sequences
+ * in cactusDisk_write. The database is always written to by a single committer thread.
+ * Defaults to 1.
+ */
+void cactusDisk_setWriteThreads(CactusDisk *cactusDisk, int64_t writeThreads);
+
+/*
+ * Sets the codec used to compress records written by the cactus disk. Records are read back
+ * whichever codec wrote them. Defaults to CACTUS_CODEC_ZLIB.
+ */
+void cactusDisk_setCodec(CactusDisk *cactusDisk, CactusCodec codec);
+
+/*
+ * Gets the codec used to compress records written by the cactus disk.
+ */
+CactusCodec cactusDisk_getCodec(CactusDisk *cactusDisk);
+
+/*
+ * Sets the number of characters in each of the (2-bit packed) sequence blocks that strings are
+ * stored in. Can only be called on a newly created cactus disk, before any strings are added.
+ * Defaults to 65536.
+ */
+void cactusDisk_setSequenceBlockSize(CactusDisk *cactusDisk, int64_t sequenceBlockSize);
+
+/*
+ * Writes the strings of the given meta sequences, which must belong to the cactus disk, to a
+ * read-only sequence store file, which can be shared by processes through cactusDisk_useSequenceStore.
+ */
+void cactusDisk_writeSequenceStore(CactusDisk *cactusDisk, stList *metaSequences, const char *fileName);
+
+/*
+ * Memory maps the sequence store file, so that the strings it contains are read from it rather
+ * than from the database. Processes on one machine mapping the same file share a single copy of
+ * the strings. Strings not in the store are still read from the database.
+ */
+void cactusDisk_useSequenceStore(CactusDisk *cactusDisk, const char *fileName);
+
 /*
  * This is used to serialise a flower before a call to a cactusDisk_write, it is exposed for use in the cactus_caf code.
  */
@@ -91,6 +135,40 @@ void cactusDisk_preCacheSegmentStrings(CactusDisk *cactusDisk, stList *flowers);
  */
 void cactusDisk_clearStringCache(CactusDisk *cactusDisk);
 
+/*
+ * Counters of the cache of sequences.
+ */
+typedef struct _cactusDiskStringCacheStats {
+    int64_t hits; //Substrings found in the cache.
+    int64_t misses; //Substrings not found in the cache.
+    int64_t bytesFetched; //Bytes of sequence added to the cache from the database.
+    int64_t evictions; //Cached ranges evicted to keep the cache within its size.
+    int64_t size; //Bytes currently cached.
+    int64_t maxSize; //The size the cache is kept within.
+} CactusDiskStringCacheStats;
+
+/*
+ * Sets the number of bytes of sequence the cache may hold, beyond which the least recently
+ * used sequences are evicted. Defaults to 100MB.
+ */
+void cactusDisk_setStringCacheSize(CactusDisk *cactusDisk, int64_t stringCacheSize);
+
+/*
+ * Gets the counters of the cache of sequences.
+ */
+void cactusDisk_getStringCacheStats(CactusDisk *cactusDisk, CactusDiskStringCacheStats *stats);
+
+/*
+ * Logs the counters of the cache of sequences at the info level.
+ */
+void cactusDisk_logStringCacheStats(CactusDisk *cactusDisk);
+
+/*
+ * Applies the cactus disk options given as attributes of the database conf string:
+ * compression="..." (see cactusCompression_getCodec) and stringCacheSize="..." (in bytes).
+ */
+void cactusDisk_setOptionsFromConfString(CactusDisk *cactusDisk, const char *confString);
+
 /*
  * Clears all cached DB responses (but not cached sequences).
  */
@@ -36,6 +36,9 @@ typedef struct {
     CactusDisk *cactusDisk;
     Flower *curFlower;
     size_t nextIdx;
+    struct _flowerDecompressor *decompressor; // NULL unless decompressing ahead.
+    bool unloadFlowers;
+    bool preCacheStrings; // Cache the sequence of each batch as it is loaded, if not decompressing ahead.
 } FlowerStream;
 
 /*
@@ -49,6 +52,26 @@ typedef struct {
  */
 FlowerStream *flowerWriter_getFlowerStream(CactusDisk *cactusDisk, FILE *file);
 
+/*
+ * The number of batches of flowers the tools decompress ahead.
+ */
+#define FLOWER_STREAM_DEFAULT_DECOMPRESSION_BATCHES 2
+
+/*
+ * As flowerWriter_getFlowerStream, but the records of up to decompressionBatches
+ * batches of flowers ahead, and the sequence of the next batch, are read
+ * in bulk and handed to a helper thread to decompress and decode, so that
+ * work overlaps with work on the current flower. The reads themselves are
+ * made by the calling thread between batches, so database latency is not
+ * hidden. If unloadFlowers is false
+ * the flowers returned stay loaded, so they can be modified and written
+ * back with cactusDisk_write. If decompressionBatches is not positive the
+ * flowers are loaded a batch at a time as needed, with their sequence
+ * cached as each batch is loaded.
+ */
+FlowerStream *flowerWriter_getDecompressingFlowerStream(CactusDisk *cactusDisk, FILE *file,
+        int64_t decompressionBatches, bool unloadFlowers);
+
 /*
  * Free a flowerStream.
  */
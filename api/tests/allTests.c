@@ -24,6 +24,8 @@ CuSuite *cactusFaceEndTestSuite();
 CuSuite *cactusSequenceTestSuite();
 CuSuite *cactusSerialisationTestSuite();
 CuSuite *cactusFlowerWriterTestSuite();
+CuSuite *cactusCompressionTestSuite();
+CuSuite *cactusStringCacheTestSuite();
 
 
 int cactusAPIRunAllTests(void) {
@@ -47,6 +49,8 @@ int cactusAPIRunAllTests(void) {
 	CuSuiteAddSuite(suite, cactusSequenceTestSuite());
 	CuSuiteAddSuite(suite, cactusSerialisationTestSuite());
 	CuSuiteAddSuite(suite, cactusFlowerWriterTestSuite());
+	CuSuiteAddSuite(suite, cactusCompressionTestSuite());
+	CuSuiteAddSuite(suite, cactusStringCacheTestSuite());
 	CuSuiteRun(suite);
 	CuSuiteSummary(suite, output);
 	CuSuiteDetails(suite, output);
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+
+static char *getRandomRecord(int64_t size) {
+    char *record = st_malloc(size + 1);
+    for (int64_t i = 0; i < size; i++) {
+        record[i] = "ACGTN"[st_randomInt(0, 5)];
+    }
+    record[size] = '\0';
+    return record;
+}
+
+void testCactusCompression_roundTrip(CuTest* testCase) {
+    for (int64_t codec = CACTUS_CODEC_ZLIB; codec <= CACTUS_CODEC_ZSTD; codec++) {
+        if (!cactusCompression_isAvailable(codec)) {
+            continue;
+        }
+        CuAssertIntEquals(testCase, codec, cactusCompression_getCodec(cactusCompression_getCodecName(codec)));
+        for (int64_t i = 0; i < 100; i++) {
+            int64_t size = st_randomInt(0, 10000);
+            char *record = getRandomRecord(size);
+            int64_t compressedSize, uncompressedSize;
+            void *compressed = cactusCompression_compress(codec, record, size, &compressedSize);
+            char *uncompressed = cactusCompression_decompress(compressed, compressedSize, &uncompressedSize);
+            CuAssertIntEquals(testCase, size, uncompressedSize);
+            CuAssertTrue(testCase, memcmp(record, uncompressed, size) == 0);
+            free(record);
+            free(compressed);
+            free(uncompressed);
+        }
+    }
+}
+
+void testCactusCompression_legacyRecords(CuTest* testCase) {
+    /*
+     * Records written by stCompression before codecs were introduced must still be readable.
+     */
+    char *record = getRandomRecord(5000);
+    int64_t compressedSize, uncompressedSize;
+    void *compressed = stCompression_compress(record, 5001, &compressedSize, -1);
+    char *uncompressed = cactusCompression_decompress(compressed, compressedSize, &uncompressedSize);
+    CuAssertIntEquals(testCase, 5001, uncompressedSize);
+    CuAssertStrEquals(testCase, record, uncompressed);
+    free(record);
+    free(compressed);
+    free(uncompressed);
+}
+
+void testCactusCompression_tryDecompress(CuTest* testCase) {
+    /*
+     * A truncated record can't be decompressed, which is reported by a NULL rather than an exception.
+     */
+    char *record = getRandomRecord(5000);
+    int64_t compressedSize, uncompressedSize;
+    void *compressed = cactusCompression_compress(CACTUS_CODEC_ZLIB, record, 5000, &compressedSize);
+    char *uncompressed = cactusCompression_tryDecompress(compressed, compressedSize, &uncompressedSize);
+    CuAssertTrue(testCase, uncompressed != NULL);
+    CuAssertIntEquals(testCase, 5000, uncompressedSize);
+    CuAssertTrue(testCase, memcmp(record, uncompressed, 5000) == 0);
+    free(uncompressed);
+    CuAssertPtrEquals(testCase, NULL, cactusCompression_tryDecompress(compressed, compressedSize / 2, &uncompressedSize));
+    free(record);
+    free(compressed);
+}
+
+void testCactusCompression_getCodecFromConfString(CuTest* testCase) {
+    CuAssertIntEquals(testCase, CACTUS_CODEC_ZLIB, cactusCompression_getCodecFromConfString(
+            "<st_kv_database_conf type=\"tokyo_cabinet\"><tokyo_cabinet database_dir=\"temp\"/></st_kv_database_conf>"));
+    CuAssertIntEquals(testCase, CACTUS_CODEC_NONE, cactusCompression_getCodecFromConfString(
+            "<st_kv_database_conf type=\"tokyo_cabinet\" compression=\"none\"><tokyo_cabinet database_dir=\"temp\"/></st_kv_database_conf>"));
+    CuAssertIntEquals(testCase, CACTUS_CODEC_ZLIB_FAST, cactusCompression_getCodecFromConfString(
+            "<st_kv_database_conf type=\"tokyo_cabinet\" compression=\"zlibFast\"><tokyo_cabinet database_dir=\"temp\"/></st_kv_database_conf>"));
+    //Assert outside of the try block, a failing CuAssert must not jump out of it.
+    char *exceptionId = NULL;
+    stTry {
+        cactusCompression_getCodec("notACodec");
+    } stCatch(except) {
+        exceptionId = stString_copy(stExcept_getId(except));
+        stExcept_free(except);
+    } stTryEnd
+    CuAssertTrue(testCase, exceptionId != NULL);
+    CuAssertStrEquals(testCase, CACTUS_COMPRESSION_EXCEPTION_ID, exceptionId);
+    free(exceptionId);
+}
+
+CuSuite* cactusCompressionTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testCactusCompression_roundTrip);
+    SUITE_ADD_TEST(suite, testCactusCompression_legacyRecords);
+    SUITE_ADD_TEST(suite, testCactusCompression_tryDecompress);
+    SUITE_ADD_TEST(suite, testCactusCompression_getCodecFromConfString);
+    return suite;
+}
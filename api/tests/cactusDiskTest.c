@@ -58,6 +58,27 @@ void testCactusDisk_getFlower(CuTest* testCase) {
     cactusDiskTestTeardown();
 }
 
+void testCactusDisk_rewriteFlower(CuTest* testCase) {
+    cactusDiskTestSetup();
+    Name name = flower_getName(flower_construct(cactusDisk));
+    cactusDisk_write(cactusDisk);
+    for (int64_t i = 0; i < 2; i++) {
+        //Reload the flower, then write it back both unchanged and changed.
+        cactusDisk_destruct(cactusDisk);
+        cactusDisk = cactusDisk_construct(conf, false, true);
+        Flower *flower = cactusDisk_getFlower(cactusDisk, name);
+        CuAssertTrue(testCase, flower != NULL);
+        CuAssertIntEquals(testCase, i, flower_builtBlocks(flower));
+        cactusDisk_write(cactusDisk);
+        flower_setBuiltBlocks(flower, 1);
+        cactusDisk_write(cactusDisk);
+    }
+    cactusDisk_destruct(cactusDisk);
+    cactusDisk = cactusDisk_construct(conf, false, true);
+    CuAssertTrue(testCase, flower_builtBlocks(cactusDisk_getFlower(cactusDisk, name)));
+    cactusDiskTestTeardown();
+}
+
 void testCactusDisk_getMetaSequence(CuTest* testCase) {
     cactusDiskTestSetup();
     MetaSequence *metaSequence = metaSequence_construct(1, 10, "ACTGACTGAG",
@@ -92,6 +113,19 @@ void testCactusDisk_getUniqueID(CuTest* testCase) {
     cactusDiskTestTeardown();
 }
 
+void testCactusDisk_getUniqueID_roundTrips(CuTest* testCase) {
+    cactusDiskTestSetup();
+    Name previousName = 0;
+    for (int64_t i = 0; i < 1000000; i++) {
+        Name uniqueName = cactusDisk_getUniqueID(cactusDisk);
+        CuAssertTrue(testCase, uniqueName > previousName); //Reserved from a single bucket, so increasing.
+        previousName = uniqueName;
+    }
+    //The reservations grow, so a million IDs should need only a handful of round trips.
+    CuAssertTrue(testCase, cactusDisk_getUniqueIDRoundTrips(cactusDisk) <= 20);
+    cactusDiskTestTeardown();
+}
+
 int testCactusDisk_getUniqueID_UniqueP(const void *a, const void *b) {
     return cactusMisc_nameCompare(cactusMisc_stringToName(a), cactusMisc_stringToName(b));
 }
@@ -134,13 +168,96 @@ void testCactusDisk_getUniqueID_UniqueIntervals(CuTest* testCase) {
     cactusDiskTestTeardown();
 }
 
+void testCactusDisk_sequenceBlocks(CuTest* testCase) {
+    cactusDiskTestSetup();
+    cactusDisk_setSequenceBlockSize(cactusDisk, 100);
+    int64_t length = 1000;
+    char *string = st_malloc(length + 1);
+    for (int64_t i = 0; i < length; i++) { //Random bases, with runs of Ns, other characters and lower case.
+        string[i] = "ACGTACGTACGTACGTNNRacgtn"[st_randomInt(0, 24)];
+    }
+    string[length] = '\0';
+    Name name = cactusDisk_addString(cactusDisk, string);
+    cactusDisk_write(cactusDisk);
+    cactusDisk_destruct(cactusDisk);
+    cactusDisk = cactusDisk_construct(conf, false, true);
+    for (int64_t i = 0; i < 1000; i++) {
+        int64_t start = st_randomInt(0, length);
+        int64_t subLength = st_randomInt(0, length - start + 1);
+        int64_t strand = st_random() > 0.5;
+        cactusDisk_clearStringCache(cactusDisk);
+        char *subString = cactusDisk_getString(cactusDisk, name, start, subLength, strand, length);
+        char *expectedSubString = stString_getSubString(string, start, subLength);
+        if (!strand) {
+            char *cA = stString_reverseComplementString(expectedSubString);
+            free(expectedSubString);
+            expectedSubString = cA;
+        }
+        CuAssertStrEquals(testCase, expectedSubString, subString);
+        free(subString);
+        subString = cactusDisk_getStringFromCache(cactusDisk, name, start, subLength, strand); //Now cached
+        CuAssertTrue(testCase, subLength == 0 || subString != NULL);
+        if (subString != NULL) {
+            CuAssertStrEquals(testCase, expectedSubString, subString);
+            free(subString);
+        }
+        free(expectedSubString);
+    }
+    free(string);
+    cactusDiskTestTeardown();
+}
+
+void testCactusDisk_sequenceStore(CuTest* testCase) {
+    cactusDiskTestSetup();
+    MetaSequence *metaSequence = metaSequence_construct(1, 10, "ACTGACTGAG", "FOO", 10, cactusDisk);
+    MetaSequence *metaSequence2 = metaSequence_construct(2, 12, "CCnnNNaattTT", "BAR", 10, cactusDisk);
+    stList *metaSequences = stList_construct();
+    stList_append(metaSequences, metaSequence);
+    stList_append(metaSequences, metaSequence2);
+    stList_append(metaSequences, metaSequence); //Duplicates are only written once.
+    char *tempPath = getTempFile();
+    cactusDisk_writeSequenceStore(cactusDisk, metaSequences, tempPath);
+    stList_destruct(metaSequences);
+    MetaSequence *metaSequence3 = metaSequence_construct(3, 5, "GGGGA", "BAZ", 10, cactusDisk); //Not in the store
+    cactusDisk_useSequenceStore(cactusDisk, tempPath);
+    cactusDisk_clearStringCache(cactusDisk);
+    char *cA = metaSequence_getString(metaSequence, 2, 5, 1);
+    CuAssertStrEquals(testCase, "CTGAC", cA);
+    free(cA);
+    cA = metaSequence_getString(metaSequence2, 2, 12, 1);
+    CuAssertStrEquals(testCase, "CCnnNNaattTT", cA);
+    free(cA);
+    cA = metaSequence_getString(metaSequence2, 7, 4, 0);
+    CuAssertStrEquals(testCase, "attN", cA);
+    free(cA);
+    cA = metaSequence_getString(metaSequence3, 3, 5, 1);
+    CuAssertStrEquals(testCase, "GGGGA", cA);
+    free(cA);
+    //Reading past the end of a stored string is an error, not an out of bounds read.
+    bool threw = 0;
+    stTry {
+        cA = cactusDisk_getString(cactusDisk, metaSequence->stringName, 8, 5, 1, 10);
+        free(cA);
+    } stCatch(except) {
+        threw = 1;
+        stExcept_free(except);
+    } stTryEnd
+    CuAssertTrue(testCase, threw);
+    removeTempFile(tempPath);
+    cactusDiskTestTeardown();
+}
+
 CuSuite* cactusDiskTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testCactusDisk_write);
     SUITE_ADD_TEST(suite, testCactusDisk_getFlower);
+    SUITE_ADD_TEST(suite, testCactusDisk_rewriteFlower);
     SUITE_ADD_TEST(suite, testCactusDisk_getMetaSequence);
+    SUITE_ADD_TEST(suite, testCactusDisk_sequenceBlocks);
+    SUITE_ADD_TEST(suite, testCactusDisk_sequenceStore);
     SUITE_ADD_TEST(suite, testCactusDisk_getUniqueID);
     SUITE_ADD_TEST(suite, testCactusDisk_getUniqueID_Unique);
+    SUITE_ADD_TEST(suite, testCactusDisk_getUniqueID_roundTrips);
     SUITE_ADD_TEST(suite, testCactusDisk_getUniqueID_UniqueIntervals);
     SUITE_ADD_TEST(suite, testCactusDisk_constructAndDestruct);
     return suite;
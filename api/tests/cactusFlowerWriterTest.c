@@ -53,6 +53,109 @@ static void testFlowerStream(CuTest *testCase) {
     testCommon_deleteTemporaryCactusDisk(cactusDisk);
 }
 
+static void testFlowerStream_decompressing(CuTest *testCase) {
+    CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+    char *tempPath = getTempFile();
+    FILE *f = fopen(tempPath, "w");
+    // Enough flowers for several batches.
+    int64_t flowerNumber = 120;
+    Name *flowerNames = st_malloc(sizeof(Name) * flowerNumber);
+    fprintf(f, "%" PRIi64, flowerNumber);
+    for (int64_t i = 0; i < flowerNumber; i++) {
+        flowerNames[i] = flower_getName(flower_construct(cactusDisk));
+        fprintf(f, " %" PRIi64, i == 0 ? flowerNames[i] : flowerNames[i] - flowerNames[i - 1]);
+    }
+    fclose(f);
+    cactusDisk_write(cactusDisk);
+    Flower *flower;
+    while ((flower = stSortedSet_getFirst(cactusDisk->flowers)) != NULL) {
+        flower_destruct(flower, false);
+    }
+
+    // With no decompression batches the flowers are loaded as needed, otherwise the helper thread runs.
+    for (int64_t test = 0; test < 4; test++) {
+        int64_t decompressionBatches = test < 2 ? 0 : 2;
+        bool unloadFlowers = test % 2;
+        f = fopen(tempPath, "r");
+        FlowerStream *flowerStream = flowerWriter_getDecompressingFlowerStream(cactusDisk, f, decompressionBatches,
+                unloadFlowers);
+        CuAssertIntEquals(testCase, flowerNumber, flowerStream_size(flowerStream));
+        int64_t i = 0;
+        while ((flower = flowerStream_getNext(flowerStream)) != NULL) {
+            CuAssertTrue(testCase, i < flowerNumber);
+            CuAssertIntEquals(testCase, flowerNames[i], flower_getName(flower));
+            i++;
+        }
+        CuAssertIntEquals(testCase, flowerNumber, i);
+        flowerStream_destruct(flowerStream);
+        fclose(f);
+        // Either every flower is still loaded, or none are.
+        CuAssertIntEquals(testCase, unloadFlowers ? 0 : flowerNumber, stSortedSet_size(cactusDisk->flowers));
+        while ((flower = stSortedSet_getFirst(cactusDisk->flowers)) != NULL) {
+            flower_destruct(flower, false);
+        }
+    }
+    free(flowerNames);
+    removeTempFile(tempPath);
+    testCommon_deleteTemporaryCactusDisk(cactusDisk);
+}
+
+static void testFlowerStream_decompressingChunkedStrings(CuTest *testCase) {
+    CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+    // Store the strings as plain chunks, as disks written before sequence blocks do.
+    cactusDisk->sequenceBlockSize = 0;
+    eventTree_construct2(cactusDisk);
+    char *tempPath = getTempFile();
+    FILE *f = fopen(tempPath, "w");
+    // Enough flowers for several batches, each with a thread.
+    int64_t flowerNumber = 120;
+    Name *flowerNames = st_malloc(sizeof(Name) * flowerNumber);
+    Name *stringNames = st_malloc(sizeof(Name) * flowerNumber);
+    char **strings = st_malloc(sizeof(char *) * flowerNumber);
+    fprintf(f, "%" PRIi64, flowerNumber);
+    for (int64_t i = 0; i < flowerNumber; i++) {
+        Flower *flower = flower_construct(cactusDisk);
+        flowerNames[i] = flower_getName(flower);
+        fprintf(f, " %" PRIi64, i == 0 ? flowerNames[i] : flowerNames[i] - flowerNames[i - 1]);
+        Cap *cap = flower_getCap(flower, testCommon_addThreadToFlower(flower, "thread", st_randomInt(1, 5000)));
+        Sequence *sequence = cap_getSequence(cap);
+        stringNames[i] = sequence_getMetaSequence(sequence)->stringName;
+        strings[i] = sequence_getString(sequence, sequence_getStart(sequence), sequence_getLength(sequence), 1);
+    }
+    fclose(f);
+    cactusDisk_write(cactusDisk);
+    Flower *flower;
+    while ((flower = stSortedSet_getFirst(cactusDisk->flowers)) != NULL) {
+        flower_destruct(flower, false);
+    }
+    cactusDisk_clearStringCache(cactusDisk);
+
+    // Each flower's string must be in the cache by the time the stream returns the flower.
+    f = fopen(tempPath, "r");
+    FlowerStream *flowerStream = flowerWriter_getDecompressingFlowerStream(cactusDisk, f, 2, 1);
+    int64_t i = 0;
+    while ((flower = flowerStream_getNext(flowerStream)) != NULL) {
+        CuAssertTrue(testCase, i < flowerNumber);
+        CuAssertIntEquals(testCase, flowerNames[i], flower_getName(flower));
+        char *string = cactusDisk_getStringFromCache(cactusDisk, stringNames[i], 0, strlen(strings[i]), 1);
+        CuAssertTrue(testCase, string != NULL);
+        CuAssertStrEquals(testCase, strings[i], string);
+        free(string);
+        i++;
+    }
+    CuAssertIntEquals(testCase, flowerNumber, i);
+    flowerStream_destruct(flowerStream);
+    fclose(f);
+    for (i = 0; i < flowerNumber; i++) {
+        free(strings[i]);
+    }
+    free(strings);
+    free(stringNames);
+    free(flowerNames);
+    removeTempFile(tempPath);
+    testCommon_deleteTemporaryCactusDisk(cactusDisk);
+}
+
 static void testFlowerWriter(CuTest *testCase) {
     char *tempFile = "./flowerWriterTest.txt";
     FILE *fileHandle = fopen(tempFile, "w");
@@ -101,6 +204,8 @@ static void testFlowerWriter(CuTest *testCase) {
 CuSuite* cactusFlowerWriterTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testFlowerStream);
+    SUITE_ADD_TEST(suite, testFlowerStream_decompressing);
+    SUITE_ADD_TEST(suite, testFlowerStream_decompressingChunkedStrings);
     SUITE_ADD_TEST(suite, testFlowerWriter);
     return suite;
 }
@@ -101,6 +101,47 @@ void testBinaryRepresentation_bool(CuTest* testCase) {
     cactusSerialisationTestTeardown();
 }
 
+void testBinaryRepresentation_compact(CuTest* testCase) {
+    cactusSerialisationTestSetup();
+    void *vA2 = vA;
+    Name baseName = 543829676894821452;
+    int64_t integers[] = { 0, 1, -1, 63, -64, 64, 537869, INT64_MAX, INT64_MIN };
+    Name names[] = { baseName, baseName + 100, baseName - 100, 1, INT64_MAX, INT64_MIN };
+    int64_t coordinates[] = { 5, 1000000, 999990, 1000010, 0, INT64_MAX };
+    BinaryRepresentationFormat format = binaryRepresentation_setFormat(1, baseName);
+    for (int64_t i = 0; i < 9; i++) {
+        binaryRepresentation_writeInteger(integers[i], writeFn);
+    }
+    for (int64_t i = 0; i < 6; i++) {
+        binaryRepresentation_writeName(names[i], writeFn);
+        binaryRepresentation_writeCoordinate(coordinates[i], writeFn);
+    }
+    binaryRepresentation_writeString("HELLO I AM A STRING", writeFn);
+    binaryRepresentation_writeBool(1, writeFn);
+    //Small values take a byte, nearby names and coordinates a few.
+    CuAssertTrue(testCase, vA3 - vA < 9 * sizeof(int64_t) + 12 * sizeof(int64_t));
+
+    binaryRepresentation_setFormat(1, baseName);
+    for (int64_t i = 0; i < 9; i++) {
+        CuAssertTrue(testCase, integers[i] == binaryRepresentation_getInteger(&vA2));
+    }
+    for (int64_t i = 0; i < 6; i++) {
+        CuAssertTrue(testCase, names[i] == binaryRepresentation_getName(&vA2));
+        CuAssertTrue(testCase, coordinates[i] == binaryRepresentation_getCoordinate(&vA2));
+    }
+    CuAssertStrEquals(testCase, "HELLO I AM A STRING", binaryRepresentation_getString(&vA2));
+    CuAssertTrue(testCase, binaryRepresentation_getBool(&vA2));
+    CuAssertTrue(testCase, (char *) vA2 == vA3);
+    binaryRepresentation_restoreFormat(format);
+
+    //Restoring the format returns to fixed width integers.
+    vA2 = vA3;
+    binaryRepresentation_writeInteger(1, writeFn);
+    CuAssertTrue(testCase, vA3 - (char *) vA2 == sizeof(int64_t));
+    CuAssertIntEquals(testCase, 1, binaryRepresentation_getInteger(&vA2));
+    cactusSerialisationTestTeardown();
+}
+
 static void testBinaryRepresentation_fn(void *object, void(*writeFn)(const void * ptr, size_t size, size_t count)) {
     binaryRepresentation_writeInteger(*(int64_t *) object, writeFn);
 }
@@ -117,6 +158,33 @@ void testBinaryRepresentation_makeBinaryRepresentation(CuTest* testCase) {
     cactusSerialisationTestTeardown();
 }
 
+static void testBinaryRepresentation_nestedFn(void *object, void(*writeFn)(const void * ptr, size_t size, size_t count)) {
+    binaryRepresentation_writeInteger(*(int64_t *) object, writeFn);
+    //Serialise another object part way through, as a loader might.
+    int64_t i = 5, recordSize;
+    void *vA = binaryRepresentation_makeBinaryRepresentation(&i, testBinaryRepresentation_fn, &recordSize);
+    free(vA);
+    binaryRepresentation_writeString("A STRING", writeFn);
+}
+
+void testBinaryRepresentation_writeToBuffer(CuTest* testCase) {
+    BinaryRepresentationBuffer buffer;
+    binaryRepresentation_initialiseBuffer(&buffer);
+    for (int64_t i = 0; i < 1000; i++) { //Enough to make the buffer grow.
+        binaryRepresentation_writeToBuffer(&buffer, &i, testBinaryRepresentation_nestedFn);
+    }
+    void *vA2 = buffer.data;
+    for (int64_t i = 0; i < 1000; i++) {
+        CuAssertIntEquals(testCase, i, binaryRepresentation_getInteger(&vA2));
+        int64_t length;
+        const char *string = binaryRepresentation_getStringView(&vA2, &length);
+        CuAssertIntEquals(testCase, 8, length);
+        CuAssertTrue(testCase, memcmp(string, "A STRING", length) == 0);
+    }
+    CuAssertTrue(testCase, (char *) vA2 == buffer.data + buffer.size);
+    binaryRepresentation_freeBuffer(&buffer);
+}
+
 static void testBinaryRepresentation_resizeObjectAsPowerOf2(CuTest* testCase) {
     for(int64_t i=0; i<100000; i++) {
         int64_t recordSize = i;
@@ -137,7 +205,9 @@ CuSuite* cactusSerialisationTestSuite(void) {
     SUITE_ADD_TEST(suite, testBinaryRepresentation_name);
     SUITE_ADD_TEST(suite, testBinaryRepresentation_float);
     SUITE_ADD_TEST(suite, testBinaryRepresentation_bool);
+    SUITE_ADD_TEST(suite, testBinaryRepresentation_compact);
     SUITE_ADD_TEST(suite, testBinaryRepresentation_makeBinaryRepresentation);
+    SUITE_ADD_TEST(suite, testBinaryRepresentation_writeToBuffer);
     SUITE_ADD_TEST(suite, testBinaryRepresentation_resizeObjectAsPowerOf2);
     return suite;
 }
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+
+static void checkString(CuTest *testCase, StringCache *stringCache, Name name, int64_t start, int64_t length,
+        const char *expectedString) {
+    char *string = stringCache_getString(stringCache, name, start, length);
+    if (expectedString == NULL) {
+        CuAssertPtrEquals(testCase, NULL, string);
+    } else {
+        CuAssertTrue(testCase, string != NULL);
+        CuAssertTrue(testCase, memcmp(string, expectedString, length) == 0);
+        free(string);
+    }
+}
+
+void testStringCache_merging(CuTest* testCase) {
+    StringCache *stringCache = stringCache_construct(1000);
+    stringCache_setString(stringCache, 1, 10, 5, "ACGTA");
+    stringCache_setString(stringCache, 1, 15, 5, "CCCCC"); //Abuts the first range
+    stringCache_setString(stringCache, 1, 30, 5, "GGGGG");
+    stringCache_setString(stringCache, 2, 12, 5, "TTTTT"); //Another string
+    checkString(testCase, stringCache, 1, 10, 10, "ACGTACCCCC");
+    checkString(testCase, stringCache, 1, 12, 5, "GTACC");
+    checkString(testCase, stringCache, 1, 18, 5, NULL); //Spans a gap
+    checkString(testCase, stringCache, 2, 12, 5, "TTTTT");
+    stringCache_setString(stringCache, 1, 18, 14, "AAAAAAAAAAAAAA"); //Overlaps both ranges
+    checkString(testCase, stringCache, 1, 10, 25, "ACGTACCCAAAAAAAAAAAAAAGGG");
+    CactusDiskStringCacheStats stats;
+    stringCache_getStats(stringCache, &stats);
+    CuAssertIntEquals(testCase, 4, stats.hits);
+    CuAssertIntEquals(testCase, 1, stats.misses);
+    CuAssertIntEquals(testCase, 34, stats.bytesFetched);
+    CuAssertIntEquals(testCase, 30, stats.size);
+    CuAssertIntEquals(testCase, 0, stats.evictions);
+    stringCache_destruct(stringCache);
+}
+
+void testStringCache_eviction(CuTest* testCase) {
+    StringCache *stringCache = stringCache_construct(10);
+    stringCache_setString(stringCache, 1, 0, 4, "AAAA");
+    stringCache_setString(stringCache, 2, 0, 4, "CCCC");
+    checkString(testCase, stringCache, 1, 0, 4, "AAAA"); //Now 2 is the least recently used
+    stringCache_setString(stringCache, 3, 0, 4, "GGGG");
+    checkString(testCase, stringCache, 2, 0, 4, NULL);
+    checkString(testCase, stringCache, 1, 0, 4, "AAAA");
+    checkString(testCase, stringCache, 3, 0, 4, "GGGG");
+    stringCache_setString(stringCache, 4, 0, 20, "TTTTTTTTTTTTTTTTTTTT"); //Larger than the cache, but kept
+    checkString(testCase, stringCache, 1, 0, 4, NULL);
+    checkString(testCase, stringCache, 3, 0, 4, NULL);
+    checkString(testCase, stringCache, 4, 5, 10, "TTTTTTTTTT");
+    CactusDiskStringCacheStats stats;
+    stringCache_getStats(stringCache, &stats);
+    CuAssertIntEquals(testCase, 3, stats.evictions);
+    CuAssertIntEquals(testCase, 20, stats.size);
+    stringCache_clear(stringCache);
+    checkString(testCase, stringCache, 4, 5, 10, NULL);
+    stringCache_destruct(stringCache);
+}
+
+CuSuite* cactusStringCacheTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testStringCache_merging);
+    SUITE_ADD_TEST(suite, testStringCache_eviction);
+    return suite;
+}
@@ -70,6 +70,12 @@ void usage() {
 
     fprintf(stderr, "-M --minimumCoverageToRescue : Unaligned segments must have at least this proportion of their bases covered by an outgroup to be rescued.\n");
 
+    fprintf(stderr, "-P --numWriteThreads : Number of threads used to serialise and compress flowers when writing the cactus disk. Default 1.\n");
+
+    fprintf(stderr, "-Q --sequenceStore : Read-only sequence store file (see cactus_exportSequences) to read the sequences from, rather than the database.\n");
+
+    fprintf(stderr, "-R --stringCacheSize : Maximum number of bytes of sequence to cache in memory. Default 100000000.\n");
+
     fprintf(stderr, "-h --help : Print this help screen\n");
 }
 
@@ -95,7 +101,7 @@ int main(int argc, char *argv[]) {
 
     char * logLevelString = NULL;
     char * cactusDiskDatabaseString = NULL;
-    int64_t i, j;
+    int64_t i;
     int64_t spanningTrees = 10;
     int64_t maximumLength = 1500;
     bool useProgressiveMerging = 0;
@@ -111,6 +117,9 @@ int main(int argc, char *argv[]) {
     char *ingroupCoverageFilePath = NULL;
     int64_t minimumSizeToRescue = 1;
     double minimumCoverageToRescue = 0.0;
+    int64_t numWriteThreads = 1;
+    char *sequenceStoreFile = NULL;
+    int64_t stringCacheSize = -1;
 
     PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters = pairwiseAlignmentBandingParameters_construct();
 
@@ -140,11 +149,14 @@ int main(int argc, char *argv[]) {
                         {"minimumSizeToRescue", required_argument, 0, 'K'},
                         {"minimumCoverageToRescue", required_argument, 0, 'M'},
                         { "minimumNumberOfSpecies", required_argument, 0, 'N' },
+                        { "numWriteThreads", required_argument, 0, 'P' },
+                        { "sequenceStore", required_argument, 0, 'Q' },
+                        { "stringCacheSize", required_argument, 0, 'R' },
                         { 0, 0, 0, 0 } };
 
         int option_index = 0;
 
-        int key = getopt_long(argc, argv, "a:b:hi:j:kl:o:p:q:r:t:u:wy:A:B:D:E:FGI:J:K:L:M:N:", long_options, &option_index);
+        int key = getopt_long(argc, argv, "a:b:hi:j:kl:o:p:q:r:t:u:wy:A:B:D:E:FGI:J:K:L:M:N:P:Q:R:", long_options, &option_index);
 
         if (key == -1) {
             break;
@@ -265,6 +277,21 @@ int main(int argc, char *argv[]) {
                     st_errAbort("Error parsing minimumNumberOfSpecies parameter");
                 }
                 break;
+            case 'P':
+                i = sscanf(optarg, "%" PRIi64, &numWriteThreads);
+                if (i != 1 || numWriteThreads < 1) {
+                    st_errAbort("Error parsing numWriteThreads parameter");
+                }
+                break;
+            case 'Q':
+                sequenceStoreFile = stString_copy(optarg);
+                break;
+            case 'R':
+                i = sscanf(optarg, "%" PRIi64, &stringCacheSize);
+                if (i != 1 || stringCacheSize < 0) {
+                    st_errAbort("Error parsing stringCacheSize parameter");
+                }
+                break;
             default:
                 usage();
                 return 1;
@@ -278,6 +305,14 @@ int main(int argc, char *argv[]) {
      */
     stKVDatabaseConf *kvDatabaseConf = stKVDatabaseConf_constructFromString(cactusDiskDatabaseString);
     CactusDisk *cactusDisk = cactusDisk_construct(kvDatabaseConf, false, true); //We precache the sequences
+    cactusDisk_setOptionsFromConfString(cactusDisk, cactusDiskDatabaseString);
+    cactusDisk_setWriteThreads(cactusDisk, numWriteThreads);
+    if (sequenceStoreFile != NULL) {
+        cactusDisk_useSequenceStore(cactusDisk, sequenceStoreFile);
+    }
+    if (stringCacheSize >= 0) {
+        cactusDisk_setStringCacheSize(cactusDisk, stringCacheSize);
+    }
     st_logInfo("Set up the flower disk\n");
 
     /*
@@ -362,13 +397,13 @@ int main(int argc, char *argv[]) {
             fclose(coverageFile);
         }
 
-        stList *flowers = flowerWriter_parseFlowersFromStdin(cactusDisk);
-        if (listOfEndAlignmentFiles != NULL && stList_length(flowers) != 1) {
-            st_errAbort("We have precomputed alignments but %" PRIi64 " flowers to align.\n", stList_length(flowers));
+        // The flowers are left loaded, to be written back at the end.
+        FlowerStream *flowerStream = flowerWriter_getDecompressingFlowerStream(cactusDisk, stdin,
+                FLOWER_STREAM_DEFAULT_DECOMPRESSION_BATCHES, 0);
+        if (listOfEndAlignmentFiles != NULL && flowerStream_size(flowerStream) != 1) {
+            st_errAbort("We have precomputed alignments but %" PRIi64 " flowers to align.\n", flowerStream_size(flowerStream));
         }
-        cactusDisk_preCacheStrings(cactusDisk, flowers);
-        for (j = 0; j < stList_length(flowers); j++) {
-            flower = stList_get(flowers, j);
+        while ((flower = flowerStream_getNext(flowerStream)) != NULL) {
             st_logInfo("Processing a flower\n");
 
             stSortedSet *alignedPairs = makeFlowerAlignment3(sM, flower, listOfEndAlignmentFiles, spanningTrees, maximumLength,
@@ -420,12 +455,13 @@ int main(int argc, char *argv[]) {
 
             st_logInfo("Finished filling in the alignments for the flower\n");
         }
-        stList_destruct(flowers);
+        flowerStream_destruct(flowerStream);
         //st_errAbort("Done\n");
         /*
          * Write and close the cactusdisk.
          */
         cactusDisk_write(cactusDisk);
+        cactusDisk_logStringCacheStats(cactusDisk);
         return 0; //Exit without clean up is quicker, enable cleanup when doing memory leak detection.
         if (bedRegions != NULL) {
             // Clean up our mapping.
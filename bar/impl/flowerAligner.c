@@ -9,6 +9,7 @@
 #include "sonLib.h"
 #include "adjacencySequences.h"
 #include "pairwiseAligner.h"
+#include "flowerAlignerPrivate.h"
 
 stList *getInducedAlignment(stSortedSet *endAlignment, AdjacencySequence *adjacencySequence) {
     /*
@@ -174,30 +175,141 @@ static int64_t getCutOff(stList *inducedAlignment1, stList *inducedAlignment2, i
     return maxScore;
 }
 
-void updateDeletedPairs(int64_t subsequenceIdentifier, stHash *deletedAlignedPairCounts) {
+/*
+ * Indexed max-heap of the caps still to be pruned, keyed first on the number of aligned
+ * pairs deleted from the cap's adjacency sequence and then on the cap's position in the
+ * cut-off score ordering, later positions first. Popping the heap picks the same cap as
+ * scanning the score ordered list for the last cap with the greatest deleted pair count.
+ */
+
+typedef struct _capName {
+    int64_t name; //Subsequence identifier of the cap's adjacency sequence.
+    int64_t order; //Position of the cap in the cut-off score ordering.
+} CapName;
+
+struct _capHeap {
+    int64_t capNumber;
+    Cap **caps; //Indexed by order.
+    int64_t *deletedPairs; //Indexed by order.
+    int64_t *heapPositions; //Indexed by order, -1 once the cap has been popped.
+    int64_t *heap; //Orders of the caps in the heap.
+    int64_t heapLength;
+    CapName *names; //Sorted by name, for looking up caps from subsequence identifiers.
+};
+
+static int capName_cmpFn(const void *a, const void *b) {
+    int64_t i = ((const CapName *) a)->name, j = ((const CapName *) b)->name;
+    return i < j ? -1 : (i > j ? 1 : 0);
+}
+
+static bool capHeap_greaterThan(CapHeap *capHeap, int64_t order1, int64_t order2) {
+    int64_t i = capHeap->deletedPairs[order1], j = capHeap->deletedPairs[order2];
+    return i > j || (i == j && order1 > order2);
+}
+
+static void capHeap_swap(CapHeap *capHeap, int64_t i, int64_t j) {
+    int64_t k = capHeap->heap[i];
+    capHeap->heap[i] = capHeap->heap[j];
+    capHeap->heap[j] = k;
+    capHeap->heapPositions[capHeap->heap[i]] = i;
+    capHeap->heapPositions[capHeap->heap[j]] = j;
+}
+
+static void capHeap_siftUp(CapHeap *capHeap, int64_t i) {
+    while (i > 0 && capHeap_greaterThan(capHeap, capHeap->heap[i], capHeap->heap[(i - 1) / 2])) {
+        capHeap_swap(capHeap, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void capHeap_siftDown(CapHeap *capHeap, int64_t i) {
+    while (1) {
+        int64_t j = i, left = 2 * i + 1, right = 2 * i + 2;
+        if (left < capHeap->heapLength && capHeap_greaterThan(capHeap, capHeap->heap[left], capHeap->heap[j])) {
+            j = left;
+        }
+        if (right < capHeap->heapLength && capHeap_greaterThan(capHeap, capHeap->heap[right], capHeap->heap[j])) {
+            j = right;
+        }
+        if (j == i) {
+            return;
+        }
+        capHeap_swap(capHeap, i, j);
+        i = j;
+    }
+}
+
+CapHeap *capHeap_construct(stList *caps) {
+    /*
+     * Builds the heap from the caps, which must be sorted by cut-off score. All the counts start at zero,
+     * so the heap order is just the reverse of the list order.
+     */
+    CapHeap *capHeap = st_malloc(sizeof(CapHeap));
+    int64_t capNumber = stList_length(caps);
+    capHeap->capNumber = capNumber;
+    capHeap->caps = st_malloc(sizeof(Cap *) * (capNumber + 1));
+    capHeap->deletedPairs = st_calloc(capNumber + 1, sizeof(int64_t));
+    capHeap->heapPositions = st_malloc(sizeof(int64_t) * (capNumber + 1));
+    capHeap->heap = st_malloc(sizeof(int64_t) * (capNumber + 1));
+    capHeap->names = st_malloc(sizeof(CapName) * (capNumber + 1));
+    for (int64_t i = 0; i < capNumber; i++) {
+        Cap *cap = stList_get(caps, i);
+        assert(!cap_getSide(cap));
+        capHeap->caps[i] = cap;
+        capHeap->heap[i] = capNumber - 1 - i;
+        capHeap->heapPositions[capNumber - 1 - i] = i;
+        capHeap->names[i].name = cap_getName(cap_getStrand(cap) ? cap : cap_getAdjacency(cap));
+        capHeap->names[i].order = i;
+    }
+    capHeap->heapLength = capNumber;
+    qsort(capHeap->names, capNumber, sizeof(CapName), capName_cmpFn);
+    return capHeap;
+}
+
+void capHeap_destruct(CapHeap *capHeap) {
+    free(capHeap->caps);
+    free(capHeap->deletedPairs);
+    free(capHeap->heapPositions);
+    free(capHeap->heap);
+    free(capHeap->names);
+    free(capHeap);
+}
+
+Cap *capHeap_pop(CapHeap *capHeap) {
+    /*
+     * Removes and returns the cap with the greatest number of deleted aligned pairs, or NULL if the heap is empty.
+     */
+    if (capHeap->heapLength == 0) {
+        return NULL;
+    }
+    int64_t order = capHeap->heap[0];
+    capHeap_swap(capHeap, 0, --capHeap->heapLength);
+    capHeap->heapPositions[order] = -1;
+    capHeap_siftDown(capHeap, 0);
+    return capHeap->caps[order];
+}
+
+void capHeap_updateDeletedPairs(int64_t subsequenceIdentifier, CapHeap *capHeap) {
 	/*
-	 * Adds one to count for the given sequenceIdentifier;
+	 * Adds one to count for the given sequenceIdentifier, if it belongs to a cap still in the heap.
 	 */
-    stIntTuple *i = stIntTuple_construct1(subsequenceIdentifier);
-    int64_t *j = stHash_search(deletedAlignedPairCounts, i);
-    if(j == NULL) {
-        j = st_calloc(1, sizeof(int64_t));
-        stHash_insert(deletedAlignedPairCounts, i, j);
-    }
-    else {
-        stIntTuple_destruct(i);
+    CapName key;
+    key.name = subsequenceIdentifier;
+    CapName *capName = bsearch(&key, capHeap->names, capHeap->capNumber, sizeof(CapName), capName_cmpFn);
+    if (capName != NULL && capHeap->heapPositions[capName->order] != -1) {
+        capHeap->deletedPairs[capName->order]++;
+        capHeap_siftUp(capHeap, capHeap->heapPositions[capName->order]);
     }
-    (*j)++;
 }
 
 static void pruneAlignmentsP(stList *inducedAlignment, stSortedSet *endAlignment, int64_t start, int64_t end,
-        stSortedSet *pairsToDelete, stHash *deletedAlignedPairCounts) {
+        stSortedSet *pairsToDelete, CapHeap *capHeap) {
     for (int64_t i = start; i < end; i++) {
         AlignedPair *alignedPair = stList_get(inducedAlignment, i);
         if (stSortedSet_search(endAlignment, alignedPair) != NULL) { //can be missing if we are pruning the reverse strand alignment at the same time
             assert(stSortedSet_search(endAlignment, alignedPair->reverse) != NULL);
-            updateDeletedPairs(alignedPair->subsequenceIdentifier, deletedAlignedPairCounts);
-            updateDeletedPairs(alignedPair->reverse->subsequenceIdentifier, deletedAlignedPairCounts);
+            capHeap_updateDeletedPairs(alignedPair->subsequenceIdentifier, capHeap);
+            capHeap_updateDeletedPairs(alignedPair->reverse->subsequenceIdentifier, capHeap);
             stSortedSet_remove(endAlignment, alignedPair);
             stSortedSet_remove(endAlignment, alignedPair->reverse);
             if (stSortedSet_search(pairsToDelete, alignedPair) == NULL) { // &&
@@ -212,7 +324,7 @@ static void pruneAlignmentsP(stList *inducedAlignment, stSortedSet *endAlignment
 }
 
 static void pruneAlignments(Cap *cap, stList *inducedAlignment1, stList *inducedAlignment2, stSortedSet *endAlignment1,
-        stSortedSet *endAlignment2, void *deletedAlignedPairCounts) {
+        stSortedSet *endAlignment2, void *capHeap) {
     /*
      * Chooses a point along the adjacency sequence at which to filter the two alignments,
      * then filters the aligned pairs by this point.
@@ -221,8 +333,8 @@ static void pruneAlignments(Cap *cap, stList *inducedAlignment1, stList *induced
     getCutOff(inducedAlignment1, inducedAlignment2, &cutOff1, &cutOff2);
     stSortedSet *pairsToDelete = stSortedSet_construct2((void(*)(void *)) alignedPair_destruct);
     //Now do the actual filtering of the alignments.
-    pruneAlignmentsP(inducedAlignment1, endAlignment1, cutOff1, stList_length(inducedAlignment1), pairsToDelete, deletedAlignedPairCounts);
-    pruneAlignmentsP(inducedAlignment2, endAlignment2, 0, cutOff2, pairsToDelete, deletedAlignedPairCounts);
+    pruneAlignmentsP(inducedAlignment1, endAlignment1, cutOff1, stList_length(inducedAlignment1), pairsToDelete, capHeap);
+    pruneAlignmentsP(inducedAlignment2, endAlignment2, 0, cutOff2, pairsToDelete, capHeap);
     stSortedSet_destruct(pairsToDelete);
 }
 
@@ -274,7 +386,7 @@ static int64_t findFirstNonStubAlignment(Flower *flower, stList *inducedAlignmen
 }
 
 static void pruneStubAlignments(Cap *cap, stList *inducedAlignment1, stList *inducedAlignment2,
-        stSortedSet *endAlignment1, stSortedSet *endAlignment2, void *deletedAlignedPairCounts) {
+        stSortedSet *endAlignment1, stSortedSet *endAlignment2, void *capHeap) {
     assert(cap != NULL);
     End *end = cap_getEnd(cap);
     assert(cap_getAdjacency(cap) != NULL);
@@ -295,8 +407,8 @@ static void pruneStubAlignments(Cap *cap, stList *inducedAlignment1, stList *ind
     }
     stSortedSet *pairsToDelete = stSortedSet_construct2((void(*)(void *)) alignedPair_destruct);
     //Now do the actual filtering of the alignments.
-    pruneAlignmentsP(inducedAlignment1, endAlignment1, cutOff1 + 1, stList_length(inducedAlignment1), pairsToDelete, deletedAlignedPairCounts);
-    pruneAlignmentsP(inducedAlignment2, endAlignment2, 0, cutOff2, pairsToDelete, deletedAlignedPairCounts);
+    pruneAlignmentsP(inducedAlignment1, endAlignment1, cutOff1 + 1, stList_length(inducedAlignment1), pairsToDelete, capHeap);
+    pruneAlignmentsP(inducedAlignment2, endAlignment2, 0, cutOff2, pairsToDelete, capHeap);
     stSortedSet_destruct(pairsToDelete);
 }
 
@@ -368,47 +480,27 @@ static stSortedSet *makeFlowerAlignment2(Flower *flower, stHash *endAlignments,
     stList_sort2(caps, sortCapsFn, capScoresFnHash); //sorts the caps in ascending order according to their cut off score.
 
     //Now do the actual pruning
-    stHash *deletedAlignedPairCounts = stHash_construct3((uint64_t (*)(const void *))stIntTuple_hashKey,
-            (int (*)(const void *, const void *))stIntTuple_equalsFn, (void (*)(void *))stIntTuple_destruct, free);
+    CapHeap *capHeap = capHeap_construct(caps);
+    stList_destruct(caps);
+    stHash_destruct(capScoresFnHash);
     stList *freeStubCaps = stList_construct(); //Caps that we'll use when pruning the stub only ends of alignments.
-    while (stList_length(caps) > 0) {
-        //Pick cap with greatest number of deleted aligned pairs.
-        //This bias the bar algorithm to pick cutpoints that consistent
-        //with previously selected cutpoints.
-        Cap *cap = NULL;
-        int64_t deletedPairsForChosenCap = 0;
-        int64_t capIndex = INT64_MAX;
-        for(int64_t i=0; i<stList_length(caps); i++) {
-            Cap *cap2 = stList_get(caps, i);
-            assert(!cap_getSide(cap2));
-            stIntTuple *sequenceIdentifier = stIntTuple_construct1(cap_getName(cap_getStrand(cap2) ? cap2 : cap_getAdjacency(cap2)));
-            int64_t *deletedPairsCount = stHash_search(deletedAlignedPairCounts, sequenceIdentifier);
-            stIntTuple_destruct(sequenceIdentifier);
-            if(cap == NULL || deletedPairsForChosenCap == 0 || (deletedPairsCount != NULL && *deletedPairsCount >= deletedPairsForChosenCap)) {
-                cap = cap2;
-                capIndex = i;
-                if(deletedPairsCount != NULL) {
-                    deletedPairsForChosenCap = *deletedPairsCount;
-                }
-            }
-        }
-        //Having chosen the cap, remove it
-        assert(cap != NULL);
-        stList_remove(caps, capIndex);
+    Cap *cap;
+    //Pick cap with greatest number of deleted aligned pairs.
+    //This bias the bar algorithm to pick cutpoints that consistent
+    //with previously selected cutpoints.
+    while ((cap = capHeap_pop(capHeap)) != NULL) {
         //Do the filtering.
-        makeFlowerAlignmentP(cap, endAlignments, pruneAlignments, deletedAlignedPairCounts);
+        makeFlowerAlignmentP(cap, endAlignments, pruneAlignments, capHeap);
         assert(cap_getAdjacency(cap) != NULL);
         if ((end_isFree(cap_getEnd(cap)) && end_isStubEnd(cap_getEnd(cap))) || (end_isFree(
                 cap_getEnd(cap_getAdjacency(cap))) && end_isStubEnd(cap_getEnd(cap_getAdjacency(cap))))) {
             stList_append(freeStubCaps, cap);
         } 
     }
-    stList_destruct(caps);
-    stHash_destruct(capScoresFnHash);
 
     if (pruneOutStubAlignments) { //This is used to remove matches only containing stub sequences at end of an end alignment.
     	while (stList_length(freeStubCaps) > 0) {
-        	makeFlowerAlignmentP(stList_pop(freeStubCaps), endAlignments, pruneStubAlignments, deletedAlignedPairCounts);
+        	makeFlowerAlignmentP(stList_pop(freeStubCaps), endAlignments, pruneStubAlignments, capHeap);
         }
     }
     stList_destruct(freeStubCaps);
@@ -432,7 +524,7 @@ static stSortedSet *makeFlowerAlignment2(Flower *flower, stHash *endAlignments,
     }
     stList_destruct(endAlignmentsList);
     stHash_destruct(endAlignments);
-    stHash_destruct(deletedAlignedPairCounts);
+    capHeap_destruct(capHeap);
 
     return sortedAlignment;
 }
@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef FLOWER_ALIGNER_PRIVATE_H_
+#define FLOWER_ALIGNER_PRIVATE_H_
+
+#include "cactus.h"
+#include "sonLib.h"
+
+/*
+ * Indexed max-heap of the caps still to be pruned by the bar algorithm, keyed on the
+ * number of aligned pairs deleted from each cap's adjacency sequence.
+ */
+typedef struct _capHeap CapHeap;
+
+/*
+ * Builds the heap from the caps, which must be sorted by cut-off score and have their
+ * side false and strand true. All the deleted pair counts start at zero.
+ */
+CapHeap *capHeap_construct(stList *caps);
+
+void capHeap_destruct(CapHeap *capHeap);
+
+/*
+ * Removes and returns the cap with the greatest number of deleted aligned pairs, the
+ * latest in the cut-off score ordering among ties, or NULL if the heap is empty.
+ */
+Cap *capHeap_pop(CapHeap *capHeap);
+
+/*
+ * Adds one to the deleted pair count of the cap whose adjacency sequence has the given
+ * subsequence identifier, if that cap is still in the heap.
+ */
+void capHeap_updateDeletedPairs(int64_t subsequenceIdentifier, CapHeap *capHeap);
+
+#endif /* FLOWER_ALIGNER_PRIVATE_H_ */
@@ -9,6 +9,7 @@
 #include "endAligner.h"
 #include "adjacencySequences.h"
 #include "pairwiseAligner.h"
+#include "flowerAlignerPrivate.h"
 
 stList *getInducedAlignment(stSortedSet *endAlignment, AdjacencySequence *adjacencySequence);
 
@@ -126,9 +127,88 @@ void test_flowerAlignerRandom(CuTest *testCase) {
     teardown();
 }
 
+/*
+ * Gets the caps the bar algorithm prunes: one for each adjacency, on the positive strand
+ * with side false.
+ */
+static stList *getCapsToPrune(Flower *flower) {
+    stList *caps = stList_construct();
+    Flower_EndIterator *endIterator = flower_getEndIterator(flower);
+    End *end;
+    while ((end = flower_getNextEnd(endIterator)) != NULL) {
+        End_InstanceIterator *capIterator = end_getInstanceIterator(end);
+        Cap *cap;
+        while ((cap = end_getNext(capIterator)) != NULL) {
+            if (cap_getSide(cap)) {
+                cap = cap_getReverse(cap);
+            }
+            if (cap_getStrand(cap)) {
+                stList_append(caps, cap);
+            }
+        }
+        end_destructInstanceIterator(capIterator);
+    }
+    flower_destructEndIterator(endIterator);
+    return caps;
+}
+
+/*
+ * Checks the cap heap pops the same caps as scanning the list, in cut-off score order,
+ * for the last remaining cap with the greatest number of deleted pairs.
+ */
+void test_capHeap(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        setup();
+        int64_t extraAdjacencies = st_randomInt(0, 50);
+        for (int64_t i = 0; i < extraAdjacencies; i++) {
+            cap_makeAdjacent(cap_construct2(end1, 0, 1, sequence1), cap_construct2(end2, 5, 1, sequence1));
+        }
+        stList *caps = getCapsToPrune(flower);
+        stList_shuffle(caps); //Stands in for the cut-off score ordering.
+        int64_t capNumber = stList_length(caps);
+        int64_t *deletedPairs = st_calloc(capNumber + 1, sizeof(int64_t));
+        bool *popped = st_calloc(capNumber + 1, sizeof(bool));
+        CapHeap *capHeap = capHeap_construct(caps);
+
+        int64_t poppedNumber = 0;
+        while (poppedNumber < capNumber) {
+            if (st_random() > 0.3) {
+                //Update the count of a random cap, popped or not, or of a sequence with no cap.
+                int64_t i = st_randomInt(0, capNumber + 1);
+                if (i == capNumber) {
+                    capHeap_updateDeletedPairs(INT64_MAX, capHeap);
+                } else {
+                    capHeap_updateDeletedPairs(cap_getName(stList_get(caps, i)), capHeap);
+                    if (!popped[i]) {
+                        deletedPairs[i]++;
+                    }
+                }
+            } else {
+                int64_t j = -1;
+                for (int64_t i = 0; i < capNumber; i++) {
+                    if (!popped[i] && (j == -1 || deletedPairs[i] >= deletedPairs[j])) {
+                        j = i;
+                    }
+                }
+                CuAssertPtrEquals(testCase, stList_get(caps, j), capHeap_pop(capHeap));
+                popped[j] = 1;
+                poppedNumber++;
+            }
+        }
+        CuAssertPtrEquals(testCase, NULL, capHeap_pop(capHeap));
+
+        capHeap_destruct(capHeap);
+        free(deletedPairs);
+        free(popped);
+        stList_destruct(caps);
+        teardown();
+    }
+}
+
 CuSuite* flowerAlignerTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, test_getInducedAlignment);
     SUITE_ADD_TEST(suite, test_flowerAlignerRandom);
+    SUITE_ADD_TEST(suite, test_capHeap);
     return suite;
 }
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "sonLib.h"
+#include "stPinchGraphs.h"
+#include "stPinchIterator.h"
+#include "stCaf.h"
+
+/*
+ * Benchmarks annealing on a recorded trace of pinches, either a cigar alignment file, as written
+ * by lastz for cactus_caf, or a binary pinch file made from one with stPinchIterator_writeBinaryFile.
+ * Each thread is made just long enough to hold its pinches. The pinches are replayed into a fresh
+ * graph with stCaf_anneal and by looking up the threads of each pinch and pinching them one at a
+ * time, the graphs are checked to be identical and the time taken by each is reported.
+ */
+
+void usage() {
+    fprintf(stderr, "cactus_annealBenchmark, version 0.1\n");
+    fprintf(stderr, "-a --logLevel : Set the log level\n");
+    fprintf(stderr, "-b --alignments : A cigar alignment file to replay\n");
+    fprintf(stderr, "-c --binaryPinchFile : A binary pinch file to replay, instead of the alignments\n");
+    fprintf(stderr, "-i --iterations : Number of times to replay the pinches (default 3)\n");
+    fprintf(stderr, "-h --help : Print this help screen\n");
+}
+
+static double getSeconds(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1.0e9;
+}
+
+static void addToExtent(stHash *extents, int64_t name, int64_t start, int64_t end) {
+    stIntTuple *key = stIntTuple_construct1(name);
+    int64_t *extent = stHash_search(extents, key);
+    if (extent == NULL) {
+        extent = st_malloc(sizeof(int64_t) * 2);
+        extent[0] = start;
+        extent[1] = end;
+        stHash_insert(extents, key, extent);
+        return;
+    }
+    stIntTuple_destruct(key);
+    extent[0] = start < extent[0] ? start : extent[0];
+    extent[1] = end > extent[1] ? end : extent[1];
+}
+
+static stPinchThreadSet *getThreadSet(stHash *extents) {
+    /*
+     * Makes a thread spanning the extent of each name's pinches, with a base either side so the
+     * ends stay distinct when trivial boundaries are joined.
+     */
+    stPinchThreadSet *threadSet = stPinchThreadSet_construct();
+    stHashIterator *it = stHash_getIterator(extents);
+    stIntTuple *key;
+    while ((key = stHash_getNext(it)) != NULL) {
+        int64_t *extent = stHash_search(extents, key);
+        stPinchThreadSet_addThread(threadSet, stIntTuple_get(key, 0), extent[0] - 1, extent[1] - extent[0] + 3);
+    }
+    stHash_destructIterator(it);
+    return threadSet;
+}
+
+static void checkGraphsAreEqual(stPinchThreadSet *threadSet1, stPinchThreadSet *threadSet2) {
+    if (stPinchThreadSet_getTotalBlockNumber(threadSet1) != stPinchThreadSet_getTotalBlockNumber(threadSet2)) {
+        st_errAbort("The graphs have different numbers of blocks");
+    }
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet1);
+    stPinchThread *thread;
+    while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        stPinchSegment *segment1 = stPinchThread_getFirst(thread);
+        stPinchSegment *segment2 = stPinchThread_getFirst(stPinchThreadSet_getThread(threadSet2, stPinchThread_getName(thread)));
+        while (segment1 != NULL && segment2 != NULL) {
+            stPinchBlock *block1 = stPinchSegment_getBlock(segment1), *block2 = stPinchSegment_getBlock(segment2);
+            if (stPinchSegment_getStart(segment1) != stPinchSegment_getStart(segment2)
+                    || stPinchSegment_getLength(segment1) != stPinchSegment_getLength(segment2)
+                    || (block1 == NULL) != (block2 == NULL)
+                    || (block1 != NULL && (stPinchSegment_getBlockOrientation(segment1) != stPinchSegment_getBlockOrientation(segment2)
+                            || stPinchSegment_getName(stPinchBlock_getFirst(block1)) != stPinchSegment_getName(stPinchBlock_getFirst(block2))
+                            || stPinchSegment_getStart(stPinchBlock_getFirst(block1)) != stPinchSegment_getStart(stPinchBlock_getFirst(block2))))) {
+                st_errAbort("The graphs differ on thread %" PRIi64 " at %" PRIi64, stPinchThread_getName(thread),
+                        stPinchSegment_getStart(segment1));
+            }
+            segment1 = stPinchSegment_get3Prime(segment1);
+            segment2 = stPinchSegment_get3Prime(segment2);
+        }
+        if (segment1 != NULL || segment2 != NULL) {
+            st_errAbort("The graphs differ on thread %" PRIi64, stPinchThread_getName(thread));
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    char * logLevelString = NULL;
+    char * alignmentsFile = NULL;
+    char * binaryPinchFile = NULL;
+    int64_t iterations = 3;
+
+    while (1) {
+        static struct option long_options[] = { { "logLevel", required_argument, 0, 'a' },
+                { "alignments", required_argument, 0, 'b' }, { "binaryPinchFile", required_argument, 0, 'c' },
+                { "iterations", required_argument, 0, 'i' }, { "help", no_argument, 0, 'h' }, { 0, 0, 0, 0 } };
+
+        int option_index = 0;
+
+        int key = getopt_long(argc, argv, "a:b:c:i:h", long_options, &option_index);
+
+        if (key == -1) {
+            break;
+        }
+
+        switch (key) {
+            case 'a':
+                logLevelString = stString_copy(optarg);
+                break;
+            case 'b':
+                alignmentsFile = stString_copy(optarg);
+                break;
+            case 'c':
+                binaryPinchFile = stString_copy(optarg);
+                break;
+            case 'i':
+                sscanf(optarg, "%" PRIi64 "", &iterations);
+                break;
+            case 'h':
+                usage();
+                return 0;
+            default:
+                usage();
+                return 1;
+        }
+    }
+
+    if ((alignmentsFile == NULL) == (binaryPinchFile == NULL) || iterations < 1) {
+        usage();
+        return 1;
+    }
+
+    st_setLogLevelFromString(logLevelString);
+
+    //////////////////////////////////////////////
+    //Read the trace, and the extent of each thread in it
+    //////////////////////////////////////////////
+
+    stPinchIterator *pinchIterator = binaryPinchFile != NULL ? stPinchIterator_constructFromBinaryFile(binaryPinchFile)
+            : stPinchIterator_constructFromFile(alignmentsFile);
+    stHash *extents = stHash_construct3((uint64_t (*)(const void *)) stIntTuple_hashKey,
+            (int (*)(const void *, const void *)) stIntTuple_equalsFn, (void (*)(void *)) stIntTuple_destruct, free);
+    int64_t pinchNumber = 0, alignedBases = 0;
+    stPinch *pinch;
+    while ((pinch = stPinchIterator_getNext(pinchIterator)) != NULL) {
+        addToExtent(extents, pinch->name1, pinch->start1, pinch->start1 + pinch->length - 1);
+        addToExtent(extents, pinch->name2, pinch->start2, pinch->start2 + pinch->length - 1);
+        pinchNumber++;
+        alignedBases += pinch->length;
+    }
+    st_logInfo("Read %" PRIi64 " pinches on %" PRIi64 " threads\n", pinchNumber, stHash_size(extents));
+
+    //////////////////////////////////////////////
+    //Replay the trace each way
+    //////////////////////////////////////////////
+
+    double annealTime = 0.0, pinchTime = 0.0;
+    int64_t blockNumber = 0;
+    for (int64_t i = 0; i < iterations; i++) {
+        stPinchThreadSet *annealedThreadSet = getThreadSet(extents);
+        double startTime = getSeconds();
+        stCaf_anneal(annealedThreadSet, pinchIterator, NULL);
+        annealTime += getSeconds() - startTime;
+
+        stPinchThreadSet *pinchedThreadSet = getThreadSet(extents);
+        stPinchIterator_reset(pinchIterator);
+        startTime = getSeconds();
+        while ((pinch = stPinchIterator_getNext(pinchIterator)) != NULL) {
+            stPinchThread_pinch(stPinchThreadSet_getThread(pinchedThreadSet, pinch->name1),
+                    stPinchThreadSet_getThread(pinchedThreadSet, pinch->name2), pinch->start1, pinch->start2,
+                    pinch->length, pinch->strand);
+        }
+        stCaf_joinTrivialBoundaries(pinchedThreadSet);
+        pinchTime += getSeconds() - startTime;
+
+        checkGraphsAreEqual(annealedThreadSet, pinchedThreadSet);
+        blockNumber = stPinchThreadSet_getTotalBlockNumber(annealedThreadSet);
+        stPinchThreadSet_destruct(annealedThreadSet);
+        stPinchThreadSet_destruct(pinchedThreadSet);
+    }
+
+    fprintf(stdout, "Pinches: %" PRIi64 ", aligned bases: %" PRIi64 ", threads: %" PRIi64 ", blocks: %" PRIi64 "\n",
+            pinchNumber, alignedBases, stHash_size(extents), blockNumber);
+    fprintf(stdout, "%-10s %12s %14s %10s\n", "method", "seconds", "pinches/s", "speedup");
+    fprintf(stdout, "%-10s %12.3f %14.0f %10.2f\n", "pinch", pinchTime / iterations,
+            pinchTime > 0.0 ? pinchNumber * iterations / pinchTime : 0.0, 1.0);
+    fprintf(stdout, "%-10s %12.3f %14.0f %10.2f\n", "anneal", annealTime / iterations,
+            annealTime > 0.0 ? pinchNumber * iterations / annealTime : 0.0, annealTime > 0.0 ? pinchTime / annealTime : 0.0);
+
+    stPinchIterator_destruct(pinchIterator);
+    stHash_destruct(extents);
+    free(alignmentsFile);
+    free(binaryPinchFile);
+    free(logLevelString);
+
+    return 0;
+}
@@ -93,6 +93,11 @@ static void usage() {
     fprintf(stderr, "-T --minimumBlockHomologySupport: Minimum fraction of possible homologies required not to be considered a transitively collapsed megablock.\n");
     fprintf(stderr, "-U --phylogenyNucleotideScalingFactor: Weighting for the nucleotide information in the distance matrix used to build each tree.\n");
     fprintf(stderr, "-V --minimumBlockDegreeToCheckSupport: Minimum degree required to be checked for being a megablock.\n");
+    fprintf(stderr, "-4 --numWriteThreads : Number of threads used to serialise and compress flowers when writing the cactus disk. Default 1.\n");
+    fprintf(stderr, "-5 --sequenceStore : Read-only sequence store file (see cactus_exportSequences) to read the sequences from, rather than the database.\n");
+    fprintf(stderr, "-6 --stringCacheSize : Maximum number of bytes of sequence to cache in memory. Default 100000000.\n");
+    fprintf(stderr, "-7 --numAnnealingThreads : Number of threads used to anneal alignments between disjoint sets of sequences when no alignment filter is in use. Default 1.\n");
+    fprintf(stderr, "-8 --numBlockScanThreads : Number of threads used to check blocks for megablocks and against the block filter. Default 1.\n");
 }
 
 static int64_t *getInts(const char *string, int64_t *arrayLength) {
@@ -142,21 +147,7 @@ void stCaf_printBlock(stPinchBlock *block) {
 
 
 static uint64_t choose2(uint64_t n) {
-#define CHOOSE_TWO_CACHE_LEN 256
-    // This is filled with 0's at init time by the compiler.
-    static int64_t chooseTwoCache[256];
-    if (n <= 1) {
-        return 0;
-    } else if (n >= CHOOSE_TWO_CACHE_LEN) {
-        return n * (n - 1) / 2;
-    } else {
-        if (chooseTwoCache[n] != 0) {
-            return chooseTwoCache[n];
-        } else {
-            chooseTwoCache[n] = n * (n - 1) / 2;
-            return chooseTwoCache[n];
-        }
-    }
+    return n <= 1 ? 0 : n * (n - 1) / 2;
 }
 
 // Get the number of possible pairwise alignments that could support
@@ -183,6 +174,22 @@ static uint64_t numPossibleSupportingHomologies(stPinchBlock *block, Flower *flo
     return choose2(ingroupDegree) * 2 + ingroupDegree * outgroupDegree;
 }
 
+typedef struct _megablockCheck {
+    Flower *flower;
+    int64_t minimumBlockDegreeToCheckSupport;
+    double minimumBlockHomologySupport;
+    uint64_t *possibleSupportingHomologies; // For each block, or 0 if its degree is too low to be checked.
+    bool *megablocks;
+} MegablockCheck;
+
+static void checkForMegablock(stPinchBlock *block, int64_t index, MegablockCheck *check) {
+    if (stPinchBlock_getDegree(block) > check->minimumBlockDegreeToCheckSupport) {
+        check->possibleSupportingHomologies[index] = numPossibleSupportingHomologies(block, check->flower);
+        check->megablocks[index] = ((double) stPinchBlock_getNumSupportingHomologies(block))
+                / check->possibleSupportingHomologies[index] < check->minimumBlockHomologySupport;
+    }
+}
+
 static void dumpBlockInfo(stPinchThreadSet *threadSet, const char *fileName) {
     stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
     FILE *file = fopen(fileName, "w");
@@ -275,6 +282,25 @@ static void printThreadSetStatistics(stPinchThreadSet *threadSet, Flower *flower
     free(blockSupports);
 }
 
+/*
+ * Converts a cigar file once into a binary pinch file, so that the annealing rounds
+ * don't reparse the text each time, and returns an iterator over it. If sortAlignments
+ * is set the alignments are sorted by descending score on the way. The temporary
+ * file name is appended to binaryPinchFiles for later removal.
+ */
+static stPinchIterator *getBinaryPinchIterator(const char *alignmentFile, bool sortAlignments, stList *binaryPinchFiles) {
+    char *binaryFile = getTempFile();
+    stList_append(binaryPinchFiles, binaryFile);
+    if (sortAlignments) {
+        stCaf_sortCigarsFile(alignmentFile, binaryFile, 1, 0, 0);
+        st_logInfo("Sorted %s into a binary pinch file\n", alignmentFile);
+    } else {
+        int64_t pinchNumber = stPinchIterator_writeBinaryFile(alignmentFile, binaryFile);
+        st_logInfo("Converted %" PRIi64 " pinches from %s into a binary pinch file\n", pinchNumber, alignmentFile);
+    }
+    return stPinchIterator_constructFromBinaryFile(binaryFile);
+}
+
 int main(int argc, char *argv[]) {
     /*
      * Script for adding alignments to cactus tree.
@@ -349,6 +375,11 @@ int main(int argc, char *argv[]) {
     enum stCaf_DistanceCorrectionMethod phylogenyDistanceCorrectionMethod = JUKES_CANTOR;
     bool sortAlignments = false;
     char *hgvmEventName = NULL;
+    int64_t numWriteThreads = 1;
+    char *sequenceStoreFile = NULL;
+    int64_t stringCacheSize = -1;
+    int64_t numAnnealingThreads = 1;
+    int64_t numBlockScanThreads = 1;
 
     ///////////////////////////////////////////////////////////////////////////
     // (0) Parse the inputs handed by genomeCactus.py / setup stuff.
@@ -404,6 +435,11 @@ int main(int argc, char *argv[]) {
 				{ "maxRecoverableChainsIterations", required_argument, 0, '1' },
 				{ "maxRecoverableChainLength", required_argument, 0, '2' },
 				{ "secondaryAlignments", required_argument, 0, '3' },
+				{ "numWriteThreads", required_argument, 0, '4' },
+				{ "sequenceStore", required_argument, 0, '5' },
+				{ "stringCacheSize", required_argument, 0, '6' },
+				{ "numAnnealingThreads", required_argument, 0, '7' },
+				{ "numBlockScanThreads", required_argument, 0, '8' },
 				{ 0, 0, 0, 0 } };
 
         int option_index = 0;
@@ -697,6 +733,34 @@ int main(int argc, char *argv[]) {
             case '3':
                 secondaryAlignmentsFile = stString_copy(optarg);
                 break;
+            case '4':
+                k = sscanf(optarg, "%" PRIi64, &numWriteThreads);
+                if (k != 1 || numWriteThreads < 1) {
+                    st_errAbort("Error parsing the numWriteThreads argument");
+                }
+                break;
+            case '5':
+                sequenceStoreFile = stString_copy(optarg);
+                break;
+            case '6':
+                k = sscanf(optarg, "%" PRIi64, &stringCacheSize);
+                if (k != 1 || stringCacheSize < 0) {
+                    st_errAbort("Error parsing the stringCacheSize argument");
+                }
+                break;
+            case '7':
+                k = sscanf(optarg, "%" PRIi64, &numAnnealingThreads);
+                if (k != 1 || numAnnealingThreads < 1) {
+                    st_errAbort("Error parsing the numAnnealingThreads argument");
+                }
+                break;
+            case '8':
+                k = sscanf(optarg, "%" PRIi64, &numBlockScanThreads);
+                if (k != 1 || numBlockScanThreads < 1) {
+                    st_errAbort("Error parsing the numBlockScanThreads argument");
+                }
+                stCaf_setNumBlockScanThreads(numBlockScanThreads);
+                break;
             default:
                 usage();
                 return 1;
@@ -745,6 +809,14 @@ int main(int argc, char *argv[]) {
 
     kvDatabaseConf = stKVDatabaseConf_constructFromString(cactusDiskDatabaseString);
     cactusDisk = cactusDisk_construct(kvDatabaseConf, false, true);
+    cactusDisk_setOptionsFromConfString(cactusDisk, cactusDiskDatabaseString);
+    cactusDisk_setWriteThreads(cactusDisk, numWriteThreads);
+    if (sequenceStoreFile != NULL) {
+        cactusDisk_useSequenceStore(cactusDisk, sequenceStoreFile);
+    }
+    if (stringCacheSize >= 0) {
+        cactusDisk_setStringCacheSize(cactusDisk, stringCacheSize);
+    }
     st_logInfo("Set up the flower disk\n");
 
     ///////////////////////////////////////////////////////////////////////////
@@ -752,8 +824,9 @@ int main(int argc, char *argv[]) {
     ///////////////////////////////////////////////////////////////////////////
 
     stPinchIterator *pinchIteratorForConstraints = NULL;
+    stList *binaryPinchFiles = stList_construct();
     if (constraintsFile != NULL) {
-        pinchIteratorForConstraints = stPinchIterator_constructFromFile(constraintsFile);
+        pinchIteratorForConstraints = getBinaryPinchIterator(constraintsFile, 0, binaryPinchFiles);
         st_logInfo("Created an iterator for the alignment constaints from file: %s\n", constraintsFile);
     }
 
@@ -788,21 +861,14 @@ int main(int argc, char *argv[]) {
             //Setup the alignments
             stPinchIterator *pinchIterator;
             stPinchIterator *secondaryPinchIterator = NULL;
-            stList *alignmentsList = NULL;
             if (alignmentsFile != NULL) {
                 assert(i == 0);
                 assert(stList_length(flowers) == 1);
 
-                if (sortAlignments) {
-                    tempFile1 = getTempFile();
-                    stCaf_sortCigarsFileByScoreInDescendingOrder(alignmentsFile, tempFile1);
-                    pinchIterator = stPinchIterator_constructFromFile(tempFile1);
-                } else {
-                    pinchIterator = stPinchIterator_constructFromFile(alignmentsFile);
-                }
+                pinchIterator = getBinaryPinchIterator(alignmentsFile, sortAlignments, binaryPinchFiles);
 
                 if(secondaryAlignmentsFile != NULL) {
-                	secondaryPinchIterator = stPinchIterator_constructFromFile(secondaryAlignmentsFile);
+                	secondaryPinchIterator = getBinaryPinchIterator(secondaryAlignmentsFile, 0, binaryPinchFiles);
                 }
 
             } else {
@@ -812,12 +878,12 @@ int main(int argc, char *argv[]) {
                 if (tempFile1 == NULL) {
                     tempFile1 = getTempFile();
                 }
-                alignmentsList = stCaf_selfAlignFlower(flower, minimumSequenceLengthForBlast, lastzArguments, realign, realignArguments, tempFile1);
-                if (sortAlignments) {
-                    stCaf_sortCigarsByScoreInDescendingOrder(alignmentsList);
-                }
-                st_logDebug("Ran lastz and have %" PRIi64 " alignments\n", stList_length(alignmentsList));
-                pinchIterator = stPinchIterator_constructFromList(alignmentsList);
+                char *binaryFile = getTempFile();
+                stList_append(binaryPinchFiles, binaryFile);
+                int64_t alignmentNumber = stCaf_selfAlignFlowerToBinaryPinchFile(flower, minimumSequenceLengthForBlast, lastzArguments,
+                        realign, realignArguments, tempFile1, binaryFile, sortAlignments, 0, 0);
+                st_logDebug("Ran lastz and have %" PRIi64 " alignments\n", alignmentNumber);
+                pinchIterator = stPinchIterator_constructFromBinaryFile(binaryFile);
             }
 
             for (int64_t annealingRound = 0; annealingRound < annealingRoundsLength; annealingRound++) {
@@ -832,12 +898,12 @@ int main(int argc, char *argv[]) {
 
                 //Add back in the constraints
                 if (pinchIteratorForConstraints != NULL) {
-                    stCaf_anneal(threadSet, pinchIteratorForConstraints, NULL);
+                    stCaf_annealInParallel(threadSet, pinchIteratorForConstraints, NULL, numAnnealingThreads);
                 }
 
                 //Do the annealing
                 if (annealingRound == 0) {
-                    stCaf_anneal(threadSet, pinchIterator, filterFn);
+                    stCaf_annealInParallel(threadSet, pinchIterator, filterFn, numAnnealingThreads);
                 } else {
                     stCaf_annealBetweenAdjacencyComponents(threadSet, pinchIterator, filterFn);
                 }
@@ -845,7 +911,7 @@ int main(int argc, char *argv[]) {
                 // Do the secondary annealing
                 if(secondaryPinchIterator != NULL) {
 					if (annealingRound == 0) {
-						stCaf_anneal(threadSet, secondaryPinchIterator, secondaryFilterFn);
+						stCaf_annealInParallel(threadSet, secondaryPinchIterator, secondaryFilterFn, numAnnealingThreads);
 					} else {
 						stCaf_annealBetweenAdjacencyComponents(threadSet, secondaryPinchIterator, secondaryFilterFn);
 					}
@@ -865,32 +931,37 @@ int main(int argc, char *argv[]) {
                 // alignment. These "megablocks" can snarl up the
                 // graph so that a lot of extra gets thrown away in
                 // the first melting step.
-                stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
-                stPinchBlock *block;
-                while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
-                    if (stPinchBlock_getDegree(block) > minimumBlockDegreeToCheckSupport) {
+                // The support is computed for all the blocks in
+                // parallel, then the megablocks are destroyed serially.
+                stList *blocks = stCaf_getBlocks(threadSet);
+                MegablockCheck megablockCheck = { flower, minimumBlockDegreeToCheckSupport, minimumBlockHomologySupport,
+                        st_calloc(stList_length(blocks) + 1, sizeof(uint64_t)), st_calloc(stList_length(blocks) + 1, sizeof(bool)) };
+                stCaf_mapBlocks(blocks, (void (*)(stPinchBlock *, int64_t, void *)) checkForMegablock, &megablockCheck,
+                        numBlockScanThreads);
+                for (int64_t i = 0; i < stList_length(blocks); i++) {
+                    if (megablockCheck.megablocks[i]) {
+                        stPinchBlock *block = stList_get(blocks, i);
                         uint64_t supportingHomologies = stPinchBlock_getNumSupportingHomologies(block);
-                        uint64_t possibleSupportingHomologies = numPossibleSupportingHomologies(block, flower);
+                        uint64_t possibleSupportingHomologies = megablockCheck.possibleSupportingHomologies[i];
                         double support = ((double) supportingHomologies) / possibleSupportingHomologies;
-                        if (support < minimumBlockHomologySupport) {
-                            fprintf(stdout, "Destroyed a megablock with degree %" PRIi64
-                                    " and %" PRIi64 " supporting homologies out of a maximum "
-                                    "of %" PRIi64 " (%lf%%).\n", stPinchBlock_getDegree(block),
-                                    supportingHomologies, possibleSupportingHomologies, support);
-                            stPinchBlock_destruct(block);
-                        }
+                        fprintf(stdout, "Destroyed a megablock with degree %" PRIi64
+                                " and %" PRIi64 " supporting homologies out of a maximum "
+                                "of %" PRIi64 " (%lf%%).\n", stPinchBlock_getDegree(block),
+                                supportingHomologies, possibleSupportingHomologies, support);
+                        stPinchBlock_destruct(block);
                     }
                 }
+                free(megablockCheck.possibleSupportingHomologies);
+                free(megablockCheck.megablocks);
+                stList_destruct(blocks);
 
                 //Do the melting rounds
-                for (int64_t meltingRound = 0; meltingRound < meltingRoundsLength; meltingRound++) {
-                    int64_t minimumChainLengthForMeltingRound = meltingRounds[meltingRound];
-                    st_logDebug("Starting melting round with a minimum chain length of %" PRIi64 " \n", minimumChainLengthForMeltingRound);
-                    if (minimumChainLengthForMeltingRound >= minimumChainLength) {
-                        break;
-                    }
-                    stCaf_melt(flower, threadSet, NULL, 0, minimumChainLengthForMeltingRound, 0, INT64_MAX);
-                } st_logDebug("Last melting round of cycle with a minimum chain length of %" PRIi64 " \n", minimumChainLength);
+                int64_t meltingRoundNumber = 0;
+                while (meltingRoundNumber < meltingRoundsLength && meltingRounds[meltingRoundNumber] < minimumChainLength) {
+                    meltingRoundNumber++;
+                }
+                stCaf_meltInRounds(flower, threadSet, meltingRounds, meltingRoundNumber);
+                st_logDebug("Last melting round of cycle with a minimum chain length of %" PRIi64 " \n", minimumChainLength);
                 stCaf_melt(flower, threadSet, NULL, 0, minimumChainLength, breakChainsAtReverseTandems, maximumMedianSequenceLengthBetweenLinkedEnds);
                 //This does the filtering of blocks that do not have the required species/tree-coverage/degree.
                 stCaf_melt(flower, threadSet, blockFilterFn, blockTrim, 0, 0, INT64_MAX);
@@ -973,13 +1044,10 @@ int main(int argc, char *argv[]) {
             stPinchThreadSet_destruct(threadSet);
             stPinchIterator_destruct(pinchIterator);
             if(secondaryPinchIterator != NULL) {
-            	free(secondaryPinchIterator);
+            	stPinchIterator_destruct(secondaryPinchIterator);
             }
             stSet_destruct(outgroupThreads);
 
-            if (alignmentsList != NULL) {
-                stList_destruct(alignmentsList);
-            }
             st_logInfo("Cleaned up from main loop\n");
         } else {
             st_logInfo("We've already built blocks / alignments for this flower\n");
@@ -993,6 +1061,10 @@ int main(int argc, char *argv[]) {
     if (constraintsFile != NULL) {
         stPinchIterator_destruct(pinchIteratorForConstraints);
     }
+    for (int64_t i = 0; i < stList_length(binaryPinchFiles); i++) {
+        stFile_rmrf(stList_get(binaryPinchFiles, i));
+    }
+    stList_destruct(binaryPinchFiles);
 
     ///////////////////////////////////////////////////////////////////////////
     // Write the flower to disk.
@@ -1000,6 +1072,7 @@ int main(int argc, char *argv[]) {
     st_logDebug("Writing the flowers to disk\n");
     cactusDisk_write(cactusDisk);
     st_logInfo("Updated the flower on disk and %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+    cactusDisk_logStringCacheStats(cactusDisk);
 
     ///////////////////////////////////////////////////////////////////////////
     // Clean up.
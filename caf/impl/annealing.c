@@ -1,3 +1,5 @@
+#include <pthread.h>
+#include <string.h>
 #include "sonLib.h"
 #include "cactus.h"
 #include "stPinchGraphs.h"
@@ -32,17 +34,31 @@ void stCaf_joinTrivialBoundaries(stPinchThreadSet *threadSet) {
 // Basic annealing function
 ///////////////////////////////////////////////////////////////////////////
 
+static stPinchThread *getThread(stPinchThreadSet *threadSet, int64_t name, stPinchThread **lastThread) {
+    /*
+     * Gets the named thread, reusing the thread last looked up with the same lastThread if it has the name.
+     * Consecutive pinches mostly come from the same alignment, so most lookups are saved.
+     */
+    if (*lastThread == NULL || stPinchThread_getName(*lastThread) != name) {
+        *lastThread = stPinchThreadSet_getThread(threadSet, name);
+        assert(*lastThread != NULL);
+    }
+    return *lastThread;
+}
+
 void stCaf_anneal2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *), void *extraArg) {
+    //The pinches are applied in order, as the orientation and first segment of each block depend on it
+    stPinchThread *thread1 = NULL, *thread2 = NULL;
     stPinch *pinch;
     while ((pinch = pinchIterator(extraArg)) != NULL) {
-        stPinchThread *thread1 = stPinchThreadSet_getThread(threadSet, pinch->name1);
-        stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet, pinch->name2);
-        assert(thread1 != NULL && thread2 != NULL);
-        stPinchThread_pinch(thread1, thread2, pinch->start1, pinch->start2, pinch->length, pinch->strand);
+        stPinchThread_pinch(getThread(threadSet, pinch->name1, &thread1), getThread(threadSet, pinch->name2, &thread2),
+                pinch->start1, pinch->start2, pinch->length, pinch->strand);
     }
 }
 
 static void stCaf_annealWithFilter2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *), void *extraArg, bool (*filterFn)(stPinchSegment *, stPinchSegment *)) {
+    //The filters may cache block summaries, which are only valid while blocks are not destroyed
+    stCaf_clearAlignmentFilteringCache();
     stPinch *pinch;
     while ((pinch = pinchIterator(extraArg)) != NULL) {
         stPinchThread *thread1 = stPinchThreadSet_getThread(threadSet, pinch->name1);
@@ -50,6 +66,7 @@ static void stCaf_annealWithFilter2(stPinchThreadSet *threadSet, stPinch *(*pinc
         assert(thread1 != NULL && thread2 != NULL);
         stPinchThread_filterPinch(thread1, thread2, pinch->start1, pinch->start2, pinch->length, pinch->strand, filterFn);
     }
+    stCaf_clearAlignmentFilteringCache();
 }
 
 void stCaf_anneal(stPinchThreadSet *threadSet, stPinchIterator *pinchIterator, bool (*filterFn)(stPinchSegment *, stPinchSegment *)) {
@@ -63,111 +80,462 @@ void stCaf_anneal(stPinchThreadSet *threadSet, stPinchIterator *pinchIterator, b
     stCaf_joinTrivialBoundaries(threadSet);
 }
 
+///////////////////////////////////////////////////////////////////////////
+// Parallel annealing. Pinches between disjoint sets of threads commute, so the
+// pinches are partitioned by the connected components of the graph on threads
+// linked by the pinches and by the existing blocks, and each partition is
+// annealed by a worker. The pinches of each partition are applied in their
+// original order, and pinches in other partitions touch none of its blocks, so
+// the output is exactly the same as annealing serially. The pinches are read in
+// chunks of at most chunkSize, each chunk being annealed before the next is
+// read, so memory is bounded whatever the number of alignments. The components
+// only ever merge, so those found for earlier chunks remain valid for later ones.
+//
+// Pinching concurrently is safe because stPinchThread_pinch only reads and
+// writes the segments and blocks of the two threads it is given, and of the
+// threads sharing blocks with them, which are all in the same partition. It
+// allocates and frees with malloc and free, which are thread safe, and doesn't
+// touch the thread set itself, whose thread table is only read, by the calling
+// thread, while the pinches are being bucketed.
+///////////////////////////////////////////////////////////////////////////
+
+#define ANNEAL_IN_PARALLEL_CHUNK_SIZE 10000000
+
+typedef struct _threadPinch {
+    stPinchThread *thread1, *thread2;
+    int64_t start1, start2, length;
+    bool strand;
+} ThreadPinch;
+
+typedef struct _pinchPartition {
+    ThreadPinch *pinches;
+    int64_t length;
+} PinchPartition;
+
+typedef struct _partitionQueue {
+    stList *partitions;
+    int64_t nextPartition;
+    pthread_mutex_t mutex;
+} PartitionQueue;
+
+static int64_t findComponent(int64_t *parents, int64_t i) {
+    while (parents[i] != i) {
+        parents[i] = parents[parents[i]];
+        i = parents[i];
+    }
+    return i;
+}
+
+static void mergeComponents(int64_t *parents, int64_t i, int64_t j) {
+    i = findComponent(parents, i);
+    j = findComponent(parents, j);
+    if (i != j) {
+        parents[i > j ? i : j] = i > j ? j : i;
+    }
+}
+
+static int64_t getIndex(stHash *indices, void *object) {
+    stIntTuple *index = stHash_search(indices, object);
+    assert(index != NULL);
+    return stIntTuple_get(index, 0);
+}
+
+static int partitionCmp(const PinchPartition *partition1, const PinchPartition *partition2) {
+    return partition1->length > partition2->length ? -1 : (partition1->length < partition2->length ? 1 : 0);
+}
+
+static void annealPartition(PinchPartition *partition) {
+    for (int64_t i = 0; i < partition->length; i++) {
+        ThreadPinch *pinch = &partition->pinches[i];
+        stPinchThread_pinch(pinch->thread1, pinch->thread2, pinch->start1, pinch->start2, pinch->length, pinch->strand);
+    }
+}
+
+static void *annealPartitions(PartitionQueue *queue) {
+    while (1) {
+        pthread_mutex_lock(&queue->mutex);
+        PinchPartition *partition = queue->nextPartition < stList_length(queue->partitions) ?
+                stList_get(queue->partitions, queue->nextPartition++) : NULL;
+        pthread_mutex_unlock(&queue->mutex);
+        if (partition == NULL) {
+            return NULL;
+        }
+        annealPartition(partition);
+    }
+}
+
+static void annealChunk(ThreadPinch *pinches, int64_t *pinchComponents, int64_t pinchNumber, int64_t *parents,
+        int64_t threadCount, int64_t threadNumber) {
+    /*
+     * Anneals a chunk of pinches, a worker at a time for each component of the threads they link.
+     */
+    //Bucket the pinches by component, keeping their order within each component
+    int64_t *componentOffsets = st_calloc(threadCount + 1, sizeof(int64_t));
+    for (int64_t i = 0; i < pinchNumber; i++) {
+        pinchComponents[i] = findComponent(parents, pinchComponents[i]);
+        componentOffsets[pinchComponents[i] + 1]++;
+    }
+    stList *partitions = stList_construct3(0, free);
+    for (int64_t i = 0; i < threadCount; i++) {
+        if (componentOffsets[i + 1] > 0) {
+            PinchPartition *partition = st_malloc(sizeof(PinchPartition));
+            partition->length = componentOffsets[i + 1];
+            stList_append(partitions, partition);
+        }
+        componentOffsets[i + 1] += componentOffsets[i];
+    }
+    ThreadPinch *partitionedPinches = st_malloc(sizeof(ThreadPinch) * (pinchNumber + 1));
+    int64_t *componentPositions = st_malloc(sizeof(int64_t) * (threadCount + 1));
+    memcpy(componentPositions, componentOffsets, sizeof(int64_t) * (threadCount + 1));
+    for (int64_t i = 0; i < pinchNumber; i++) {
+        partitionedPinches[componentPositions[pinchComponents[i]]++] = pinches[i];
+    }
+    for (int64_t i = 0, j = 0; i < threadCount; i++) {
+        if (componentOffsets[i + 1] > componentOffsets[i]) {
+            ((PinchPartition *) stList_get(partitions, j++))->pinches = partitionedPinches + componentOffsets[i];
+        }
+    }
+    free(componentOffsets);
+    free(componentPositions);
+
+    //Largest partitions first, so that the workers finish together
+    stList_sort(partitions, (int (*)(const void *, const void *)) partitionCmp);
+    st_logDebug("Annealing %" PRIi64 " pinches in %" PRIi64 " partitions, the largest with %" PRIi64 " pinches, using %" PRIi64 " threads\n",
+            pinchNumber, stList_length(partitions),
+            stList_length(partitions) > 0 ? ((PinchPartition *) stList_get(partitions, 0))->length : 0, threadNumber);
+    if (stList_length(partitions) <= 1) {
+        for (int64_t i = 0; i < stList_length(partitions); i++) {
+            annealPartition(stList_get(partitions, i));
+        }
+    } else {
+        PartitionQueue queue;
+        queue.partitions = partitions;
+        queue.nextPartition = 0;
+        pthread_mutex_init(&queue.mutex, NULL);
+        int64_t workerNumber = threadNumber < stList_length(partitions) ? threadNumber : stList_length(partitions);
+        pthread_t *workers = st_malloc(sizeof(pthread_t) * workerNumber);
+        for (int64_t i = 1; i < workerNumber; i++) {
+            if (pthread_create(&workers[i], NULL, (void *(*)(void *)) annealPartitions, &queue) != 0) {
+                st_errAbort("Could not create an annealing thread");
+            }
+        }
+        annealPartitions(&queue);
+        for (int64_t i = 1; i < workerNumber; i++) {
+            pthread_join(workers[i], NULL);
+        }
+        free(workers);
+        pthread_mutex_destroy(&queue.mutex);
+    }
+    stList_destruct(partitions);
+    free(partitionedPinches);
+}
+
+void stCaf_annealInParallel2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *), void *extraArg,
+        int64_t threadNumber, int64_t chunkSize) {
+    assert(chunkSize > 0);
+    if (threadNumber <= 1) {
+        stCaf_anneal2(threadSet, pinchIterator, extraArg);
+        return;
+    }
+    //Index the threads
+    stHash *threadIndices = stHash_construct2(NULL, (void (*)(void *)) stIntTuple_destruct);
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet);
+    stPinchThread *thread;
+    while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        stHash_insert(threadIndices, thread, stIntTuple_construct1(stHash_size(threadIndices)));
+    }
+    int64_t threadCount = stHash_size(threadIndices);
+    int64_t *parents = st_malloc(sizeof(int64_t) * (threadCount + 1));
+    for (int64_t i = 0; i < threadCount; i++) {
+        parents[i] = i;
+    }
+
+    //Threads already sharing a block must be annealed together
+    stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+    stPinchBlock *block;
+    while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+        int64_t firstIndex = getIndex(threadIndices, stPinchSegment_getThread(stPinchBlock_getFirst(block)));
+        stPinchBlockIt segmentIt = stPinchBlock_getSegmentIterator(block);
+        stPinchSegment *segment;
+        while ((segment = stPinchBlockIt_getNext(&segmentIt)) != NULL) {
+            mergeComponents(parents, firstIndex, getIndex(threadIndices, stPinchSegment_getThread(segment)));
+        }
+    }
+
+    //Read the pinches a chunk at a time, merging the components of the threads they link
+    int64_t pinchNumber = 0, pinchCapacity = chunkSize < 1024 ? chunkSize : 1024;
+    ThreadPinch *pinches = st_malloc(sizeof(ThreadPinch) * pinchCapacity);
+    int64_t *pinchComponents = st_malloc(sizeof(int64_t) * pinchCapacity);
+    stPinch *pinch;
+    do {
+        pinch = pinchIterator(extraArg);
+        if (pinch != NULL) {
+            if (pinchNumber == pinchCapacity) {
+                pinchCapacity = pinchCapacity * 2 < chunkSize ? pinchCapacity * 2 : chunkSize;
+                pinches = st_realloc(pinches, sizeof(ThreadPinch) * pinchCapacity);
+                pinchComponents = st_realloc(pinchComponents, sizeof(int64_t) * pinchCapacity);
+            }
+            ThreadPinch *threadPinch = &pinches[pinchNumber];
+            threadPinch->thread1 = stPinchThreadSet_getThread(threadSet, pinch->name1);
+            threadPinch->thread2 = stPinchThreadSet_getThread(threadSet, pinch->name2);
+            assert(threadPinch->thread1 != NULL && threadPinch->thread2 != NULL);
+            threadPinch->start1 = pinch->start1;
+            threadPinch->start2 = pinch->start2;
+            threadPinch->length = pinch->length;
+            threadPinch->strand = pinch->strand;
+            pinchComponents[pinchNumber++] = getIndex(threadIndices, threadPinch->thread1);
+            mergeComponents(parents, pinchComponents[pinchNumber - 1], getIndex(threadIndices, threadPinch->thread2));
+        }
+        if (pinchNumber > 0 && (pinchNumber == chunkSize || pinch == NULL)) {
+            annealChunk(pinches, pinchComponents, pinchNumber, parents, threadCount, threadNumber);
+            pinchNumber = 0;
+        }
+    } while (pinch != NULL);
+    free(pinches);
+    free(pinchComponents);
+    free(parents);
+    stHash_destruct(threadIndices);
+}
+
+void stCaf_annealInParallel(stPinchThreadSet *threadSet, stPinchIterator *pinchIterator,
+        bool (*filterFn)(stPinchSegment *, stPinchSegment *), int64_t threadNumber) {
+    if (filterFn != NULL || threadNumber <= 1) {
+        //Filters look at the state of the whole graph as it is built, so are applied serially
+        stCaf_anneal(threadSet, pinchIterator, filterFn);
+        return;
+    }
+    stPinchIterator_reset(pinchIterator);
+    stCaf_annealInParallel2(threadSet, (stPinch *(*)(void *)) stPinchIterator_getNext, pinchIterator, threadNumber,
+            ANNEAL_IN_PARALLEL_CHUNK_SIZE);
+    stCaf_joinTrivialBoundaries(threadSet);
+}
+
 ///////////////////////////////////////////////////////////////////////////
 // Annealing function that ignores homologies between bases not in the same adjacency component.
 ///////////////////////////////////////////////////////////////////////////
 
-static int64_t getIntersectionLength(int64_t start1, int64_t start2, stPinchInterval *pinchInterval1,
-        stPinchInterval *pinchInterval2) {
-    int64_t length1 = pinchInterval1->length + pinchInterval1->start - start1;
-    int64_t length2 = pinchInterval2->length + pinchInterval2->start - start2;
-    assert(length1 > 0 && length2 > 0);
-    return length1 > length2 ? length2 : length1;
+/*
+ * The adjacency components of the graph as labelled intervals on each thread. Components are
+ * found with a union-find over block ends in one sweep along the threads, and each thread gets
+ * a flat array of interval starts, so lookups are a binary search and walking along a pinch is
+ * a cursor move. Unaligned positions take the label of the adjacency they lie on; positions in
+ * a block segment take the label of the adjacency on their side of the segment's midpoint.
+ */
+
+typedef struct _threadLabelIntervals {
+    int64_t *starts;
+    int64_t *labels;
+    int64_t length, end;
+} ThreadLabelIntervals;
+
+struct _stCaf_adjacencyComponentIntervals {
+    stHash *threadsToIntervals;
+};
+
+static void threadLabelIntervals_destruct(ThreadLabelIntervals *intervals) {
+    free(intervals->starts);
+    free(intervals->labels);
+    free(intervals);
+}
+
+static void threadLabelIntervals_add(ThreadLabelIntervals *intervals, int64_t start, int64_t label, int64_t *capacity) {
+    if (intervals->length > 0 && intervals->labels[intervals->length - 1] == label) {
+        return;
+    }
+    if (intervals->length == *capacity) {
+        *capacity *= 2;
+        intervals->starts = st_realloc(intervals->starts, sizeof(int64_t) * *capacity);
+        intervals->labels = st_realloc(intervals->labels, sizeof(int64_t) * *capacity);
+    }
+    intervals->starts[intervals->length] = start;
+    intervals->labels[intervals->length++] = label;
+}
+
+/*
+ * The ends of a block segment facing lower and higher coordinates on its thread.
+ */
+static void getSegmentEnds(stPinchSegment *segment, stHash *blockIndices, int64_t *leftEnd, int64_t *rightEnd) {
+    int64_t blockIndex = getIndex(blockIndices, stPinchSegment_getBlock(segment));
+    bool orientation = stPinchSegment_getBlockOrientation(segment);
+    *leftEnd = 2 * blockIndex + (orientation ? 0 : 1);
+    *rightEnd = 2 * blockIndex + (orientation ? 1 : 0);
+}
+
+stCaf_AdjacencyComponentIntervals *stCaf_adjacencyComponentIntervals_construct(stPinchThreadSet *threadSet) {
+    //Index the blocks, each contributing two ends
+    stHash *blockIndices = stHash_construct2(NULL, (void (*)(void *)) stIntTuple_destruct);
+    stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+    stPinchBlock *block;
+    while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+        stHash_insert(blockIndices, block, stIntTuple_construct1(stHash_size(blockIndices)));
+    }
+    //One extra end for the start of each thread
+    int64_t endNumber = 2 * stHash_size(blockIndices) + stPinchThreadSet_getSize(threadSet);
+    int64_t *parents = st_malloc(sizeof(int64_t) * (endNumber + 1));
+    for (int64_t i = 0; i < endNumber; i++) {
+        parents[i] = i;
+    }
+
+    //Join the ends linked by each adjacency
+    int64_t threadStartEnd = 2 * stHash_size(blockIndices);
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet);
+    stPinchThread *thread;
+    while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        int64_t previousEnd = threadStartEnd++;
+        for (stPinchSegment *segment = stPinchThread_getFirst(thread); segment != NULL; segment = stPinchSegment_get3Prime(segment)) {
+            if (stPinchSegment_getBlock(segment) != NULL) {
+                int64_t leftEnd, rightEnd;
+                getSegmentEnds(segment, blockIndices, &leftEnd, &rightEnd);
+                mergeComponents(parents, previousEnd, leftEnd);
+                previousEnd = rightEnd;
+            }
+        }
+    }
+
+    //Label the positions of each thread
+    stCaf_AdjacencyComponentIntervals *adjacencyComponentIntervals = st_malloc(sizeof(stCaf_AdjacencyComponentIntervals));
+    adjacencyComponentIntervals->threadsToIntervals = stHash_construct2(NULL, (void (*)(void *)) threadLabelIntervals_destruct);
+    threadStartEnd = 2 * stHash_size(blockIndices);
+    threadIt = stPinchThreadSet_getIt(threadSet);
+    while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        ThreadLabelIntervals *intervals = st_malloc(sizeof(ThreadLabelIntervals));
+        int64_t capacity = 16;
+        intervals->starts = st_malloc(sizeof(int64_t) * capacity);
+        intervals->labels = st_malloc(sizeof(int64_t) * capacity);
+        intervals->length = 0;
+        intervals->end = stPinchThread_getStart(thread) + stPinchThread_getLength(thread);
+        int64_t previousEnd = threadStartEnd++;
+        for (stPinchSegment *segment = stPinchThread_getFirst(thread); segment != NULL; segment = stPinchSegment_get3Prime(segment)) {
+            int64_t start = stPinchSegment_getStart(segment);
+            if (stPinchSegment_getBlock(segment) == NULL) {
+                threadLabelIntervals_add(intervals, start, findComponent(parents, previousEnd), &capacity);
+                continue;
+            }
+            int64_t leftEnd, rightEnd, halfLength = stPinchSegment_getLength(segment) / 2;
+            getSegmentEnds(segment, blockIndices, &leftEnd, &rightEnd);
+            if (halfLength > 0) {
+                threadLabelIntervals_add(intervals, start, findComponent(parents, previousEnd), &capacity);
+            }
+            threadLabelIntervals_add(intervals, start + halfLength, findComponent(parents, rightEnd), &capacity);
+            previousEnd = rightEnd;
+        }
+        stHash_insert(adjacencyComponentIntervals->threadsToIntervals, thread, intervals);
+    }
+    free(parents);
+    stHash_destruct(blockIndices);
+    return adjacencyComponentIntervals;
+}
+
+void stCaf_adjacencyComponentIntervals_destruct(stCaf_AdjacencyComponentIntervals *adjacencyComponentIntervals) {
+    stHash_destruct(adjacencyComponentIntervals->threadsToIntervals);
+    free(adjacencyComponentIntervals);
 }
 
-static int64_t getIntersectionLengthReverse(int64_t start1, int64_t end2, stPinchInterval *pinchInterval1,
-        stPinchInterval *pinchInterval2) {
-    int64_t length1 = pinchInterval1->length + pinchInterval1->start - start1;
-    int64_t length2 = end2 - pinchInterval2->start + 1;
-    assert(length1 > 0 && length2 > 0);
-    return length1 > length2 ? length2 : length1;
+static ThreadLabelIntervals *getThreadLabelIntervals(stCaf_AdjacencyComponentIntervals *adjacencyComponentIntervals, stPinchThread *thread) {
+    ThreadLabelIntervals *intervals = stHash_search(adjacencyComponentIntervals->threadsToIntervals, thread);
+    assert(intervals != NULL && intervals->length > 0);
+    return intervals;
 }
 
-static stPinchInterval *updatePinchInterval(int64_t start, stPinchInterval *pinchInterval,
-        stSortedSet *adjacencyComponentIntervals) {
-    return start < pinchInterval->start + pinchInterval->length ? pinchInterval : stPinchIntervals_getInterval(
-            adjacencyComponentIntervals, pinchInterval->name, start);
+/*
+ * Index of the interval containing the position.
+ */
+static int64_t threadLabelIntervals_getIndex(ThreadLabelIntervals *intervals, int64_t position) {
+    int64_t i = 0, j = intervals->length - 1;
+    while (i < j) {
+        int64_t k = (i + j + 1) / 2;
+        if (intervals->starts[k] <= position) {
+            i = k;
+        } else {
+            j = k - 1;
+        }
+    }
+    return i;
 }
 
-static stPinchInterval *updatePinchIntervalReverse(int64_t end, stPinchInterval *pinchInterval,
-        stSortedSet *adjacencyComponentIntervals) {
-    return end >= pinchInterval->start ? pinchInterval : stPinchIntervals_getInterval(adjacencyComponentIntervals,
-            pinchInterval->name, end);
+static int64_t threadLabelIntervals_getEnd(ThreadLabelIntervals *intervals, int64_t index) {
+    return index + 1 < intervals->length ? intervals->starts[index + 1] : intervals->end;
+}
+
+int64_t stCaf_adjacencyComponentIntervals_getLabel(stCaf_AdjacencyComponentIntervals *adjacencyComponentIntervals, stPinchThread *thread,
+        int64_t position) {
+    ThreadLabelIntervals *intervals = getThreadLabelIntervals(adjacencyComponentIntervals, thread);
+    return intervals->labels[threadLabelIntervals_getIndex(intervals, position)];
 }
 
 static int64_t min(int64_t i, int64_t j) {
     return i < j ? i : j;
 }
 
-static void alignSameComponents(stPinch *pinch, stPinchThreadSet *threadSet, stSortedSet *adjacencyComponentIntervals, bool (*filterFn)(stPinchSegment *, stPinchSegment *)) {
+static void alignSameComponents(stPinch *pinch, stPinchThreadSet *threadSet, stCaf_AdjacencyComponentIntervals *adjacencyComponentIntervals,
+        bool (*filterFn)(stPinchSegment *, stPinchSegment *)) {
     stPinchThread *thread1 = stPinchThreadSet_getThread(threadSet, pinch->name1);
     stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet, pinch->name2);
     assert(thread1 != NULL && thread2 != NULL);
-    stPinchInterval *pinchInterval1 = stPinchIntervals_getInterval(adjacencyComponentIntervals, pinch->name1,
-            pinch->start1);
+    ThreadLabelIntervals *intervals1 = getThreadLabelIntervals(adjacencyComponentIntervals, thread1);
+    ThreadLabelIntervals *intervals2 = getThreadLabelIntervals(adjacencyComponentIntervals, thread2);
+    int64_t i1 = threadLabelIntervals_getIndex(intervals1, pinch->start1);
     int64_t offset = 0;
     if (pinch->strand) { //A bit redundant code wise, but fast.
-        stPinchInterval *pinchInterval2 = stPinchIntervals_getInterval(adjacencyComponentIntervals, pinch->name2,
-                pinch->start2);
+        int64_t i2 = threadLabelIntervals_getIndex(intervals2, pinch->start2);
         while (offset < pinch->length) {
-            assert(pinchInterval1 != NULL && pinchInterval2 != NULL);
-            int64_t length = min(getIntersectionLength(pinch->start1 + offset, pinch->start2 + offset, pinchInterval1,
-                    pinchInterval2), pinch->length - offset);
-            if (stPinchInterval_getLabel(pinchInterval1) == stPinchInterval_getLabel(pinchInterval2)) {
-                if(filterFn != NULL) {
-                    stPinchThread_filterPinch(thread1, thread2, pinch->start1 + offset, pinch->start2 + offset, length, 1, filterFn);
-                }
-                else {
-                    stPinchThread_pinch(thread1, thread2, pinch->start1 + offset, pinch->start2 + offset, length, 1);
+            int64_t start1 = pinch->start1 + offset, start2 = pinch->start2 + offset;
+            while (threadLabelIntervals_getEnd(intervals1, i1) <= start1) {
+                i1++;
+            }
+            while (threadLabelIntervals_getEnd(intervals2, i2) <= start2) {
+                i2++;
+            }
+            int64_t length = min(min(threadLabelIntervals_getEnd(intervals1, i1) - start1,
+                    threadLabelIntervals_getEnd(intervals2, i2) - start2), pinch->length - offset);
+            assert(length > 0);
+            if (intervals1->labels[i1] == intervals2->labels[i2]) {
+                if (filterFn != NULL) {
+                    stPinchThread_filterPinch(thread1, thread2, start1, start2, length, 1, filterFn);
+                } else {
+                    stPinchThread_pinch(thread1, thread2, start1, start2, length, 1);
                 }
             }
             offset += length;
-            pinchInterval1 = updatePinchInterval(pinch->start1 + offset, pinchInterval1, adjacencyComponentIntervals);
-            pinchInterval2 = updatePinchInterval(pinch->start2 + offset, pinchInterval2, adjacencyComponentIntervals);
         }
     } else {
         int64_t end2 = pinch->start2 + pinch->length - 1;
-        stPinchInterval *pinchInterval2 = stPinchIntervals_getInterval(adjacencyComponentIntervals, pinch->name2, end2);
+        int64_t i2 = threadLabelIntervals_getIndex(intervals2, end2);
         while (offset < pinch->length) {
-            assert(pinchInterval1 != NULL && pinchInterval2 != NULL);
-            int64_t length = min(getIntersectionLengthReverse(pinch->start1 + offset, end2 - offset, pinchInterval1,
-                    pinchInterval2), pinch->length - offset);
-            if (stPinchInterval_getLabel(pinchInterval1) == stPinchInterval_getLabel(pinchInterval2)) {
-                if(filterFn != NULL) {
-                    stPinchThread_filterPinch(thread1, thread2, pinch->start1 + offset, end2 - offset - length + 1, length, 0, filterFn);
-                }
-                else {
-                    stPinchThread_pinch(thread1, thread2, pinch->start1 + offset, end2 - offset - length + 1, length, 0);
+            int64_t start1 = pinch->start1 + offset, position2 = end2 - offset;
+            while (threadLabelIntervals_getEnd(intervals1, i1) <= start1) {
+                i1++;
+            }
+            while (intervals2->starts[i2] > position2) {
+                i2--;
+            }
+            int64_t length = min(min(threadLabelIntervals_getEnd(intervals1, i1) - start1,
+                    position2 - intervals2->starts[i2] + 1), pinch->length - offset);
+            assert(length > 0);
+            if (intervals1->labels[i1] == intervals2->labels[i2]) {
+                if (filterFn != NULL) {
+                    stPinchThread_filterPinch(thread1, thread2, start1, position2 - length + 1, length, 0, filterFn);
+                } else {
+                    stPinchThread_pinch(thread1, thread2, start1, position2 - length + 1, length, 0);
                 }
             }
             offset += length;
-            pinchInterval1 = updatePinchInterval(pinch->start1 + offset, pinchInterval1, adjacencyComponentIntervals);
-            pinchInterval2 = updatePinchIntervalReverse(end2 - offset, pinchInterval2, adjacencyComponentIntervals);
         }
     }
 }
 
-static stSortedSet *getAdjacencyComponentIntervals(stPinchThreadSet *threadSet, stList **adjacencyComponents) {
-    stHash *pinchEndsToAdjacencyComponents;
-    *adjacencyComponents = stPinchThreadSet_getAdjacencyComponents2(threadSet, &pinchEndsToAdjacencyComponents);
-    stSortedSet *adjacencyComponentIntervals = stPinchThreadSet_getLabelIntervals(threadSet,
-            pinchEndsToAdjacencyComponents);
-    stHash_destruct(pinchEndsToAdjacencyComponents);
-    return adjacencyComponentIntervals;
-}
-
 void stCaf_annealBetweenAdjacencyComponents2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *),
         void *extraArg, bool (*filterFn)(stPinchSegment *, stPinchSegment *)) {
     //Get the adjacency component intervals
-    stList *adjacencyComponents;
-    stSortedSet *adjacencyComponentIntervals = getAdjacencyComponentIntervals(threadSet, &adjacencyComponents);
-    //Now do the actual alignments.
+    stCaf_AdjacencyComponentIntervals *adjacencyComponentIntervals = stCaf_adjacencyComponentIntervals_construct(threadSet);
+    //Now do the actual alignments
+    stCaf_clearAlignmentFilteringCache();
     stPinch *pinch;
     while ((pinch = pinchIterator(extraArg)) != NULL) {
         alignSameComponents(pinch, threadSet, adjacencyComponentIntervals, filterFn);
     }
-    stSortedSet_destruct(adjacencyComponentIntervals);
-    stList_destruct(adjacencyComponents);
+    stCaf_clearAlignmentFilteringCache();
+    stCaf_adjacencyComponentIntervals_destruct(adjacencyComponentIntervals);
 }
 
 void stCaf_annealBetweenAdjacencyComponents(stPinchThreadSet *threadSet, stPinchIterator *pinchIterator, bool (*filterFn)(stPinchSegment *, stPinchSegment *)) {
@@ -8,212 +8,472 @@
 // parameter.
 static Flower *flower;
 
+/*
+ * Lookup table from the names of the threads (caps) of the filtering flower to
+ * their species (event) and chromosome (sequence), built once per flower so the
+ * filters don't have to search the flower's caps for every segment they look at.
+ */
+
+typedef struct _threadInfo {
+    Name name;
+    Event *event;
+    int64_t eventIndex;
+    int64_t sequenceIndex;
+    bool outgroup;
+} ThreadInfo;
+
+static ThreadInfo *threadInfos = NULL; // Open addressing hash table keyed by name
+static uint64_t threadInfosMask = 0;
+static int64_t eventNumber = 0;
+static int64_t eventWordNumber = 0;
+static uint64_t *ingroupEvents = NULL; // One bit per ingroup event
+static int64_t sequenceNumber = 0;
+static int64_t *sequenceStamps = NULL; // Last stamp each sequence was seen with
+static int64_t sequenceStamp = 0;
+
+static uint64_t hashName(Name name) {
+    return ((uint64_t) name) * 0x9E3779B97F4A7C15ULL;
+}
+
+static ThreadInfo *getThreadInfo(Name name) {
+    uint64_t i = hashName(name) & threadInfosMask;
+    while (threadInfos[i].event != NULL) {
+        if (threadInfos[i].name == name) {
+            return &threadInfos[i];
+        }
+        i = (i + 1) & threadInfosMask;
+    }
+    return NULL;
+}
+
+static ThreadInfo *getSegmentInfo(stPinchSegment *segment) {
+    ThreadInfo *threadInfo = getThreadInfo(stPinchSegment_getName(segment));
+    assert(threadInfo != NULL);
+    return threadInfo;
+}
+
+/*
+ * Summaries of the species in a block, cached between calls to the filters so
+ * they don't have to walk the segments of both blocks for every pinch. There is
+ * no way to attach data to a pinch block, so the summaries are kept in a hash
+ * keyed by block and are only used while the degree and first segment of the
+ * block still match. When a filter accepts a pinch the union of the two
+ * summaries is kept aside, then stored for the merged block at the start of the
+ * next filter call, if the pinch has been applied. The pinch is only taken to
+ * have been applied if both positions are now in one block with the summed
+ * degree, whose first segment is the first of one of the two pinched blocks, so
+ * a pinch the caller drops or makes differently is recomputed rather than
+ * trusted. A block that is pinched repeatedly is therefore only walked once.
+ */
+
+typedef struct _blockSummary {
+    stPinchSegment *first;
+    int64_t degree;
+    int64_t outgroupNumber;
+    uint64_t events[]; // One bit per event
+} BlockSummary;
+
+static stHash *blockSummaries = NULL;
+static BlockSummary *segmentSummaries[2] = { NULL, NULL }; // Used for segments not in a block
+static BlockSummary *pendingSummary = NULL;
+static stPinchThread *pendingThread1, *pendingThread2;
+static int64_t pendingPosition1, pendingPosition2;
+static stPinchSegment *pendingFirst1, *pendingFirst2; // Only compared, never followed
+
+static BlockSummary *blockSummary_construct(void) {
+    return st_calloc(1, sizeof(BlockSummary) + eventWordNumber * sizeof(uint64_t));
+}
+
+static void blockSummary_addSegment(BlockSummary *summary, stPinchSegment *segment) {
+    ThreadInfo *threadInfo = getSegmentInfo(segment);
+    summary->events[threadInfo->eventIndex / 64] |= ((uint64_t) 1) << (threadInfo->eventIndex % 64);
+    summary->outgroupNumber += threadInfo->outgroup ? 1 : 0;
+    summary->degree++;
+}
+
+static void storeBlockSummary(stPinchBlock *block, BlockSummary *summary) {
+    free(stHash_remove(blockSummaries, block));
+    stHash_insert(blockSummaries, block, summary);
+}
+
+static void storePendingSummary(void) {
+    if (pendingSummary == NULL) {
+        return;
+    }
+    stPinchBlock *block = stPinchSegment_getBlock(stPinchThread_getSegment(pendingThread1, pendingPosition1));
+    if (block != NULL && block == stPinchSegment_getBlock(stPinchThread_getSegment(pendingThread2, pendingPosition2))
+            && stPinchBlock_getDegree(block) == pendingSummary->degree
+            && (stPinchBlock_getFirst(block) == pendingFirst1 || stPinchBlock_getFirst(block) == pendingFirst2)) {
+        pendingSummary->first = stPinchBlock_getFirst(block);
+        storeBlockSummary(block, pendingSummary);
+    } else {
+        free(pendingSummary);
+    }
+    pendingSummary = NULL;
+}
+
+static BlockSummary *getSummary(stPinchSegment *segment, int64_t scratchIndex) {
+    stPinchBlock *block = stPinchSegment_getBlock(segment);
+    BlockSummary *summary;
+    if (block == NULL) {
+        summary = segmentSummaries[scratchIndex];
+        memset(summary, 0, sizeof(BlockSummary) + eventWordNumber * sizeof(uint64_t));
+        blockSummary_addSegment(summary, segment);
+        return summary;
+    }
+    summary = stHash_search(blockSummaries, block);
+    if (summary != NULL && summary->degree == stPinchBlock_getDegree(block)
+            && summary->first == stPinchBlock_getFirst(block)) {
+        return summary;
+    }
+    summary = blockSummary_construct();
+    stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
+    while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
+        blockSummary_addSegment(summary, segment);
+    }
+    summary->first = stPinchBlock_getFirst(block);
+    storeBlockSummary(block, summary);
+    return summary;
+}
+
+static void getSummaries(stPinchSegment *segment1, stPinchSegment *segment2,
+                         BlockSummary **summary1, BlockSummary **summary2) {
+    storePendingSummary();
+    *summary1 = getSummary(segment1, 0);
+    *summary2 = getSummary(segment2, 1);
+}
+
+/*
+ * Returns the filter's verdict, remembering the summary of the merged block if
+ * the pinch is going to be made.
+ */
+static bool recordFilterResult(stPinchSegment *segment1, stPinchSegment *segment2,
+                               BlockSummary *summary1, BlockSummary *summary2, bool filtered) {
+    stPinchBlock *block1 = stPinchSegment_getBlock(segment1);
+    if (!filtered && (block1 == NULL || block1 != stPinchSegment_getBlock(segment2))) {
+        pendingSummary = blockSummary_construct();
+        for (int64_t i = 0; i < eventWordNumber; i++) {
+            pendingSummary->events[i] = summary1->events[i] | summary2->events[i];
+        }
+        pendingSummary->degree = summary1->degree + summary2->degree;
+        pendingSummary->outgroupNumber = summary1->outgroupNumber + summary2->outgroupNumber;
+        stPinchBlock *block2 = stPinchSegment_getBlock(segment2);
+        pendingThread1 = stPinchSegment_getThread(segment1);
+        pendingThread2 = stPinchSegment_getThread(segment2);
+        pendingPosition1 = stPinchSegment_getStart(segment1);
+        pendingPosition2 = stPinchSegment_getStart(segment2);
+        pendingFirst1 = block1 != NULL ? stPinchBlock_getFirst(block1) : segment1;
+        pendingFirst2 = block2 != NULL ? stPinchBlock_getFirst(block2) : segment2;
+    }
+    return filtered;
+}
+
+void stCaf_clearAlignmentFilteringCache(void) {
+    free(pendingSummary);
+    pendingSummary = NULL;
+    if (blockSummaries != NULL) {
+        stHash_destruct(blockSummaries);
+        blockSummaries = stHash_construct2(NULL, free);
+    }
+}
+
+static void destructThreadInfos(void) {
+    stCaf_clearAlignmentFilteringCache();
+    if (blockSummaries != NULL) {
+        stHash_destruct(blockSummaries);
+    }
+    free(segmentSummaries[0]);
+    free(segmentSummaries[1]);
+    free(threadInfos);
+    free(ingroupEvents);
+    free(sequenceStamps);
+    blockSummaries = NULL;
+    segmentSummaries[0] = NULL;
+    segmentSummaries[1] = NULL;
+    threadInfos = NULL;
+    ingroupEvents = NULL;
+    sequenceStamps = NULL;
+    threadInfosMask = 0;
+    eventNumber = 0;
+    eventWordNumber = 0;
+    sequenceNumber = 0;
+    sequenceStamp = 0;
+}
+
+static void constructThreadInfos(Flower *flower) {
+    stHash *eventIndices = stHash_construct2(NULL, free);
+    EventTree_Iterator *eventIt = eventTree_getIterator(flower_getEventTree(flower));
+    Event *event;
+    while ((event = eventTree_getNext(eventIt)) != NULL) {
+        int64_t *index = st_malloc(sizeof(int64_t));
+        *index = eventNumber++;
+        stHash_insert(eventIndices, event, index);
+    }
+    eventTree_destructIterator(eventIt);
+    eventWordNumber = (eventNumber + 63) / 64;
+    ingroupEvents = st_calloc(eventWordNumber + 1, sizeof(uint64_t));
+    eventIt = eventTree_getIterator(flower_getEventTree(flower));
+    while ((event = eventTree_getNext(eventIt)) != NULL) {
+        if (!event_isOutgroup(event)) {
+            int64_t index = *(int64_t *) stHash_search(eventIndices, event);
+            ingroupEvents[index / 64] |= ((uint64_t) 1) << (index % 64);
+        }
+    }
+    eventTree_destructIterator(eventIt);
+    blockSummaries = stHash_construct2(NULL, free);
+    segmentSummaries[0] = blockSummary_construct();
+    segmentSummaries[1] = blockSummary_construct();
+
+    uint64_t capacity = 16;
+    while (capacity < 2 * (uint64_t) flower_getCapNumber(flower)) {
+        capacity *= 2;
+    }
+    threadInfos = st_calloc(capacity, sizeof(ThreadInfo));
+    threadInfosMask = capacity - 1;
+    stHash *sequenceIndices = stHash_construct2(NULL, free);
+    Flower_CapIterator *capIt = flower_getCapIterator(flower);
+    Cap *cap;
+    while ((cap = flower_getNextCap(capIt)) != NULL) {
+        Sequence *sequence = cap_getSequence(cap);
+        int64_t *sequenceIndex = NULL;
+        if (sequence != NULL && (sequenceIndex = stHash_search(sequenceIndices, sequence)) == NULL) {
+            sequenceIndex = st_malloc(sizeof(int64_t));
+            *sequenceIndex = sequenceNumber++;
+            stHash_insert(sequenceIndices, sequence, sequenceIndex);
+        }
+        uint64_t i = hashName(cap_getName(cap)) & threadInfosMask;
+        while (threadInfos[i].event != NULL) {
+            i = (i + 1) & threadInfosMask;
+        }
+        ThreadInfo *threadInfo = &threadInfos[i];
+        threadInfo->name = cap_getName(cap);
+        threadInfo->event = cap_getEvent(cap);
+        assert(threadInfo->event != NULL);
+        threadInfo->eventIndex = *(int64_t *) stHash_search(eventIndices, threadInfo->event);
+        threadInfo->sequenceIndex = sequenceIndex != NULL ? *sequenceIndex : -1;
+        threadInfo->outgroup = event_isOutgroup(threadInfo->event);
+    }
+    flower_destructCapIterator(capIt);
+    sequenceStamps = st_calloc(sequenceNumber + 1, sizeof(int64_t));
+    stHash_destruct(sequenceIndices);
+    stHash_destruct(eventIndices);
+}
+
 void stCaf_setFlowerForAlignmentFiltering(Flower *input) {
+    destructThreadInfos();
     flower = input;
+    if (flower != NULL) {
+        constructThreadInfos(flower);
+    }
 }
 
 /*
  * Functions used for prefiltering the alignments.
  */
 
-Event *stCaf_getEvent(stPinchSegment *segment, Flower *flower) {
-    Event *event = cap_getEvent(flower_getCap(flower, stPinchSegment_getName(segment)));
+Event *stCaf_getEvent(stPinchSegment *segment, Flower *flower2) {
+    ThreadInfo *threadInfo;
+    if (flower2 == flower && threadInfos != NULL && (threadInfo = getThreadInfo(stPinchSegment_getName(segment))) != NULL) {
+        return threadInfo->event;
+    }
+    Event *event = cap_getEvent(flower_getCap(flower2, stPinchSegment_getName(segment)));
     assert(event != NULL);
     return event;
 }
 
+static bool containsOutgroup(BlockSummary *summary) {
+    return summary->outgroupNumber > 0;
+}
+
+static bool containsMoreThanOneEvent(BlockSummary *summary) {
+    bool seenEvent = 0;
+    for (int64_t i = 0; i < eventWordNumber; i++) {
+        if (summary->events[i] != 0) {
+            if (seenEvent || (summary->events[i] & (summary->events[i] - 1)) != 0) {
+                return 1;
+            }
+            seenEvent = 1;
+        }
+    }
+    return 0;
+}
+
+static bool sharesEvent(BlockSummary *summary1, BlockSummary *summary2, bool ingroupsOnly) {
+    for (int64_t i = 0; i < eventWordNumber; i++) {
+        if ((summary1->events[i] & summary2->events[i] & (ingroupsOnly ? ingroupEvents[i] : ~((uint64_t) 0))) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 /*
- * Filtering by presence of outgroup. This code is efficient and scales linearly with depth.
+ * Filtering by presence of outgroup. A block found to contain an outgroup has
+ * its first outgroup segment moved to the front, which decides the orientation
+ * and first segment of the block in the cactus graph, so the blocks are checked
+ * in the same order, and moved under the same conditions, as when each check
+ * walked the block.
  */
 
-static bool containsOutgroupSegment(stPinchBlock *block, Flower *flower) {
+static bool containsOutgroupSegment(stPinchBlock *block, BlockSummary *summary) {
+    if (!containsOutgroup(summary)) {
+        return 0;
+    }
     stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
     stPinchSegment *segment;
     while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-        if (event_isOutgroup(stCaf_getEvent(segment, flower))) {
+        if (getSegmentInfo(segment)->outgroup) {
             stPinchSegment_putSegmentFirstInBlock(segment);
             assert(stPinchBlock_getFirst(block) == segment);
+            summary->first = segment; // The degree and species are unchanged, so the summary still holds
             return 1;
         }
     }
+    assert(0);
     return 0;
 }
 
-static bool isOutgroupSegment(stPinchSegment *segment, Flower *flower) {
-    if (event_isOutgroup(stCaf_getEvent(segment, flower))) {
-        return 1;
-    } else {
-        return 0;
-    }
-}
-
-bool stCaf_filterByOutgroup(stPinchSegment *segment1,
-                            stPinchSegment *segment2) {
-    stPinchBlock *block1, *block2;
-    if ((block1 = stPinchSegment_getBlock(segment1)) != NULL) {
-        if ((block2 = stPinchSegment_getBlock(segment2)) != NULL) {
+static bool filterByOutgroup(stPinchSegment *segment1, stPinchSegment *segment2,
+                             BlockSummary *summary1, BlockSummary *summary2) {
+    stPinchBlock *block1 = stPinchSegment_getBlock(segment1);
+    stPinchBlock *block2 = stPinchSegment_getBlock(segment2);
+    if (block1 != NULL) {
+        if (block2 != NULL) {
             if (block1 == block2) {
-                return stPinchBlock_getLength(block1) == 1 ? 0 : containsOutgroupSegment(block1, flower);
+                return stPinchBlock_getLength(block1) == 1 ? 0 : containsOutgroupSegment(block1, summary1);
             }
             if (stPinchBlock_getDegree(block1) < stPinchBlock_getDegree(block2)) {
-                return containsOutgroupSegment(block1, flower) && containsOutgroupSegment(block2, flower);
+                return containsOutgroupSegment(block1, summary1) && containsOutgroupSegment(block2, summary2);
             }
-            return containsOutgroupSegment(block2, flower) && containsOutgroupSegment(block1, flower);
+            return containsOutgroupSegment(block2, summary2) && containsOutgroupSegment(block1, summary1);
         }
-        return isOutgroupSegment(segment2, flower) && containsOutgroupSegment(block1, flower);
+        return containsOutgroup(summary2) && containsOutgroupSegment(block1, summary1);
     }
-    if ((block2 = stPinchSegment_getBlock(segment2)) != NULL) {
-        return isOutgroupSegment(segment1, flower) && containsOutgroupSegment(block2, flower);
+    if (block2 != NULL) {
+        return containsOutgroup(summary1) && containsOutgroupSegment(block2, summary2);
     }
-    return isOutgroupSegment(segment1, flower) && isOutgroupSegment(segment2, flower);
+    return containsOutgroup(summary1) && containsOutgroup(summary2);
+}
+
+bool stCaf_filterByOutgroup(stPinchSegment *segment1,
+                            stPinchSegment *segment2) {
+    BlockSummary *summary1, *summary2;
+    getSummaries(segment1, segment2, &summary1, &summary2);
+    return recordFilterResult(segment1, segment2, summary1, summary2,
+                              filterByOutgroup(segment1, segment2, summary1, summary2));
 }
 
 bool stCaf_relaxedFilterByOutgroup(stPinchSegment *segment1,
                                    stPinchSegment *segment2) {
-    stPinchBlock *block1, *block2;
-    if ((block1 = stPinchSegment_getBlock(segment1)) != NULL) {
-        if ((block2 = stPinchSegment_getBlock(segment2)) != NULL) {
-            if (block1 == block2) {
-                return stPinchBlock_getLength(block1) == 1 ? 0 : containsOutgroupSegment(block1, flower);
-            }
-            if (stPinchBlock_getDegree(block1) < stPinchBlock_getDegree(block2)) {
-                return containsOutgroupSegment(block1, flower) && containsOutgroupSegment(block2, flower);
-            }
-            return containsOutgroupSegment(block2, flower) && containsOutgroupSegment(block1, flower);
-        }
-    }
-    // If we get here, we are just adding a segment to a block, not
-    // pinching two blocks together.
-    return false;
+    BlockSummary *summary1, *summary2;
+    getSummaries(segment1, segment2, &summary1, &summary2);
+    // If either segment is not in a block, we are just adding a
+    // segment to a block, not pinching two blocks together.
+    return recordFilterResult(segment1, segment2, summary1, summary2,
+                              stPinchSegment_getBlock(segment1) != NULL
+                              && stPinchSegment_getBlock(segment2) != NULL
+                              && filterByOutgroup(segment1, segment2, summary1, summary2));
 }
 
 /*
- * Filtering by presence of repeat species in block. This code is inefficient and does not scale.
+ * Filtering by presence of repeat species in block.
  */
 
-static bool checkIntersection(stSortedSet *names1, stSortedSet *names2) {
-    stSortedSet *n12 = stSortedSet_getIntersection(names1, names2);
-    bool b = stSortedSet_size(n12) > 0;
-    stSortedSet_destruct(names1);
-    stSortedSet_destruct(names2);
-    stSortedSet_destruct(n12);
-    return b;
-}
-
-static stSortedSet *getEvents(stPinchSegment *segment, Flower *flower) {
-    stSortedSet *events = stSortedSet_construct();
-    if (stPinchSegment_getBlock(segment) != NULL) {
-        stPinchBlock *block = stPinchSegment_getBlock(segment);
-        stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
-        while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-            stSortedSet_insert(events, stCaf_getEvent(segment, flower));
-        }
-    } else {
-        stSortedSet_insert(events, stCaf_getEvent(segment, flower));
-    }
-    return events;
-}
-
-static bool containsMoreThanOneEvent(stPinchSegment *segment, Flower *flower) {
-    if (stPinchSegment_getBlock(segment) == NULL) {
-        return false;
-    } else {
-        stPinchBlock *block = stPinchSegment_getBlock(segment);
-        Event *event = stCaf_getEvent(segment, flower);
-        stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
-        while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-            if (stCaf_getEvent(segment, flower) != event) {
-                return true;
-            }
-        }
-        return false;
-    }
-}
-
 bool stCaf_filterByMultipleSpecies(stPinchSegment *segment1,
                                    stPinchSegment *segment2) {
-    stPinchBlock *block1, *block2;
-    if ((block1 = stPinchSegment_getBlock(segment1)) != NULL) {
-        if ((block2 = stPinchSegment_getBlock(segment2)) != NULL) {
-            if (block1 == block2) {
-                return stPinchBlock_getLength(block1) == 1 ? 0 : containsMoreThanOneEvent(segment1, flower);
-            }
-            if (stPinchBlock_getDegree(block1) < stPinchBlock_getDegree(block2)) {
-            	return containsMoreThanOneEvent(segment1, flower) && containsMoreThanOneEvent(segment2, flower);
-            }
-            return containsMoreThanOneEvent(segment2, flower) && containsMoreThanOneEvent(segment1, flower);
+    BlockSummary *summary1, *summary2;
+    getSummaries(segment1, segment2, &summary1, &summary2);
+    stPinchBlock *block1 = stPinchSegment_getBlock(segment1);
+    stPinchBlock *block2 = stPinchSegment_getBlock(segment2);
+    bool filtered = 0;
+    if (block1 != NULL && block2 != NULL) {
+        if (block1 == block2) {
+            filtered = stPinchBlock_getLength(block1) == 1 ? 0 : containsMoreThanOneEvent(summary1);
+        } else {
+            filtered = containsMoreThanOneEvent(summary1) && containsMoreThanOneEvent(summary2);
         }
     }
-    // If we get here, we are just adding a segment to a block, not
-    // pinching two blocks together.
-    return false;
+    // Otherwise we are just adding a segment to a block, not pinching
+    // two blocks together.
+    return recordFilterResult(segment1, segment2, summary1, summary2, filtered);
 }
 
 bool stCaf_filterByRepeatSpecies(stPinchSegment *segment1,
                                  stPinchSegment *segment2) {
-    return checkIntersection(getEvents(segment1, flower), getEvents(segment2, flower));
+    BlockSummary *summary1, *summary2;
+    getSummaries(segment1, segment2, &summary1, &summary2);
+    return recordFilterResult(segment1, segment2, summary1, summary2, sharesEvent(summary1, summary2, 0));
 }
 
 bool stCaf_relaxedFilterByRepeatSpecies(stPinchSegment *segment1,
                                         stPinchSegment *segment2) {
-    return stPinchSegment_getBlock(segment1) != NULL
-        && stPinchSegment_getBlock(segment2) != NULL
-        && checkIntersection(getEvents(segment1, flower), getEvents(segment2, flower));
+    BlockSummary *summary1, *summary2;
+    getSummaries(segment1, segment2, &summary1, &summary2);
+    return recordFilterResult(segment1, segment2, summary1, summary2,
+                              stPinchSegment_getBlock(segment1) != NULL
+                              && stPinchSegment_getBlock(segment2) != NULL
+                              && sharesEvent(summary1, summary2, 0));
 }
 
-static stSortedSet *getChrNames(stPinchSegment *segment, Flower *flower) {
-    stSortedSet *names = stSortedSet_construct();
-    if (stPinchSegment_getBlock(segment) != NULL) {
-        stPinchBlock *block = stPinchSegment_getBlock(segment);
-        stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
-        while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-            Cap *cap = flower_getCap(flower, stPinchSegment_getName(segment));
-            Sequence *sequence = cap_getSequence(cap);
-            stSortedSet_insert(names, (void *) sequence_getName(sequence));
-        }
-    } else {
-        Cap *cap = flower_getCap(flower, stPinchSegment_getName(segment));
-        Sequence *sequence = cap_getSequence(cap);
-        stSortedSet_insert(names, (void *) sequence_getName(sequence));
-    }
-    return names;
+static void markSequence(stPinchSegment *segment) {
+    ThreadInfo *threadInfo = getSegmentInfo(segment);
+    assert(threadInfo->sequenceIndex != -1);
+    sequenceStamps[threadInfo->sequenceIndex] = sequenceStamp;
 }
 
-bool stCaf_singleCopyChr(stPinchSegment *segment1,
-                         stPinchSegment *segment2) {
-    return checkIntersection(getChrNames(segment1, flower), getChrNames(segment2, flower));
+static bool isMarkedSequence(stPinchSegment *segment) {
+    ThreadInfo *threadInfo = getSegmentInfo(segment);
+    assert(threadInfo->sequenceIndex != -1);
+    return sequenceStamps[threadInfo->sequenceIndex] == sequenceStamp;
 }
 
-static stSortedSet *getIngroupEvents(stPinchSegment *segment, Flower *flower) {
-    stSortedSet *events = stSortedSet_construct();
-    if (stPinchSegment_getBlock(segment) != NULL) {
-        stPinchBlock *block = stPinchSegment_getBlock(segment);
+static bool sharesSequence(stPinchSegment *segment1, stPinchSegment *segment2) {
+    // Bumping the stamp unmarks all the sequences at once.
+    sequenceStamp++;
+    stPinchBlock *block = stPinchSegment_getBlock(segment1);
+    if (block != NULL) {
         stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
+        stPinchSegment *segment;
         while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-            Event *event = stCaf_getEvent(segment, flower);
-            if (!event_isOutgroup(event)) {
-                stSortedSet_insert(events, event);
-            }
+            markSequence(segment);
         }
     } else {
-        Event *event = stCaf_getEvent(segment, flower);
-        if (!event_isOutgroup(event)) {
-            stSortedSet_insert(events, event);
+        markSequence(segment1);
+    }
+    block = stPinchSegment_getBlock(segment2);
+    if (block != NULL) {
+        stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
+        stPinchSegment *segment;
+        while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
+            if (isMarkedSequence(segment)) {
+                return true;
+            }
         }
+        return false;
     }
-    return events;
+    return isMarkedSequence(segment2);
+}
+
+bool stCaf_singleCopyChr(stPinchSegment *segment1,
+                         stPinchSegment *segment2) {
+    return sharesSequence(segment1, segment2);
 }
 
 bool stCaf_singleCopyIngroup(stPinchSegment *segment1,
                              stPinchSegment *segment2) {
-    return checkIntersection(getIngroupEvents(segment1, flower), getIngroupEvents(segment2, flower));
+    BlockSummary *summary1, *summary2;
+    getSummaries(segment1, segment2, &summary1, &summary2);
+    return recordFilterResult(segment1, segment2, summary1, summary2, sharesEvent(summary1, summary2, 1));
 }
 
 bool stCaf_relaxedSingleCopyIngroup(stPinchSegment *segment1,
                                     stPinchSegment *segment2) {
-    return stPinchSegment_getBlock(segment1) != NULL
-        && stPinchSegment_getBlock(segment2) != NULL
-        && checkIntersection(getIngroupEvents(segment1, flower), getIngroupEvents(segment2, flower));
+    BlockSummary *summary1, *summary2;
+    getSummaries(segment1, segment2, &summary1, &summary2);
+    return recordFilterResult(segment1, segment2, summary1, summary2,
+                              stPinchSegment_getBlock(segment1) != NULL
+                              && stPinchSegment_getBlock(segment2) != NULL
+                              && sharesEvent(summary1, summary2, 1));
 }
 
 /*
@@ -401,31 +661,74 @@ bool stCaf_chainHasUnequalNumberOfIngroupCopiesOrNoOutgroup(stCactusEdgeEnd *cha
         || (numOutgroups > 0 && numOutgroupCopies == 0);
 }
 
+/*
+ * Counts the species and the ingroup and outgroup sequences in a block using the
+ * thread table, with a bitset of the events seen. Returns false if a thread of
+ * the block is not in the table. Only local state is written, as the block
+ * filter is run on several threads at once.
+ */
+static bool countSpeciesFromThreadInfos(stPinchBlock *pinchBlock, int64_t *numberOfSpecies,
+                                        int64_t *ingroupSequences, int64_t *outgroupSequences) {
+    uint64_t localEvents[16];
+    uint64_t *events = eventWordNumber <= 16 ? localEvents : st_malloc(eventWordNumber * sizeof(uint64_t));
+    memset(events, 0, eventWordNumber * sizeof(uint64_t));
+    bool indexed = 1;
+    stPinchBlockIt segmentIt = stPinchBlock_getSegmentIterator(pinchBlock);
+    stPinchSegment *segment;
+    while ((segment = stPinchBlockIt_getNext(&segmentIt)) != NULL) {
+        ThreadInfo *threadInfo = getThreadInfo(stPinchSegment_getName(segment));
+        if (threadInfo == NULL) {
+            indexed = 0;
+            break;
+        }
+        uint64_t bit = ((uint64_t) 1) << (threadInfo->eventIndex % 64);
+        if ((events[threadInfo->eventIndex / 64] & bit) == 0) {
+            events[threadInfo->eventIndex / 64] |= bit;
+            (*numberOfSpecies)++;
+        }
+        if (threadInfo->outgroup) {
+            (*outgroupSequences)++;
+        } else {
+            (*ingroupSequences)++;
+        }
+    }
+    if (events != localEvents) {
+        free(events);
+    }
+    return indexed;
+}
+
 bool stCaf_containsRequiredSpecies(stPinchBlock *pinchBlock,
-                                   Flower *flower,
+                                   Flower *flower2,
                                    int64_t minimumIngroupDegree,
                                    int64_t minimumOutgroupDegree,
                                    int64_t minimumDegree,
                                    int64_t minimumNumberOfSpecies) {
-    stSet *seenEvents = stSet_construct();
     int64_t numberOfSpecies = 0;
     int64_t outgroupSequences = 0;
     int64_t ingroupSequences = 0;
-    stPinchBlockIt segmentIt = stPinchBlock_getSegmentIterator(pinchBlock);
-    stPinchSegment *segment;
-    while ((segment = stPinchBlockIt_getNext(&segmentIt)) != NULL) {
-        Event *event = stCaf_getEvent(segment, flower);
-        if (!stSet_search(seenEvents, event)) {
-            stSet_insert(seenEvents, event);
-            numberOfSpecies++;
-        }
-        if (event_isOutgroup(event)) {
-            outgroupSequences++;
-        } else {
-            ingroupSequences++;
+    if (flower2 != flower || threadInfos == NULL
+            || !countSpeciesFromThreadInfos(pinchBlock, &numberOfSpecies, &ingroupSequences, &outgroupSequences)) {
+        numberOfSpecies = 0;
+        outgroupSequences = 0;
+        ingroupSequences = 0;
+        stSet *seenEvents = stSet_construct();
+        stPinchBlockIt segmentIt = stPinchBlock_getSegmentIterator(pinchBlock);
+        stPinchSegment *segment;
+        while ((segment = stPinchBlockIt_getNext(&segmentIt)) != NULL) {
+            Event *event = stCaf_getEvent(segment, flower2);
+            if (!stSet_search(seenEvents, event)) {
+                stSet_insert(seenEvents, event);
+                numberOfSpecies++;
+            }
+            if (event_isOutgroup(event)) {
+                outgroupSequences++;
+            } else {
+                ingroupSequences++;
+            }
         }
+        stSet_destruct(seenEvents);
     }
-    stSet_destruct(seenEvents);
     return ingroupSequences >= minimumIngroupDegree &&
         outgroupSequences >= minimumOutgroupDegree &&
         outgroupSequences + ingroupSequences >= minimumDegree &&
@@ -10,64 +10,99 @@
 #include <math.h>
 #include <stdlib.h>
 
-static void *getValue(stHash *hash, int64_t node) {
-    stIntTuple *nodeTuple = stIntTuple_construct1(node);
-    void *object = stHash_search(hash, nodeTuple);
-    stIntTuple_destruct(nodeTuple);
-    return object;
+typedef struct _greedyEdge {
+    int64_t score;
+    int64_t node1, node2; // Indices into the sorted array of node names
+    stIntTuple *edge;
+} GreedyEdge;
+
+static int int64_cmp(const int64_t *i, const int64_t *j) {
+    return *i < *j ? -1 : (*i > *j ? 1 : 0);
+}
+
+/*
+ * Best edge first, i.e. the reverse of the order of stIntTuple_cmpFn.
+ */
+static int greedyEdge_cmp(const GreedyEdge *edge1, const GreedyEdge *edge2) {
+    if (edge1->score != edge2->score) {
+        return edge1->score > edge2->score ? -1 : 1;
+    }
+    if (edge1->node1 != edge2->node1) {
+        return edge1->node1 > edge2->node1 ? -1 : 1;
+    }
+    return edge1->node2 > edge2->node2 ? -1 : (edge1->node2 < edge2->node2 ? 1 : 0);
+}
+
+static int64_t getNodeIndex(int64_t *nodeNames, int64_t nodeNumber, int64_t nodeName) {
+    int64_t *i = bsearch(&nodeName, nodeNames, nodeNumber, sizeof(int64_t), (int(*)(const void *, const void *)) int64_cmp);
+    assert(i != NULL);
+    return i - nodeNames;
+}
+
+static int64_t findComponent(int64_t *parents, int64_t i) {
+    while (parents[i] != i) {
+        parents[i] = parents[parents[i]];
+        i = parents[i];
+    }
+    return i;
 }
 
 stList *stCaf_breakupComponentGreedily(stList *nodes, stList *edges, int64_t maxComponentSize) {
     /*
-     * Make a component for each node in the graph
+     * Make a component for each node in the graph, as a union-find over the nodes in sorted order.
      */
-    stHash *nodeToComponents = stHash_construct3((uint64_t(*)(const void *)) stIntTuple_hashKey,
-            (int(*)(const void *, const void *)) stIntTuple_equalsFn, NULL, NULL);
-    stListIterator *listIt = stList_getIterator(nodes);
-    stIntTuple *node;
-    while ((node = stList_getNext(listIt)) != NULL) {
-        stSortedSet *component = stSortedSet_construct();
-        stSortedSet_insert(component, node);
-        assert(stHash_search(nodeToComponents, node) == NULL);
-        stHash_insert(nodeToComponents, node, component);
+    int64_t nodeNumber = stList_length(nodes);
+    int64_t *nodeNames = st_malloc(sizeof(int64_t) * (nodeNumber + 1));
+    for (int64_t i = 0; i < nodeNumber; i++) {
+        nodeNames[i] = stIntTuple_get(stList_get(nodes, i), 0);
+    }
+    qsort(nodeNames, nodeNumber, sizeof(int64_t), (int(*)(const void *, const void *)) int64_cmp);
+    int64_t *parents = st_malloc(sizeof(int64_t) * (nodeNumber + 1));
+    int64_t *sizes = st_malloc(sizeof(int64_t) * (nodeNumber + 1));
+    for (int64_t i = 0; i < nodeNumber; i++) {
+        assert(i == 0 || nodeNames[i - 1] < nodeNames[i]);
+        parents[i] = i;
+        sizes[i] = 1;
     }
-    stList_destructIterator(listIt);
 
-    stList *sortedEdges = stList_copy(edges, NULL); //copy, to avoid messing input
-    stList_sort(sortedEdges, (int(*)(const void *, const void *)) stIntTuple_cmpFn); //Sort in ascending order, so best edge first
-    int64_t edgeScore = INT64_MAX;
-    //While edges exist, try and put them into the graph.
+    /*
+     * Sort the edges, best first. The ordering of nodes by index is the same as by name, so
+     * the edges are considered in the same order as the stIntTuple ordering of the input.
+     */
+    int64_t edgeNumber = stList_length(edges);
+    GreedyEdge *sortedEdges = st_malloc(sizeof(GreedyEdge) * (edgeNumber + 1));
+    for (int64_t i = 0; i < edgeNumber; i++) {
+        stIntTuple *edge = stList_get(edges, i);
+        sortedEdges[i].score = stIntTuple_get(edge, 0);
+        sortedEdges[i].node1 = getNodeIndex(nodeNames, nodeNumber, stIntTuple_get(edge, 1));
+        sortedEdges[i].node2 = getNodeIndex(nodeNames, nodeNumber, stIntTuple_get(edge, 2));
+        sortedEdges[i].edge = edge;
+    }
+    qsort(sortedEdges, edgeNumber, sizeof(GreedyEdge), (int(*)(const void *, const void *)) greedyEdge_cmp);
+
+    //Try and put the edges into the graph, best first.
     stList *edgesToDelete = stList_construct();
-    int64_t totalComponents = stList_length(nodes);
-    while (stList_length(sortedEdges) > 0) {
-        stIntTuple *edge = stList_pop(sortedEdges);
-        assert(edgeScore >= stIntTuple_get(edge, 0));
-        edgeScore = stIntTuple_get(edge, 0);
-        stSortedSet *component1 = getValue(nodeToComponents, stIntTuple_get(edge, 1));
-        stSortedSet *component2 = getValue(nodeToComponents, stIntTuple_get(edge, 2));
-        assert(component1 != NULL && component2 != NULL);
+    int64_t totalComponents = nodeNumber;
+    for (int64_t i = 0; i < edgeNumber; i++) {
+        GreedyEdge *edge = &sortedEdges[i];
+        assert(i == 0 || sortedEdges[i - 1].score >= edge->score);
+        int64_t component1 = findComponent(parents, edge->node1);
+        int64_t component2 = findComponent(parents, edge->node2);
         if (component1 == component2) { //We're golden, as the edge is already contained within one component.
             continue;
         }
-        if (stSortedSet_size(component1) + stSortedSet_size(component2) > maxComponentSize) { //This edge would make a too large component, so reject
-            stList_append(edgesToDelete, edge);
+        if (sizes[component1] + sizes[component2] > maxComponentSize) { //This edge would make a too large component, so reject
+            stList_append(edgesToDelete, edge->edge);
             continue;
         }
-        //Merge the components and replace references in the hash.
-        if (stSortedSet_size(component1) < stSortedSet_size(component2)) {
-            stSortedSet *component3 = component1;
+        //Merge the smaller component into the larger.
+        if (sizes[component1] < sizes[component2]) {
+            int64_t component3 = component1;
             component1 = component2;
             component2 = component3;
         }
-        assert(stSortedSet_size(component1) >= stSortedSet_size(component2));
-        while (stSortedSet_size(component2) > 0) {
-            node = stSortedSet_getLast(component2);
-            stSortedSet_remove(component2, node);
-            assert(stSortedSet_search(component1, node) == NULL);
-            stSortedSet_insert(component1, node);
-            stHash_insert(nodeToComponents, node, component1);
-        }
-        stSortedSet_destruct(component2);
+        parents[component2] = component1;
+        sizes[component1] += sizes[component2];
         totalComponents -= 1;
     }
 
@@ -77,13 +112,10 @@ stList *stCaf_breakupComponentGreedily(stList *nodes, stList *edges, int64_t max
             stList_length(edges) - stList_length(edgesToDelete), stList_length(edgesToDelete));
 
     //Cleanup
-    stList_destruct(sortedEdges);
-    stList *components = stHash_getValues(nodeToComponents);
-    stSortedSet *componentsSet = stList_getSortedSet(components, NULL);
-    stList_destruct(components);
-    stSortedSet_setDestructor(componentsSet, (void(*)(void *)) stSortedSet_destruct);
-    stSortedSet_destruct(componentsSet);
-    stHash_destruct(nodeToComponents);
+    free(sortedEdges);
+    free(sizes);
+    free(parents);
+    free(nodeNames);
 
     return edgesToDelete;
 }
@@ -7,11 +7,71 @@
 
 #define _XOPEN_SOURCE 500
 
+#include <ctype.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "bioioC.h"
 #include "cactus.h"
 #include "sonLib.h"
 #include "pairwiseAlignment.h"
 #include "blastAlignmentLib.h"
+#include "stPinchIterator.h"
+#include "stLastzAlignments.h"
+
+/*
+ * Starts lastz (and optionally the realigner) on the sequences in the given fasta file, returning
+ * a stream of its cigars.
+ */
+static FILE *openLastzPipe(const char *lastzArgs, bool realign, const char *realignArgs, const char *tempFile1,
+        char **command) {
+    if(realign) {
+        *command = stString_print(
+                            "cPecanLastz --format=cigar %s %s[multiple][nameparse=darkspace] %s[nameparse=darkspace] --notrivial | cPecanRealign %s %s",
+                            lastzArgs, tempFile1, tempFile1, realignArgs, tempFile1);
+    }
+    else {
+        *command = stString_print(
+                "cPecanLastz --format=cigar %s %s[multiple][nameparse=darkspace] %s[nameparse=darkspace] --notrivial",
+                lastzArgs, tempFile1, tempFile1);
+    }
+    //char *command = stString_print(
+    //        "cPecanLastz --format=cigar %s %s[multiple][nameparse=darkspace] --self",
+    //        lastzArgs, tempFile1);
+    FILE *fileHandle = popen(*command, "r");
+    if (fileHandle == NULL) {
+        st_errAbort("Problems with lastz pipe");
+    }
+    return fileHandle;
+}
+
+static void closeLastzPipe(FILE *fileHandle, char *command) {
+    int i = pclose(fileHandle);
+    if(i != 0) {
+        st_errAbort("Lastz failed: %s\n", command);
+    }
+    free(command);
+}
+
+typedef struct _lastzStream {
+    FILE *fileHandle;
+    int64_t alignmentNumber;
+} LastzStream;
+
+/*
+ * Reads the next cigar from lastz, converting its coordinates to the flower's.
+ */
+static struct PairwiseAlignment *getNextLastzAlignment(LastzStream *stream) {
+    struct PairwiseAlignment *pairwiseAlignment = cigarRead(stream->fileHandle);
+    if (pairwiseAlignment != NULL) {
+        convertCoordinatesOfPairwiseAlignment(pairwiseAlignment, TRUE, TRUE);
+        stream->alignmentNumber++;
+    }
+    return pairwiseAlignment;
+}
 
 stList *stCaf_selfAlignFlower(Flower *flower, int64_t minimumSequenceLength, const char *lastzArgs,
         bool realign, const char *realignArgs,
@@ -25,45 +85,68 @@ stList *stCaf_selfAlignFlower(Flower *flower, int64_t minimumSequenceLength, con
         /*
          * Run lastz.
          */
-        char *command = NULL;
-        if(realign) {
-            command = stString_print(
-                                "cPecanLastz --format=cigar %s %s[multiple][nameparse=darkspace] %s[nameparse=darkspace] --notrivial | cPecanRealign %s %s",
-                                lastzArgs, tempFile1, tempFile1, realignArgs, tempFile1);
-        }
-        else {
-            command = stString_print(
-                    "cPecanLastz --format=cigar %s %s[multiple][nameparse=darkspace] %s[nameparse=darkspace] --notrivial",
-                    lastzArgs, tempFile1, tempFile1);
-        }
-        //char *command = stString_print(
-        //        "cPecanLastz --format=cigar %s %s[multiple][nameparse=darkspace] --self",
-        //        lastzArgs, tempFile1);
-        FILE *fileHandle = popen(command, "r");
-        if (fileHandle == NULL) {
-            st_errAbort("Problems with lastz pipe");
-        }
+        char *command;
+        LastzStream stream = { openLastzPipe(lastzArgs, realign, realignArgs, tempFile1, &command), 0 };
 
         /*
          * Process the cigars, modifying their coordinates.
          */
         //Read from stream
         struct PairwiseAlignment *pairwiseAlignment;
-        while ((pairwiseAlignment = cigarRead(fileHandle)) != NULL) {
-            convertCoordinatesOfPairwiseAlignment(pairwiseAlignment, TRUE, TRUE);
+        while ((pairwiseAlignment = getNextLastzAlignment(&stream)) != NULL) {
             stList_append(cigars, pairwiseAlignment);
         }
-        int i = pclose(fileHandle);
-        if(i != 0) {
-            st_errAbort("Lastz failed: %s\n", command);
-        }
-        free(command);
+        closeLastzPipe(stream.fileHandle, command);
     }
     //st_system("rm %s", tempFile1);
 
     return cigars;
 }
 
+int64_t stCaf_selfAlignFlowerToBinaryPinchFile(Flower *flower, int64_t minimumSequenceLength, const char *lastzArgs,
+        bool realign, const char *realignArgs, char *tempFile1, const char *binaryPinchFile,
+        bool sortAlignments, int64_t threadNumber, int64_t memoryBudget) {
+    if (writeFlowerSequencesInFile(flower, tempFile1, minimumSequenceLength) == 0) {
+        // Nothing to align, so write a pinch file with no records.
+        stList *noAlignments = stList_construct();
+        stListIterator *it = stList_getIterator(noAlignments);
+        stPinchIterator_writeBinaryFileFromAlignments(it, (struct PairwiseAlignment *(*)(void *)) stList_getNext,
+                binaryPinchFile);
+        stList_destructIterator(it);
+        stList_destruct(noAlignments);
+        return 0;
+    }
+    char *command;
+    LastzStream stream = { openLastzPipe(lastzArgs, realign, realignArgs, tempFile1, &command), 0 };
+    if (!sortAlignments) {
+        // Each alignment is turned into pinches and freed as soon as it is read.
+        stPinchIterator_writeBinaryFileFromAlignments(&stream,
+                (struct PairwiseAlignment *(*)(void *)) getNextLastzAlignment, binaryPinchFile);
+        closeLastzPipe(stream.fileHandle, command);
+        return stream.alignmentNumber;
+    }
+    // The alignments are spooled to disk as they are read, then sorted within
+    // the memory budget straight into the binary pinch file.
+    char *cigarsFile = stString_print("%s.cigars", binaryPinchFile);
+    FILE *cigarsHandle = fopen(cigarsFile, "w");
+    if (cigarsHandle == NULL) {
+        st_errAbort("Could not open cigars file: %s\n", cigarsFile);
+    }
+    struct PairwiseAlignment *pairwiseAlignment;
+    while ((pairwiseAlignment = getNextLastzAlignment(&stream)) != NULL) {
+        cigarWrite(cigarsHandle, pairwiseAlignment, 0);
+        destructPairwiseAlignment(pairwiseAlignment);
+    }
+    closeLastzPipe(stream.fileHandle, command);
+    if (fclose(cigarsHandle) != 0) {
+        st_errAbort("Failed to write cigars file: %s\n", cigarsFile);
+    }
+    stCaf_sortCigarsFile(cigarsFile, binaryPinchFile, 1, threadNumber, memoryBudget);
+    unlink(cigarsFile);
+    free(cigarsFile);
+    return stream.alignmentNumber;
+}
+
 static int compareByScore(struct PairwiseAlignment *pA, struct PairwiseAlignment *pA2) {
     return pA->score == pA2->score ? 0 : (pA->score > pA2->score ? -1 : 1);
 }
@@ -80,23 +163,358 @@ void stCaf_sortCigarsByScoreInDescendingOrder(stList *cigars) {
 #endif
 }
 
-void stCaf_sortCigarsFileByScoreInDescendingOrder(char *cigarsFile, char *sortedFile) {
-    int64_t i = st_system("sort -k10,10nr -k2,2 %s > %s", cigarsFile, sortedFile);
-    if(i != 0) {
-        st_errAbort("Encountered unix sort error when sorting cigar alignments in file: %s\n", cigarsFile);
+/*
+ * External sort of cigar files by score. Only a compact key (score, offset, length) is kept for
+ * each record; runs of keys that fit in the memory budget are sorted by several threads, spilled
+ * to disk if there is more than one run, and finally merged. The records are then copied, or
+ * converted to pinches, in sorted order straight from the input file.
+ */
+
+#define CIGAR_SORT_DEFAULT_MEMORY_BUDGET 1073741824
+#define CIGAR_SORT_MAX_THREADS 16
+#define CIGAR_SORT_READ_BUFFER 65536
+#define CIGAR_SORT_MAX_RUNS 64
+
+typedef struct _cigarSortKey {
+    double score;
+    int64_t offset;
+    int64_t length;
+} CigarSortKey;
+
+typedef struct _cigarSortStream {
+    CigarSortKey *keys;
+    int64_t length, index;
+    FILE *file; // NULL if the keys are an in-memory chunk of a run
+} CigarSortStream;
+
+typedef struct _cigarSorter {
+    const char *cigarsFile;
+    char *map;
+    size_t mapSize;
+    CigarSortKey *keys;
+    stList *streams;
+    stList *runFiles;
+    double lastScore;
+    FILE *cigarsHandle;
+} CigarSorter;
+
+/*
+ * Descending by score, ties broken by position in the input, so the sort is stable.
+ */
+static int cigarSortKey_cmp(const void *a, const void *b) {
+    const CigarSortKey *key1 = a, *key2 = b;
+    if (key1->score != key2->score) {
+        return key1->score > key2->score ? -1 : 1;
     }
-    i = st_system("chmod 777 %s", sortedFile);
-    if(i != 0) {
-        st_errAbort("Encountered error when changing file permissions: %s\n", cigarsFile);
+    return key1->offset < key2->offset ? -1 : (key1->offset > key2->offset ? 1 : 0);
+}
+
+/*
+ * The score is the tenth whitespace separated field of a cigar line.
+ */
+static double getCigarScore(const char *line, int64_t length, const char *cigarsFile) {
+    int64_t i = 0;
+    for (int64_t field = 0; field < 9; field++) {
+        while (i < length && !isspace(line[i])) {
+            i++;
+        }
+        while (i < length && isspace(line[i])) {
+            i++;
+        }
     }
-#ifndef NDEBUG
-    double score = INT64_MAX;
-    FILE *fileHandle = fopen(sortedFile, "r");
-    struct PairwiseAlignment *pA;
-    while ((pA = cigarRead(fileHandle)) != NULL) {
-        assert(pA->score <= score);
-        score = pA->score;
-    }
-    fclose(fileHandle);
-#endif
+    char scoreString[64];
+    int64_t j = 0;
+    while (i < length && !isspace(line[i]) && j < (int64_t) sizeof(scoreString) - 1) {
+        scoreString[j++] = line[i++];
+    }
+    scoreString[j] = '\0';
+    char *end;
+    double score = strtod(scoreString, &end);
+    if (j == 0 || *end != '\0') {
+        st_errAbort("Could not parse the score of a cigar line in file: %s\n", cigarsFile);
+    }
+    return score;
+}
+
+static CigarSortStream *cigarSortStream_construct(CigarSortKey *keys, int64_t length, FILE *file) {
+    CigarSortStream *stream = st_calloc(1, sizeof(CigarSortStream));
+    stream->keys = keys;
+    stream->length = length;
+    stream->file = file;
+    return stream;
+}
+
+static void cigarSortStream_destruct(CigarSortStream *stream) {
+    if (stream->file != NULL) {
+        fclose(stream->file);
+        free(stream->keys);
+    }
+    free(stream);
+}
+
+static CigarSortKey *cigarSortStream_peek(CigarSortStream *stream) {
+    if (stream->index == stream->length && stream->file != NULL) {
+        stream->length = fread(stream->keys, sizeof(CigarSortKey), CIGAR_SORT_READ_BUFFER, stream->file);
+        stream->index = 0;
+    }
+    return stream->index < stream->length ? &stream->keys[stream->index] : NULL;
+}
+
+/*
+ * Removes the smallest key from a set of sorted streams. The number of streams is small
+ * (threads plus spilled runs), so a linear scan is fine.
+ */
+static bool mergeSortStreams(stList *streams, CigarSortKey *key) {
+    CigarSortStream *minStream = NULL;
+    CigarSortKey *minKey = NULL;
+    for (int64_t i = 0; i < stList_length(streams); i++) {
+        CigarSortStream *stream = stList_get(streams, i);
+        CigarSortKey *streamKey = cigarSortStream_peek(stream);
+        if (streamKey != NULL && (minKey == NULL || cigarSortKey_cmp(streamKey, minKey) < 0)) {
+            minStream = stream;
+            minKey = streamKey;
+        }
+    }
+    if (minStream == NULL) {
+        return 0;
+    }
+    *key = *minKey;
+    minStream->index++;
+    return 1;
+}
+
+static void *sortCigarSortStream(void *stream) {
+    qsort(((CigarSortStream *) stream)->keys, ((CigarSortStream *) stream)->length, sizeof(CigarSortKey),
+            cigarSortKey_cmp);
+    return NULL;
+}
+
+/*
+ * Sorts a run of keys as threadNumber chunks in parallel, returning a list of sorted in-memory streams.
+ */
+static stList *sortRun(CigarSortKey *keys, int64_t length, int64_t threadNumber) {
+    stList *streams = stList_construct3(0, (void (*)(void *)) cigarSortStream_destruct);
+    int64_t chunkSize = (length + threadNumber - 1) / threadNumber;
+    for (int64_t i = 0; i < length; i += chunkSize) {
+        stList_append(streams, cigarSortStream_construct(keys + i, i + chunkSize < length ? chunkSize : length - i, NULL));
+    }
+    pthread_t *threads = st_malloc(sizeof(pthread_t) * (stList_length(streams) + 1));
+    for (int64_t i = 1; i < stList_length(streams); i++) {
+        if (pthread_create(&threads[i], NULL, sortCigarSortStream, stList_get(streams, i)) != 0) {
+            st_errAbort("Could not create a thread to sort cigars");
+        }
+    }
+    if (stList_length(streams) > 0) {
+        sortCigarSortStream(stList_get(streams, 0));
+    }
+    for (int64_t i = 1; i < stList_length(streams); i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    return streams;
+}
+
+/*
+ * Sorts the keys collected so far and writes them, merged, to a new run file.
+ */
+static void spillRun(CigarSorter *sorter, const char *outputFile, int64_t length, int64_t threadNumber) {
+    char *runFile = stString_print("%s.run%" PRIi64, outputFile, stList_length(sorter->runFiles));
+    stList_append(sorter->runFiles, runFile);
+    FILE *fileHandle = fopen(runFile, "w");
+    if (fileHandle == NULL) {
+        st_errAbort("Could not open temporary sort file: %s\n", runFile);
+    }
+    stList *streams = sortRun(sorter->keys, length, threadNumber);
+    CigarSortKey key;
+    while (mergeSortStreams(streams, &key)) {
+        if (fwrite(&key, sizeof(CigarSortKey), 1, fileHandle) != 1) {
+            st_errAbort("Could not write temporary sort file: %s\n", runFile);
+        }
+    }
+    stList_destruct(streams);
+    if (fclose(fileHandle) != 0) {
+        st_errAbort("Could not write temporary sort file: %s\n", runFile);
+    }
+}
+
+static CigarSortStream *openRunFile(const char *runFile) {
+    FILE *fileHandle = fopen(runFile, "r");
+    if (fileHandle == NULL) {
+        st_errAbort("Could not open temporary sort file: %s\n", runFile);
+    }
+    return cigarSortStream_construct(st_malloc(sizeof(CigarSortKey) * CIGAR_SORT_READ_BUFFER), 0, fileHandle);
+}
+
+/*
+ * Merges all the spilled runs into one, to bound the number of open files in the final merge.
+ */
+static void mergeRunFiles(CigarSorter *sorter, const char *outputFile) {
+    stList *streams = stList_construct3(0, (void (*)(void *)) cigarSortStream_destruct);
+    for (int64_t i = 0; i < stList_length(sorter->runFiles); i++) {
+        stList_append(streams, openRunFile(stList_get(sorter->runFiles, i)));
+    }
+    char *mergedFile = stString_print("%s.merged", outputFile);
+    FILE *fileHandle = fopen(mergedFile, "w");
+    if (fileHandle == NULL) {
+        st_errAbort("Could not open temporary sort file: %s\n", mergedFile);
+    }
+    CigarSortKey key;
+    while (mergeSortStreams(streams, &key)) {
+        if (fwrite(&key, sizeof(CigarSortKey), 1, fileHandle) != 1) {
+            st_errAbort("Could not write temporary sort file: %s\n", mergedFile);
+        }
+    }
+    if (fclose(fileHandle) != 0) {
+        st_errAbort("Could not write temporary sort file: %s\n", mergedFile);
+    }
+    stList_destruct(streams);
+    while (stList_length(sorter->runFiles) > 1) {
+        char *runFile = stList_pop(sorter->runFiles);
+        remove(runFile);
+        free(runFile);
+    }
+    if (rename(mergedFile, stList_get(sorter->runFiles, 0)) != 0) {
+        st_errAbort("Could not rename temporary sort file: %s\n", mergedFile);
+    }
+    free(mergedFile);
+}
+
+static CigarSorter *cigarSorter_construct(const char *cigarsFile, const char *outputFile, int64_t threadNumber,
+        int64_t memoryBudget) {
+    if (threadNumber <= 0) {
+        threadNumber = sysconf(_SC_NPROCESSORS_ONLN);
+        threadNumber = threadNumber < 1 ? 1 : (threadNumber > CIGAR_SORT_MAX_THREADS ? CIGAR_SORT_MAX_THREADS : threadNumber);
+    }
+    if (memoryBudget <= 0) {
+        memoryBudget = CIGAR_SORT_DEFAULT_MEMORY_BUDGET;
+    }
+    int64_t maxRunLength = memoryBudget / sizeof(CigarSortKey);
+    maxRunLength = maxRunLength < 1 ? 1 : maxRunLength;
+
+    CigarSorter *sorter = st_calloc(1, sizeof(CigarSorter));
+    sorter->cigarsFile = cigarsFile;
+    sorter->runFiles = stList_construct3(0, free);
+    sorter->lastScore = INFINITY;
+    int fd = open(cigarsFile, O_RDONLY);
+    struct stat fileStat;
+    if (fd < 0 || fstat(fd, &fileStat) != 0) {
+        st_errAbort("Could not open cigars file: %s\n", cigarsFile);
+    }
+    sorter->mapSize = fileStat.st_size;
+    if (sorter->mapSize > 0) {
+        sorter->map = mmap(NULL, sorter->mapSize, PROT_READ, MAP_SHARED, fd, 0);
+        if (sorter->map == MAP_FAILED) {
+            st_errAbort("Could not map cigars file: %s\n", cigarsFile);
+        }
+    }
+    close(fd);
+
+    // Collect the keys, spilling sorted runs whenever the budget is used up
+    int64_t keyNumber = 0, keyCapacity = 1024;
+    sorter->keys = st_malloc(sizeof(CigarSortKey) * keyCapacity);
+    size_t offset = 0;
+    while (offset < sorter->mapSize) {
+        char *line = sorter->map + offset;
+        char *newLine = memchr(line, '\n', sorter->mapSize - offset);
+        int64_t length = newLine != NULL ? newLine - line : (int64_t) (sorter->mapSize - offset);
+        if (length > 0) {
+            if (keyNumber == maxRunLength) {
+                if (stList_length(sorter->runFiles) == CIGAR_SORT_MAX_RUNS) {
+                    mergeRunFiles(sorter, outputFile);
+                }
+                spillRun(sorter, outputFile, keyNumber, threadNumber);
+                keyNumber = 0;
+            }
+            if (keyNumber == keyCapacity) {
+                keyCapacity = keyCapacity * 2 < maxRunLength ? keyCapacity * 2 : maxRunLength;
+                sorter->keys = st_realloc(sorter->keys, sizeof(CigarSortKey) * keyCapacity);
+            }
+            CigarSortKey *key = &sorter->keys[keyNumber++];
+            key->score = getCigarScore(line, length, cigarsFile);
+            key->offset = offset;
+            key->length = length;
+        }
+        offset += length + 1;
+    }
+
+    // The last run is merged straight from memory with any spilled runs
+    sorter->streams = sortRun(sorter->keys, keyNumber, threadNumber);
+    for (int64_t i = 0; i < stList_length(sorter->runFiles); i++) {
+        stList_append(sorter->streams, openRunFile(stList_get(sorter->runFiles, i)));
+    }
+    st_logDebug("Sorting %" PRIi64 " bytes of cigars from %s using %" PRIi64 " threads and %" PRIi64 " spilled runs\n",
+            (int64_t) sorter->mapSize, cigarsFile, threadNumber, stList_length(sorter->runFiles));
+    return sorter;
+}
+
+static bool cigarSorter_getNext(CigarSorter *sorter, CigarSortKey *key) {
+    if (!mergeSortStreams(sorter->streams, key)) {
+        return 0;
+    }
+    assert(key->score <= sorter->lastScore);
+    sorter->lastScore = key->score;
+    return 1;
+}
+
+static struct PairwiseAlignment *cigarSorter_getNextAlignment(CigarSorter *sorter) {
+    CigarSortKey key;
+    if (!cigarSorter_getNext(sorter, &key)) {
+        return NULL;
+    }
+    if (fseeko(sorter->cigarsHandle, key.offset, SEEK_SET) != 0) {
+        st_errAbort("Could not seek in cigars file: %s\n", sorter->cigarsFile);
+    }
+    struct PairwiseAlignment *pairwiseAlignment = cigarRead(sorter->cigarsHandle);
+    if (pairwiseAlignment == NULL) {
+        st_errAbort("Could not parse a cigar in file: %s\n", sorter->cigarsFile);
+    }
+    return pairwiseAlignment;
+}
+
+static void cigarSorter_destruct(CigarSorter *sorter) {
+    stList_destruct(sorter->streams);
+    for (int64_t i = 0; i < stList_length(sorter->runFiles); i++) {
+        remove(stList_get(sorter->runFiles, i));
+    }
+    stList_destruct(sorter->runFiles);
+    if (sorter->map != NULL) {
+        munmap(sorter->map, sorter->mapSize);
+    }
+    free(sorter->keys);
+    free(sorter);
+}
+
+void stCaf_sortCigarsFile(const char *cigarsFile, const char *outputFile, bool binaryPinchOutput,
+        int64_t threadNumber, int64_t memoryBudget) {
+    CigarSorter *sorter = cigarSorter_construct(cigarsFile, outputFile, threadNumber, memoryBudget);
+    if (binaryPinchOutput) {
+        sorter->cigarsHandle = fopen(cigarsFile, "r");
+        if (sorter->cigarsHandle == NULL) {
+            st_errAbort("Could not open cigars file: %s\n", cigarsFile);
+        }
+        stPinchIterator_writeBinaryFileFromAlignments(sorter,
+                (struct PairwiseAlignment *(*)(void *)) cigarSorter_getNextAlignment, outputFile);
+        fclose(sorter->cigarsHandle);
+    } else {
+        FILE *fileHandle = fopen(outputFile, "w");
+        if (fileHandle == NULL) {
+            st_errAbort("Could not open sorted cigars file: %s\n", outputFile);
+        }
+        CigarSortKey key;
+        while (cigarSorter_getNext(sorter, &key)) {
+            fwrite(sorter->map + key.offset, 1, key.length, fileHandle);
+            fputc('\n', fileHandle);
+        }
+        if (fclose(fileHandle) != 0) {
+            st_errAbort("Encountered an error writing sorted cigars file: %s\n", outputFile);
+        }
+    }
+    cigarSorter_destruct(sorter);
+    if (chmod(outputFile, 0777) != 0) {
+        st_errAbort("Encountered error when changing file permissions: %s\n", outputFile);
+    }
+}
+
+void stCaf_sortCigarsFileByScoreInDescendingOrder(char *cigarsFile, char *sortedFile) {
+    stCaf_sortCigarsFile(cigarsFile, sortedFile, 0, 0, 0);
 }
@@ -1,3 +1,4 @@
+#include <pthread.h>
 #include "sonLib.h"
 #include "cactus.h"
 #include "stPinchGraphs.h"
@@ -96,16 +97,127 @@ static void trimAlignments(stPinchThreadSet *threadSet, int64_t blockEndTrim) {
     }
 }
 
-static void filterAlignments(stPinchThreadSet *threadSet, bool(*blockFilterFn)(stPinchBlock *)) {
+///////////////////////////////////////////////////////////////////////////
+// Parallel evaluation of read-only block predicates
+///////////////////////////////////////////////////////////////////////////
+
+#define BLOCK_SCAN_CHUNK_SIZE 1024
+
+static int64_t numBlockScanThreads = 1;
+
+void stCaf_setNumBlockScanThreads(int64_t threadNumber) {
+    numBlockScanThreads = threadNumber < 1 ? 1 : threadNumber;
+}
+
+stList *stCaf_getBlocks(stPinchThreadSet *threadSet) {
+    stList *blocks = stList_construct();
     stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
-    stPinchBlock *block = stPinchThreadSetBlockIt_getNext(&blockIt);
-    while (block != NULL) {
-        stPinchBlock *block2 = stPinchThreadSetBlockIt_getNext(&blockIt);
-        if (!isThreadEnd(block) && blockFilterFn(block)) {
-            stPinchBlock_destruct(block);
+    stPinchBlock *block;
+    while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+        stList_append(blocks, block);
+    }
+    return blocks;
+}
+
+typedef struct _blockMap {
+    stList *blocks;
+    void (*fn)(stPinchBlock *, int64_t, void *);
+    void *extraArg;
+    int64_t nextBlock;
+    pthread_mutex_t mutex;
+} BlockMap;
+
+static void *mapBlocks(BlockMap *map) {
+    int64_t blockNumber = stList_length(map->blocks);
+    while (1) {
+        // Hand out the blocks in chunks, as the cost of a function
+        // usually grows with the degree of the block.
+        pthread_mutex_lock(&map->mutex);
+        int64_t start = map->nextBlock;
+        map->nextBlock += BLOCK_SCAN_CHUNK_SIZE;
+        pthread_mutex_unlock(&map->mutex);
+        if (start >= blockNumber) {
+            return NULL;
+        }
+        int64_t end = start + BLOCK_SCAN_CHUNK_SIZE < blockNumber ? start + BLOCK_SCAN_CHUNK_SIZE : blockNumber;
+        for (int64_t i = start; i < end; i++) {
+            map->fn(stList_get(map->blocks, i), i, map->extraArg);
+        }
+    }
+}
+
+void stCaf_mapBlocks(stList *blocks, void (*fn)(stPinchBlock *, int64_t, void *), void *extraArg,
+        int64_t threadNumber) {
+    BlockMap map;
+    map.blocks = blocks;
+    map.fn = fn;
+    map.extraArg = extraArg;
+    map.nextBlock = 0;
+    int64_t chunkNumber = (stList_length(blocks) + BLOCK_SCAN_CHUNK_SIZE - 1) / BLOCK_SCAN_CHUNK_SIZE;
+    int64_t workerNumber = threadNumber < chunkNumber ? threadNumber : chunkNumber;
+    if (workerNumber <= 1) {
+        for (int64_t i = 0; i < stList_length(blocks); i++) {
+            fn(stList_get(blocks, i), i, extraArg);
+        }
+        return;
+    }
+    pthread_mutex_init(&map.mutex, NULL);
+    pthread_t *workers = st_malloc(sizeof(pthread_t) * workerNumber);
+    for (int64_t i = 1; i < workerNumber; i++) {
+        if (pthread_create(&workers[i], NULL, (void *(*)(void *)) mapBlocks, &map) != 0) {
+            st_errAbort("Could not create a block scanning thread");
         }
-        block = block2;
     }
+    mapBlocks(&map);
+    for (int64_t i = 1; i < workerNumber; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    pthread_mutex_destroy(&map.mutex);
+}
+
+typedef struct _blockScan {
+    bool *results;
+    bool (*predicate)(stPinchBlock *, void *);
+    void *extraArg;
+} BlockScan;
+
+static void scanBlock(stPinchBlock *block, int64_t index, BlockScan *scan) {
+    scan->results[index] = scan->predicate(block, scan->extraArg);
+}
+
+bool *stCaf_scanBlocks(stList *blocks, bool (*predicate)(stPinchBlock *, void *), void *extraArg,
+        int64_t threadNumber) {
+    BlockScan scan;
+    scan.results = st_calloc(stList_length(blocks) + 1, sizeof(bool));
+    scan.predicate = predicate;
+    scan.extraArg = extraArg;
+    stCaf_mapBlocks(blocks, (void (*)(stPinchBlock *, int64_t, void *)) scanBlock, &scan, threadNumber);
+    return scan.results;
+}
+
+typedef struct _blockFilter {
+    bool (*blockFilterFn)(stPinchBlock *);
+} BlockFilter;
+
+static bool isFilteredBlock(stPinchBlock *block, BlockFilter *filter) {
+    return !isThreadEnd(block) && filter->blockFilterFn(block);
+}
+
+static void filterAlignments(stPinchThreadSet *threadSet, bool(*blockFilterFn)(stPinchBlock *)) {
+    // The filter only reads the graph, so evaluate it over all the
+    // blocks first and then destroy the filtered blocks serially.
+    BlockFilter filter = { blockFilterFn };
+    stList *blocks = stCaf_getBlocks(threadSet);
+    bool *filtered = stCaf_scanBlocks(blocks, (bool (*)(stPinchBlock *, void *)) isFilteredBlock,
+            &filter, numBlockScanThreads);
+    for (int64_t i = 0; i < stList_length(blocks); i++) {
+        if (filtered[i]) {
+            stPinchBlock_destruct(stList_get(blocks, i));
+        }
+    }
+    free(filtered);
+    stList_destruct(blocks);
 }
 
 void stCaf_melt(Flower *flower, stPinchThreadSet *threadSet, bool blockFilterfn(stPinchBlock *), int64_t blockEndTrim,
@@ -142,6 +254,90 @@ void stCaf_melt(Flower *flower, stPinchThreadSet *threadSet, bool blockFilterfn(
     stCaf_joinTrivialBoundaries(threadSet);
 }
 
+static int64_t getThreadComponentNumber(stPinchThreadSet *threadSet) {
+    stSortedSet *threadComponents = stPinchThreadSet_getThreadComponents(threadSet);
+    int64_t threadComponentNumber = stSortedSet_size(threadComponents);
+    stSortedSet_destruct(threadComponents);
+    return threadComponentNumber;
+}
+
+/*
+ * Contracting the blocks of a chain merges the cactus nodes along it but leaves the
+ * other chains, and so their lengths, as they were. The chains of a single cactus
+ * graph can therefore be melted for a series of increasing thresholds without
+ * rebuilding the graph between rounds. The exception is a melt that splits a thread
+ * component in the top level flower: building the graph afresh would attach the new
+ * component to the dead end component, which can break up the chains between them, so
+ * the remaining rounds are then done from a new graph, as repeated calls to stCaf_melt
+ * would.
+ */
+void stCaf_meltInRounds(Flower *flower, stPinchThreadSet *threadSet, int64_t *minimumChainLengths, int64_t roundNumber) {
+    int64_t round = 0;
+    if (roundNumber > 0 && minimumChainLengths[roundNumber - 1] > 1) {
+        stCactusNode *startCactusNode;
+        stList *deadEndComponent;
+        stCactusGraph *cactusGraph = stCaf_getCactusGraphForThreadSet(flower, threadSet, &startCactusNode, &deadEndComponent, 0, INT64_MAX,
+                0.0, 0, INT64_MAX);
+        bool checkThreadComponents = roundNumber > 1 && flower_getName(flower) == 0;
+        int64_t threadComponentNumber = checkThreadComponents ? getThreadComponentNumber(threadSet) : 0;
+
+        //Record the length of every chain
+        stList *chainEnds = stList_construct();
+        stList *chainLengths = stList_construct3(0, (void(*)(void *)) stIntTuple_destruct);
+        stCactusGraphNodeIt *nodeIt = stCactusGraphNodeIterator_construct(cactusGraph);
+        stCactusNode *cactusNode;
+        while ((cactusNode = stCactusGraphNodeIterator_getNext(nodeIt)) != NULL) {
+            stCactusNodeEdgeEndIt cactusEdgeEndIt = stCactusNode_getEdgeEndIt(cactusNode);
+            stCactusEdgeEnd *cactusEdgeEnd;
+            while ((cactusEdgeEnd = stCactusNodeEdgeEndIt_getNext(&cactusEdgeEndIt)) != NULL) {
+                if (stCactusEdgeEnd_isChainEnd(cactusEdgeEnd) && stCactusEdgeEnd_getLinkOrientation(cactusEdgeEnd)) {
+                    stList_append(chainEnds, cactusEdgeEnd);
+                    stList_append(chainLengths, stIntTuple_construct1(getChainLength(cactusEdgeEnd)));
+                }
+            }
+        }
+        stCactusGraphNodeIterator_destruct(nodeIt);
+
+        //Each round destroys the chains shorter than its threshold that survived the previous rounds
+        int64_t previousMinimumChainLength = 0;
+        while (round < roundNumber) {
+            int64_t minimumChainLength = minimumChainLengths[round++];
+            assert(minimumChainLength >= previousMinimumChainLength);
+            st_logDebug("Starting melting round with a minimum chain length of %" PRIi64 " \n", minimumChainLength);
+            stList *blocksToDelete = stList_construct3(0, (void(*)(void *)) stPinchBlock_destruct);
+            for (int64_t i = 0; i < stList_length(chainEnds); i++) {
+                int64_t chainLength = stIntTuple_get(stList_get(chainLengths, i), 0);
+                if (chainLength >= previousMinimumChainLength && chainLength < minimumChainLength) {
+                    addChainBlocksToBlocksToDelete(stList_get(chainEnds, i), blocksToDelete);
+                }
+            }
+            printf("A melting round is destroying %" PRIi64 " blocks with an average degree "
+                   "of %lf from chains with length less than %" PRIi64 ". Total aligned bases"
+                   " lost: %" PRIu64 "\n",
+                   stList_length(blocksToDelete), stCaf_averageBlockDegree(blocksToDelete),
+                   minimumChainLength, stCaf_totalAlignedBases(blocksToDelete));
+            bool blocksDestroyed = stList_length(blocksToDelete) > 0;
+            stList_destruct(blocksToDelete); //This will destroy the blocks
+            previousMinimumChainLength = minimumChainLength;
+            if (checkThreadComponents && blocksDestroyed && round < roundNumber
+                    && getThreadComponentNumber(threadSet) != threadComponentNumber) {
+                break;
+            }
+        }
+
+        //Cleanup cactus
+        stList_destruct(chainLengths);
+        stList_destruct(chainEnds);
+        stCactusGraph_destruct(cactusGraph);
+    }
+    //Now heal up the trivial boundaries
+    stCaf_joinTrivialBoundaries(threadSet);
+    if (round > 0 && round < roundNumber) {
+        //A thread component was split, so do the remaining rounds from a new graph
+        stCaf_meltInRounds(flower, threadSet, minimumChainLengths + round, roundNumber - round);
+    }
+}
+
 static bool isTelomere(stPinchEnd *end, stSet *deadEndComponent) {
     stPinchSegment *segment = stPinchBlock_getFirst(end->block);
     bool atEndOfThread = stPinchThread_getFirst(stPinchSegment_getThread(segment)) == segment || stPinchThread_getLast(stPinchSegment_getThread(segment)) == segment;
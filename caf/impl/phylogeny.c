@@ -5,6 +5,7 @@
  *      Author: benedictpaten
  */
 
+#include <sys/time.h>
 #include "sonLib.h"
 #include "cactus.h"
 #include "stPinchGraphs.h"
@@ -45,6 +46,7 @@ typedef struct {
     HomologyUnit *homologyUnit;
     bool wasSimple;
     bool wasSingleCopy;
+    double buildTime; // Wall-clock seconds spent building the tree.
 } TreeBuildingResult;
 
 // Globals for collecting statistics that are later output.  Globals
@@ -59,6 +61,10 @@ static int64_t numberOfSplitsMade = 0;
 // FIXME: (Dec 4): Remove these after the first whole-genome tests.
 static int64_t numSimpleBlocksSkipped = 0;
 static int64_t numSingleCopyBlocksSkipped = 0;
+// Time spent inside tree-building workers during the current round,
+// and the longest single unit, for the utilisation report.
+static double treeBuildingBusyTime = 0.0;
+static double treeBuildingLongestUnitTime = 0.0;
 static FILE *gDebugFile;
 static stHash *gThreadStrings;
 
@@ -86,10 +92,15 @@ stHash *stCaf_getThreadStrings(Flower *flower, stPinchThreadSet *threadSet) {
         Sequence *sequence = cap_getSequence(cap);
         assert(sequence != NULL);
         assert(stPinchThread_getLength(thread)-2 >= 0);
-        char *string = sequence_getString(sequence, stPinchThread_getStart(thread)+1, stPinchThread_getLength(thread)-2, 1); //Gets the sequence excluding the empty positions representing the caps.
-        char *paddedString = stString_print_r("N%sN", string); //Add in positions to represent the flanking bases
-        stHash_insert(threadStrings, thread, paddedString);
-        free(string);
+        int64_t length = stPinchThread_getLength(thread)-2;
+        char *string = sequence_getString(sequence, stPinchThread_getStart(thread)+1, length, 1); //Gets the sequence excluding the empty positions representing the caps.
+        //Add in positions to represent the flanking bases, in place rather than by printing a copy
+        string = st_realloc(string, length + 3);
+        memmove(string + 1, string, length);
+        string[0] = 'N';
+        string[length + 1] = 'N';
+        string[length + 2] = '\0';
+        stHash_insert(threadStrings, thread, string);
     }
     gThreadStrings = threadStrings;
     return threadStrings;
@@ -124,6 +135,34 @@ stPinchBlock *getCanonicalBlockForHomologyUnit(HomologyUnit *unit) {
     return block;
 }
 
+// Gets a seed for the random choices made building a unit's trees
+// from the lowest (thread, position) among the segments of its
+// canonical block, along with the block's degree and the chain length,
+// none of which depend on the order in which blocks were pinched or
+// units were built.
+static unsigned int getSeedForHomologyUnit(HomologyUnit *unit) {
+    stPinchBlock *block = getCanonicalBlockForHomologyUnit(unit);
+    stPinchBlockIt blockIt = stPinchBlock_getSegmentIterator(block);
+    stPinchSegment *segment = stPinchBlockIt_getNext(&blockIt);
+    Name minName = stPinchSegment_getName(segment);
+    int64_t minStart = stPinchSegment_getStart(segment);
+    while ((segment = stPinchBlockIt_getNext(&blockIt)) != NULL) {
+        Name name = stPinchSegment_getName(segment);
+        int64_t start = stPinchSegment_getStart(segment);
+        if (name < minName || (name == minName && start < minStart)) {
+            minName = name;
+            minStart = start;
+        }
+    }
+    int64_t keys[] = { minName, minStart, stPinchBlock_getDegree(block),
+                       unit->unitType == CHAIN ? stList_length(unit->unit) : 1 };
+    uint64_t hash = 0xCBF29CE484222325ULL; // FNV-1a over the keys
+    for (int64_t i = 0; i < 4; i++) {
+        hash = (hash ^ (uint64_t) keys[i]) * 0x100000001B3ULL;
+    }
+    return (unsigned int) (hash ^ (hash >> 32));
+}
+
 /*
  * Gets a list of the segments in the block that are part of outgroup threads.
  * The list contains stIntTuples, each of length 1, representing the index of a particular segment in
@@ -500,8 +539,30 @@ static double scoreTree(stTree *tree, enum stCaf_ScoringMethod scoringMethod, st
     return ret;
 }
 
+// Combine the substitution and breakpoint distance matrices into a
+// single distance matrix, scaling each by its factor. Done in place in
+// the substitution matrix rather than scaling both and adding them
+// into a third matrix.
+static stMatrix *combineDistanceMatrices(stMatrix *substitutionDistanceMatrix,
+                                         stMatrix *breakpointDistanceMatrix,
+                                         double nucleotideScalingFactor,
+                                         double breakpointScalingFactor) {
+    assert(stMatrix_m(substitutionDistanceMatrix) == stMatrix_m(breakpointDistanceMatrix));
+    assert(stMatrix_n(substitutionDistanceMatrix) == stMatrix_n(breakpointDistanceMatrix));
+    for (int64_t i = 0; i < stMatrix_m(substitutionDistanceMatrix); i++) {
+        for (int64_t j = 0; j < stMatrix_n(substitutionDistanceMatrix); j++) {
+            double *cell = stMatrix_getCell(substitutionDistanceMatrix, i, j);
+            *cell = *cell * nucleotideScalingFactor
+                + *stMatrix_getCell(breakpointDistanceMatrix, i, j) * breakpointScalingFactor;
+        }
+    }
+    return substitutionDistanceMatrix;
+}
+
 // Build a tree from a set of feature columns and root it according to
-// the rooting method.
+// the rooting method. matrixIndexToJoinCostIndex is only needed for
+// guided neighbor-joining, and is the same for every tree built for
+// the unit, so the caller computes it once.
 static stTree *buildTree(stList *featureColumns,
                          HomologyUnit *unit,
                          enum stCaf_TreeBuildingMethod treeBuildingMethod,
@@ -511,6 +572,7 @@ static stTree *buildTree(stList *featureColumns,
                          Flower *flower, stTree *speciesStTree,
                          stMatrix *joinCosts,
                          stHash *speciesToJoinCostIndex,
+                         stHash *matrixIndexToJoinCostIndex,
                          int64_t **speciesMRCAMatrix,
                          stHash *eventToSpeciesNode,
                          stMatrixDiffs *snpDiffs,
@@ -529,9 +591,9 @@ static stTree *buildTree(stList *featureColumns,
         assert(params->distanceCorrectionMethod == NONE);
     }
     stMatrix *breakpointDistanceMatrix = stPinchPhylogeny_getSymmetricDistanceMatrix(breakpointMatrix);
-    stMatrix_scale(substitutionDistanceMatrix, params->nucleotideScalingFactor, 0.0);
-    stMatrix_scale(breakpointDistanceMatrix, params->breakpointScalingFactor, 0.0);
-    stMatrix *distanceMatrix = stMatrix_add(substitutionDistanceMatrix, breakpointDistanceMatrix);
+    stMatrix *distanceMatrix = combineDistanceMatrices(substitutionDistanceMatrix, breakpointDistanceMatrix,
+                                                       params->nucleotideScalingFactor,
+                                                       params->breakpointScalingFactor);
 
     stTree *tree = NULL;
     if (params->rootingMethod == OUTGROUP_BRANCH) {
@@ -550,13 +612,9 @@ static stTree *buildTree(stList *featureColumns,
         if (treeBuildingMethod == NEIGHBOR_JOINING) {
             tree = stPhylogeny_neighborJoin(distanceMatrix, NULL);
         } else if (treeBuildingMethod == GUIDED_NEIGHBOR_JOINING) {
-            // Could move this out of the function as well. It's the
-            // same for each tree generated for the block.
-            stHash *matrixIndexToJoinCostIndex = getMatrixIndexToJoinCostIndex(unit, flower, eventToSpeciesNode,
-                                                                               speciesToJoinCostIndex);
+            assert(matrixIndexToJoinCostIndex != NULL);
             stMatrix *combinedMatrix = stMatrix_add(breakpointMatrix, substitutionMatrix);
             tree = stPhylogeny_guidedNeighborJoining(distanceMatrix, combinedMatrix, joinCosts, matrixIndexToJoinCostIndex, speciesToJoinCostIndex, speciesMRCAMatrix, speciesStTree);
-            stHash_destruct(matrixIndexToJoinCostIndex);
             stMatrix_destruct(combinedMatrix);
         } else if (treeBuildingMethod == SPLIT_DECOMPOSITION) {
             tree = stPhylogeny_greedySplitDecomposition(distanceMatrix, true);
@@ -596,9 +654,8 @@ static stTree *buildTree(stList *featureColumns,
 
     stMatrix_destruct(substitutionMatrix);
     stMatrix_destruct(breakpointMatrix);
-    stMatrix_destruct(substitutionDistanceMatrix);
     stMatrix_destruct(breakpointDistanceMatrix);
-    stMatrix_destruct(distanceMatrix);
+    stMatrix_destruct(distanceMatrix); // Same matrix as substitutionDistanceMatrix.
     return tree;
 }
 
@@ -938,17 +995,89 @@ static double getAvgSupportValue(stSortedSet *splitBranches) {
     return totalSupport/stSortedSet_size(splitBranches);
 }
 
-// Small wrapper function to tell the pool to build, reconcile, and
-// bootstrap a tree for a homology unit.
-static void pushHomologyUnitToPool(HomologyUnit *unit,
-                                   TreeBuildingConstants *constants,
-                                   stHash *homologyUnitsToTrees,
-                                   stThreadPool *threadPool) {
-    TreeBuildingInput *input = st_malloc(sizeof(TreeBuildingInput));
-    input->constants = constants;
-    input->homologyUnit = unit;
-    input->homologyUnitsToTrees = homologyUnitsToTrees;
-    stThreadPool_push(threadPool, input);
+static double getWallTime(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// Rough estimate of the work needed to build the trees for a unit:
+// the distance matrices are quadratic in the degree, each one is
+// built from every feature column (approximated by the aligned
+// length plus the context on either side), and this is repeated for
+// every sampled tree and every tree-building method.
+static double estimateTreeBuildingCost(HomologyUnit *unit, stCaf_PhylogenyParameters *params) {
+    double degree = stPinchBlock_getDegree(getCanonicalBlockForHomologyUnit(unit));
+    double columns = 2.0 * params->maxBaseDistance;
+    if (unit->unitType == BLOCK) {
+        columns += stPinchBlock_getLength(unit->unit);
+    } else {
+        assert(unit->unitType == CHAIN);
+        for (int64_t i = 0; i < stList_length(unit->unit); i++) {
+            columns += stPinchBlock_getLength(stList_get(unit->unit, i));
+        }
+    }
+    return degree * degree * columns * params->numTrees * stList_length(params->treeBuildingMethods);
+}
+
+typedef struct {
+    HomologyUnit *unit;
+    double cost;
+} CostedHomologyUnit;
+
+static int costedHomologyUnit_cmp(const void *a, const void *b) {
+    double cost1 = ((const CostedHomologyUnit *) a)->cost;
+    double cost2 = ((const CostedHomologyUnit *) b)->cost;
+    return cost1 > cost2 ? -1 : (cost1 < cost2 ? 1 : 0);
+}
+
+// Tell the pool to build, reconcile, and bootstrap a tree for each
+// homology unit in the list. The pool hands out work in the order it
+// was pushed, so the units are pushed most expensive first: a giant
+// unit started last would otherwise leave every other thread idle
+// while it finishes.
+static void pushHomologyUnitsToPool(stList *units,
+                                    TreeBuildingConstants *constants,
+                                    stHash *homologyUnitsToTrees,
+                                    stThreadPool *threadPool) {
+    int64_t unitNumber = stList_length(units);
+    CostedHomologyUnit *costedUnits = st_malloc(sizeof(CostedHomologyUnit) * (unitNumber > 0 ? unitNumber : 1));
+    for (int64_t i = 0; i < unitNumber; i++) {
+        costedUnits[i].unit = stList_get(units, i);
+        costedUnits[i].cost = estimateTreeBuildingCost(costedUnits[i].unit, constants->params);
+    }
+    qsort(costedUnits, unitNumber, sizeof(CostedHomologyUnit), costedHomologyUnit_cmp);
+    for (int64_t i = 0; i < unitNumber; i++) {
+        TreeBuildingInput *input = st_malloc(sizeof(TreeBuildingInput));
+        input->constants = constants;
+        input->homologyUnit = costedUnits[i].unit;
+        input->homologyUnitsToTrees = homologyUnitsToTrees;
+        stThreadPool_push(threadPool, input);
+    }
+    free(costedUnits);
+}
+
+// Wait for a round of tree building to finish, then report how well
+// the threads were kept busy. The longest unit is a lower bound on
+// the wall time of the round, so a low utilisation with a long
+// longest unit means a straggler rather than too little work.
+static void waitForTreeBuildingRound(stThreadPool *threadPool, stCaf_PhylogenyParameters *params,
+                                     int64_t unitNumber, double startTime, bool isFirstRound) {
+    stThreadPool_wait(threadPool);
+    double wallTime = getWallTime() - startTime;
+    int64_t threadNumber = params->numTreeBuildingThreads > 0 ? params->numTreeBuildingThreads : 1;
+    double utilisation = wallTime > 0.0 ? treeBuildingBusyTime / (wallTime * threadNumber) : 1.0;
+    if (isFirstRound) {
+        st_logInfo("Built trees for %" PRIi64 " units in %lf seconds using %" PRIi64 " threads, "
+                   "%.1f%% utilisation, longest unit took %lf seconds\n", unitNumber, wallTime,
+                   threadNumber, 100.0 * utilisation, treeBuildingLongestUnitTime);
+    } else {
+        st_logDebug("Rebuilt trees for %" PRIi64 " units in %lf seconds, %.1f%% utilisation, "
+                    "longest unit took %lf seconds\n", unitNumber, wallTime,
+                    100.0 * utilisation, treeBuildingLongestUnitTime);
+    }
+    treeBuildingBusyTime = 0.0;
+    treeBuildingLongestUnitTime = 0.0;
 }
 
 static stTree *chooseBestAndMostResolvedTree(stList *trees,
@@ -988,6 +1117,7 @@ static stTree *chooseBestAndMostResolvedTree(stList *trees,
 static TreeBuildingResult *buildTreeForHomologyUnit(TreeBuildingInput *input) {
     HomologyUnit *unit = input->homologyUnit;
     stCaf_PhylogenyParameters *params = input->constants->params;
+    double startTime = getWallTime();
 
     TreeBuildingResult *ret = st_calloc(1, sizeof(TreeBuildingResult));
     ret->homologyUnitsToTrees = input->homologyUnitsToTrees;
@@ -1041,15 +1171,24 @@ static TreeBuildingResult *buildTreeForHomologyUnit(TreeBuildingInput *input) {
     stMatrixDiffs *snpDiffs = stPinchPhylogeny_getMatrixDiffsFromSubstitutions(featureColumns, degree, NULL);
     stMatrixDiffs *breakpointDiffs = stPinchPhylogeny_getMatrixDiffsFromBreakpoints(featureColumns, degree, NULL);
 
-    // rand() has a global lock on it! Better to contest it once and
-    // use that as a seed than to contest it several thousand times
-    // per tree...
-    unsigned int mySeed = rand();
+    // The bootstraps draw from a seed derived from the unit itself, so
+    // the trees don't depend on the order in which units reach the
+    // workers (and rand()'s global lock isn't contested).
+    unsigned int mySeed = getSeedForHomologyUnit(unit);
 
     stList *bestTrees = stList_construct();
 
+    // Only needed for guided neighbor-joining, and the same for every
+    // tree built for this unit.
+    stHash *matrixIndexToJoinCostIndex = NULL;
+
     for (int64_t i = 0; i < stList_length(params->treeBuildingMethods); i++) {
         enum stCaf_TreeBuildingMethod *treeBuildingMethod = stList_get(params->treeBuildingMethods, i);
+        if (*treeBuildingMethod == GUIDED_NEIGHBOR_JOINING && matrixIndexToJoinCostIndex == NULL) {
+            matrixIndexToJoinCostIndex = getMatrixIndexToJoinCostIndex(unit, input->constants->flower,
+                                                                       input->constants->eventToSpeciesNode,
+                                                                       input->constants->speciesToJoinCostIndex);
+        }
         // Build the canonical tree.
         stTree *canonicalTree = buildTree(featureColumns, unit, *treeBuildingMethod,
                                           params, 0, outgroups,
@@ -1057,6 +1196,7 @@ static TreeBuildingResult *buildTreeForHomologyUnit(TreeBuildingInput *input) {
                                           input->constants->speciesStTree,
                                           input->constants->joinCosts,
                                           input->constants->speciesToJoinCostIndex,
+                                          matrixIndexToJoinCostIndex,
                                           input->constants->speciesMRCAMatrix,
                                           input->constants->eventToSpeciesNode,
                                           snpDiffs, breakpointDiffs, &mySeed);
@@ -1070,6 +1210,7 @@ static TreeBuildingResult *buildTreeForHomologyUnit(TreeBuildingInput *input) {
                                      input->constants->speciesStTree,
                                      input->constants->joinCosts,
                                      input->constants->speciesToJoinCostIndex,
+                                     matrixIndexToJoinCostIndex,
                                      input->constants->speciesMRCAMatrix,
                                      input->constants->eventToSpeciesNode,
                                      snpDiffs, breakpointDiffs, &mySeed);
@@ -1110,6 +1251,9 @@ static TreeBuildingResult *buildTreeForHomologyUnit(TreeBuildingInput *input) {
         }
     }
     stList_destruct(bestTrees);
+    if (matrixIndexToJoinCostIndex != NULL) {
+        stHash_destruct(matrixIndexToJoinCostIndex);
+    }
 
     stMatrixDiffs_destruct(snpDiffs);
     stMatrixDiffs_destruct(breakpointDiffs);
@@ -1120,6 +1264,7 @@ static TreeBuildingResult *buildTreeForHomologyUnit(TreeBuildingInput *input) {
     free(input);
 
     ret->tree = bestTree;
+    ret->buildTime = getWallTime() - startTime;
 
     return ret;
 }
@@ -1127,6 +1272,10 @@ static TreeBuildingResult *buildTreeForHomologyUnit(TreeBuildingInput *input) {
 // Gets run as a "finisher" in the thread pool, so it's run in series
 // and we don't have to lock the hash.
 static void addTreeToHash(TreeBuildingResult *result) {
+    treeBuildingBusyTime += result->buildTime;
+    if (result->buildTime > treeBuildingLongestUnitTime) {
+        treeBuildingLongestUnitTime = result->buildTime;
+    }
     if (stHash_search(result->homologyUnitsToTrees, result->homologyUnit)) {
         stHash_remove(result->homologyUnitsToTrees, result->homologyUnit);
     }
@@ -1347,13 +1496,13 @@ static void recomputeAffectedTrees(stSet *homologyUnitsToUpdate,
     }
     stSet_destructIterator(homologyUnitsToUpdateIt);
 
-    for (int64_t i = 0; i < stList_length(unitsToPush); i++) {
-        pushHomologyUnitToPool(stList_get(unitsToPush, i), constants,
-                               homologyUnitsToTrees, treeBuildingPool);
-    }
+    double startTime = getWallTime();
+    pushHomologyUnitsToPool(unitsToPush, constants, homologyUnitsToTrees,
+                            treeBuildingPool);
 
     // Wait for the trees to be done.
-    stThreadPool_wait(treeBuildingPool);
+    waitForTreeBuildingRound(treeBuildingPool, constants->params,
+                             stList_length(unitsToPush), startTime, false);
     homologyUnitsToUpdateIt = stSet_getIterator(homologyUnitsToUpdate);
     while ((unitToUpdate = stSet_getNext(homologyUnitsToUpdateIt)) != NULL) {
         stTree *tree = stHash_search(homologyUnitsToTrees, unitToUpdate);
@@ -1679,54 +1828,90 @@ static stHash *getBadDivergences(stSet *homologyUnits, TreeBuildingConstants *co
     return speciesPairToBadDivergence;
 }
 
-static stHash *getDistanceMatricesForUnits(stSet *homologyUnits, TreeBuildingConstants *constants, stCaf_PhylogenyParameters *params) {
-    stHash *unitToDistanceMatrix = stHash_construct2(NULL, (void (*)(void *)) stMatrix_destruct);
-    stSetIterator *it = stSet_getIterator(homologyUnits);
-    HomologyUnit *unit;
-    while ((unit = stSet_getNext(it)) != NULL) {
-        assert(unit->unitType == CHAIN);
-        stList *featureBlocks = stFeatureBlock_getContextualFeatureBlocksForChainedBlocks(
-            unit->unit, params->maxBaseDistance,
-            params->maxBlockDistance,
-            params->ignoreUnalignedBases,
-            params->onlyIncludeCompleteFeatureBlocks,
-            constants->threadStrings);
+stMatrix *stCaf_getDistanceMatrixForUnit(HomologyUnit *unit, stHash *threadStrings, stCaf_PhylogenyParameters *params) {
+    assert(unit->unitType == CHAIN);
+    stList *featureBlocks = stFeatureBlock_getContextualFeatureBlocksForChainedBlocks(
+        unit->unit, params->maxBaseDistance,
+        params->maxBlockDistance,
+        params->ignoreUnalignedBases,
+        params->onlyIncludeCompleteFeatureBlocks,
+        threadStrings);
 
-        // Make feature columns
-        stList *featureColumns = stFeatureColumn_getFeatureColumns(featureBlocks);
+    // Make feature columns
+    stList *featureColumns = stFeatureColumn_getFeatureColumns(featureBlocks);
 
-        // Get the degree (= number of segments in the block/chain).
-        int64_t degree = stPinchBlock_getDegree(getCanonicalBlockForHomologyUnit(unit));
+    // Get the degree (= number of segments in the block/chain).
+    int64_t degree = stPinchBlock_getDegree(getCanonicalBlockForHomologyUnit(unit));
 
-        // Get the matrix diffs.
-        stMatrixDiffs *snpDiffs = stPinchPhylogeny_getMatrixDiffsFromSubstitutions(featureColumns, degree, NULL);
+    // Get the matrix diffs.
+    stMatrixDiffs *snpDiffs = stPinchPhylogeny_getMatrixDiffsFromSubstitutions(featureColumns, degree, NULL);
 
-        // Make substitution matrix
-        stMatrix *substitutionMatrix = stPinchPhylogeny_constructMatrixFromDiffs(snpDiffs, false, 0);
+    // Make substitution matrix
+    stMatrix *substitutionMatrix = stPinchPhylogeny_constructMatrixFromDiffs(snpDiffs, false, 0);
 
-        //Combine the matrices into distance matrices
-        stMatrix *substitutionDistanceMatrix = stPinchPhylogeny_getSymmetricDistanceMatrix(substitutionMatrix);
-        if (params->distanceCorrectionMethod == JUKES_CANTOR) {
-            stPhylogeny_applyJukesCantorCorrection(substitutionDistanceMatrix);
-        } else {
-            assert(params->distanceCorrectionMethod == NONE);
-        }
+    //Combine the matrices into distance matrices
+    stMatrix *substitutionDistanceMatrix = stPinchPhylogeny_getSymmetricDistanceMatrix(substitutionMatrix);
+    if (params->distanceCorrectionMethod == JUKES_CANTOR) {
+        stPhylogeny_applyJukesCantorCorrection(substitutionDistanceMatrix);
+    } else {
+        assert(params->distanceCorrectionMethod == NONE);
+    }
 
-        stHash_insert(unitToDistanceMatrix, unit, substitutionDistanceMatrix);
+    stList_destruct(featureBlocks);
+    stList_destruct(featureColumns);
 
-        stList_destruct(featureBlocks);
-        stList_destruct(featureColumns);
+    stMatrix_destruct(substitutionMatrix);
 
-        stMatrix_destruct(substitutionMatrix);
+    stMatrixDiffs_destruct(snpDiffs);
+    return substitutionDistanceMatrix;
+}
 
-        stMatrixDiffs_destruct(snpDiffs);
+// Gets passed to getDistanceMatrixForUnit and then addDistanceMatrixToHash.
+typedef struct {
+    HomologyUnit *unit;
+    stHash *threadStrings;
+    stCaf_PhylogenyParameters *params;
+    stHash *unitToDistanceMatrix;
+    stMatrix *distanceMatrix;
+} DistanceMatrixInput;
+
+// Gets run as a worker in a thread.
+static DistanceMatrixInput *getDistanceMatrixForUnit(DistanceMatrixInput *input) {
+    input->distanceMatrix = stCaf_getDistanceMatrixForUnit(input->unit, input->threadStrings, input->params);
+    return input;
+}
+
+// Gets run as a "finisher" in the thread pool, so it's run in series
+// and we don't have to lock the hash.
+static void addDistanceMatrixToHash(DistanceMatrixInput *result) {
+    stHash_insert(result->unitToDistanceMatrix, result->unit, result->distanceMatrix);
+    free(result);
+}
+
+stHash *stCaf_getDistanceMatricesForUnits(stSet *homologyUnits, stHash *threadStrings, stCaf_PhylogenyParameters *params) {
+    stHash *unitToDistanceMatrix = stHash_construct2(NULL, (void (*)(void *)) stMatrix_destruct);
+    stThreadPool *pool = stThreadPool_construct(params->numTreeBuildingThreads,
+                                                (void *(*)(void *)) getDistanceMatrixForUnit,
+                                                (void (*)(void *)) addDistanceMatrixToHash);
+    stSetIterator *it = stSet_getIterator(homologyUnits);
+    HomologyUnit *unit;
+    while ((unit = stSet_getNext(it)) != NULL) {
+        DistanceMatrixInput *input = st_calloc(1, sizeof(DistanceMatrixInput));
+        input->unit = unit;
+        input->threadStrings = threadStrings;
+        input->params = params;
+        input->unitToDistanceMatrix = unitToDistanceMatrix;
+        stThreadPool_push(pool, input);
     }
+    stSet_destructIterator(it);
+    stThreadPool_wait(pool);
+    stThreadPool_destruct(pool);
     return unitToDistanceMatrix;
 }
 
 stSet *stCaf_getBadChains(stSet *homologyUnits, TreeBuildingConstants *constants, stCaf_PhylogenyParameters *params, Flower *flower) {
     stSet *ret = stSet_construct2(free);
-    stHash *unitToDistanceMatrix = getDistanceMatricesForUnits(homologyUnits, constants, params);
+    stHash *unitToDistanceMatrix = stCaf_getDistanceMatricesForUnits(homologyUnits, constants->threadStrings, params);
     stHash *badDivergences = getBadDivergences(homologyUnits, constants, flower, unitToDistanceMatrix);
 
     stSetIterator *it = stSet_getIterator(homologyUnits);
@@ -2013,15 +2198,20 @@ void stCaf_buildTreesToRemoveAncientHomologies(stPinchThreadSet *threadSet,
     }
 
     // The loop to build a tree for each homology unit
+    stList *unitsToPush = stList_construct();
     stSetIterator *homologyUnitIt = stSet_getIterator(homologyUnits);
     HomologyUnit *unit;
     while ((unit = stSet_getNext(homologyUnitIt)) != NULL) {
-        pushHomologyUnitToPool(unit, &constants, homologyUnitsToTrees, treeBuildingPool);
+        stList_append(unitsToPush, unit);
     }
     stSet_destructIterator(homologyUnitIt);
+    double startTime = getWallTime();
+    pushHomologyUnitsToPool(unitsToPush, &constants, homologyUnitsToTrees, treeBuildingPool);
 
     // We need the trees to be done before we can continue.
-    stThreadPool_wait(treeBuildingPool);
+    waitForTreeBuildingRound(treeBuildingPool, params, stList_length(unitsToPush),
+                             startTime, true);
+    stList_destruct(unitsToPush);
 
     if (debugFile != NULL) {
         blockIt = stPinchThreadSet_getBlockIt(threadSet);
@@ -6,6 +6,11 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "sonLib.h"
 #include "stPinchGraphs.h"
 #include "stPinchIterator.h"
@@ -178,6 +183,117 @@ stPinchIterator *stPinchIterator_constructFromAlignedPairs(stSortedSet *alignedP
     return pinchIterator;
 }
 
+/*
+ * Binary pinch files: a fixed header followed by fixed-size, untrimmed pinch records.
+ */
+
+static const char binaryPinchFileMagic[8] = { 'C', 'A', 'F', 'P', 'I', 'N', 'C', '1' };
+
+typedef struct _binaryPinchRecord {
+    int64_t name1, name2, start1, start2, length, strand;
+} BinaryPinchRecord;
+
+typedef struct _binaryPinchFile {
+    void *map;
+    size_t mapSize;
+    const BinaryPinchRecord *records;
+    int64_t recordNumber, recordIndex;
+    stPinch pinch;
+} BinaryPinchFile;
+
+int64_t stPinchIterator_writeBinaryFileFromAlignments(void *alignmentArg,
+        struct PairwiseAlignment *(*getNextAlignment)(void *), const char *binaryFile) {
+    FILE *fileHandle = fopen(binaryFile, "w");
+    if (fileHandle == NULL) {
+        st_errAbort("Could not open the binary pinch file %s for writing", binaryFile);
+    }
+    fwrite(binaryPinchFileMagic, sizeof(binaryPinchFileMagic), 1, fileHandle);
+    PairwiseAlignmentToPinch *pA = pairwiseAlignmentToPinch_construct(alignmentArg, getNextAlignment, 1);
+    int64_t recordNumber = 0;
+    stPinch *pinch;
+    while ((pinch = pairwiseAlignmentToPinch_getNext(pA)) != NULL) {
+        BinaryPinchRecord record = { pinch->name1, pinch->name2, pinch->start1, pinch->start2, pinch->length, pinch->strand };
+        if (fwrite(&record, sizeof(BinaryPinchRecord), 1, fileHandle) != 1) {
+            st_errAbort("Failed to write to the binary pinch file %s", binaryFile);
+        }
+        recordNumber++;
+    }
+    free(pA);
+    if (fclose(fileHandle) != 0) {
+        st_errAbort("Failed to close the binary pinch file %s", binaryFile);
+    }
+    return recordNumber;
+}
+
+int64_t stPinchIterator_writeBinaryFile(const char *alignmentFile, const char *binaryFile) {
+    FILE *fileHandle = fopen(alignmentFile, "r");
+    if (fileHandle == NULL) {
+        st_errAbort("Could not open the alignment file %s", alignmentFile);
+    }
+    int64_t recordNumber = stPinchIterator_writeBinaryFileFromAlignments(fileHandle,
+            (struct PairwiseAlignment *(*)(void *)) cigarRead, binaryFile);
+    fclose(fileHandle);
+    return recordNumber;
+}
+
+static stPinch *binaryPinchFile_getNext(BinaryPinchFile *binaryPinchFile) {
+    if (binaryPinchFile->recordIndex >= binaryPinchFile->recordNumber) {
+        return NULL;
+    }
+    const BinaryPinchRecord *record = &binaryPinchFile->records[binaryPinchFile->recordIndex++];
+    stPinch_fillOut(&binaryPinchFile->pinch, record->name1, record->name2, record->start1, record->start2, record->length,
+            record->strand);
+    return &binaryPinchFile->pinch;
+}
+
+static BinaryPinchFile *binaryPinchFile_reset(BinaryPinchFile *binaryPinchFile) {
+    binaryPinchFile->recordIndex = 0;
+    return binaryPinchFile;
+}
+
+static void binaryPinchFile_destruct(BinaryPinchFile *binaryPinchFile) {
+    if (binaryPinchFile->map != NULL) {
+        munmap(binaryPinchFile->map, binaryPinchFile->mapSize);
+    }
+    free(binaryPinchFile);
+}
+
+stPinchIterator *stPinchIterator_constructFromBinaryFile(const char *binaryFile) {
+    int fd = open(binaryFile, O_RDONLY);
+    if (fd < 0) {
+        st_errAbort("Could not open the binary pinch file %s", binaryFile);
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0) {
+        st_errAbort("Could not stat the binary pinch file %s", binaryFile);
+    }
+    size_t fileSize = fileStat.st_size;
+    if (fileSize < sizeof(binaryPinchFileMagic)
+            || (fileSize - sizeof(binaryPinchFileMagic)) % sizeof(BinaryPinchRecord) != 0) {
+        st_errAbort("The binary pinch file %s is truncated or corrupt", binaryFile);
+    }
+    BinaryPinchFile *binaryPinchFile = st_calloc(1, sizeof(BinaryPinchFile));
+    binaryPinchFile->mapSize = fileSize;
+    binaryPinchFile->map = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (binaryPinchFile->map == MAP_FAILED) {
+        st_errAbort("Could not map the binary pinch file %s", binaryFile);
+    }
+    if (memcmp(binaryPinchFile->map, binaryPinchFileMagic, sizeof(binaryPinchFileMagic)) != 0) {
+        st_errAbort("The file %s is not a binary pinch file", binaryFile);
+    }
+    madvise(binaryPinchFile->map, fileSize, MADV_SEQUENTIAL);
+    binaryPinchFile->records = (const BinaryPinchRecord *) ((const char *) binaryPinchFile->map + sizeof(binaryPinchFileMagic));
+    binaryPinchFile->recordNumber = (fileSize - sizeof(binaryPinchFileMagic)) / sizeof(BinaryPinchRecord);
+
+    stPinchIterator *pinchIterator = st_calloc(1, sizeof(stPinchIterator));
+    pinchIterator->alignmentArg = binaryPinchFile;
+    pinchIterator->getNextAlignment = (stPinch *(*)(void *)) binaryPinchFile_getNext;
+    pinchIterator->destructAlignmentArg = (void(*)(void *)) binaryPinchFile_destruct;
+    pinchIterator->startAlignmentStack = (void *(*)(void *)) binaryPinchFile_reset;
+    return pinchIterator;
+}
+
 void stPinchIterator_setTrim(stPinchIterator *pinchIterator, int64_t alignmentTrim) {
     pinchIterator->alignmentTrim = alignmentTrim;
 }
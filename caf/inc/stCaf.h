@@ -38,11 +38,35 @@ stPinchThreadSet *stCaf_setup(Flower *flower);
  */
 void stCaf_anneal(stPinchThreadSet *threadSet, stPinchIterator *pinchIterator, bool (*filterFn)(stPinchSegment *, stPinchSegment *));
 
+/*
+ * As stCaf_anneal, but anneals pinches between disjoint sets of threads using up to threadNumber threads.
+ * The result is the same as stCaf_anneal. If filterFn is not NULL the pinches are annealed serially.
+ */
+void stCaf_annealInParallel(stPinchThreadSet *threadSet, stPinchIterator *pinchIterator,
+        bool (*filterFn)(stPinchSegment *, stPinchSegment *), int64_t threadNumber);
+
 /*
  * Add the set of alignments, represented as pinches, to the graph, allowing alignments only between segments in the same component.
  */
 void stCaf_annealBetweenAdjacencyComponents(stPinchThreadSet *threadSet, stPinchIterator *pinchIterator, bool (*filterFn)(stPinchSegment *, stPinchSegment *));
 
+typedef struct _stCaf_adjacencyComponentIntervals stCaf_AdjacencyComponentIntervals;
+
+/*
+ * Labels each position of each thread with its adjacency component, as used by
+ * stCaf_annealBetweenAdjacencyComponents. Positions in a block segment take the label of the
+ * adjacency on their side of the segment's midpoint. The labels are only valid until the graph changes.
+ */
+stCaf_AdjacencyComponentIntervals *stCaf_adjacencyComponentIntervals_construct(stPinchThreadSet *threadSet);
+
+void stCaf_adjacencyComponentIntervals_destruct(stCaf_AdjacencyComponentIntervals *adjacencyComponentIntervals);
+
+/*
+ * Gets the label of the adjacency component of the given position of the thread.
+ */
+int64_t stCaf_adjacencyComponentIntervals_getLabel(stCaf_AdjacencyComponentIntervals *adjacencyComponentIntervals,
+        stPinchThread *thread, int64_t position);
+
 /*
  * Joins all trivial boundaries, but not joining stub boundaries.
  */
@@ -52,12 +76,46 @@ void stCaf_joinTrivialBoundaries(stPinchThreadSet *threadSet);
 // Melting fuctions -- removing alignments from the pinch graph
 ///////////////////////////////////////////////////////////////////////////
 
+/*
+ * Returns a list of the blocks in the thread set. The list does not own the blocks.
+ */
+stList *stCaf_getBlocks(stPinchThreadSet *threadSet);
+
+/*
+ * Evaluates the predicate on each block in the list using up to threadNumber threads, returning
+ * an array of the results in list order, which the caller must free. The predicate must not
+ * modify the pinch graph; any destructive action should be applied serially afterwards.
+ */
+bool *stCaf_scanBlocks(stList *blocks, bool (*predicate)(stPinchBlock *, void *), void *extraArg,
+        int64_t threadNumber);
+
+/*
+ * As stCaf_scanBlocks, but calls fn with each block and its index in the list, for scans that
+ * compute more than a flag per block. fn must only write the index'th entry of any output array.
+ */
+void stCaf_mapBlocks(stList *blocks, void (*fn)(stPinchBlock *, int64_t, void *), void *extraArg,
+        int64_t threadNumber);
+
+/*
+ * Sets the number of threads used by stCaf_melt to evaluate the block filter function, which must
+ * then be safe to call concurrently. Default 1.
+ */
+void stCaf_setNumBlockScanThreads(int64_t threadNumber);
+
 /*
  * Removes homologies from the graph.
  */
 void stCaf_melt(Flower *flower, stPinchThreadSet *threadSet, bool blockFilterfn(stPinchBlock *), int64_t blockEndTrim,
         int64_t minimumChainLength, bool breakChainsAtReverseTandems, int64_t maximumMedianSpacingBetweenLinkedEnds);
 
+/*
+ * Melts chains shorter than each of the given increasing minimum chain lengths in turn, as
+ * successive calls to stCaf_melt without a block filter, trim or chain breaking would, but
+ * builds the cactus graph only once and takes the chain lengths from it for every round.
+ * The graph is only rebuilt if a round splits a thread component of the top level flower.
+ */
+void stCaf_meltInRounds(Flower *flower, stPinchThreadSet *threadSet, int64_t *minimumChainLengths, int64_t roundNumber);
+
 /*
  * Removes any recoverable chains (those expected to be picked up by
  * bar phase) from the graph. Only chains that are recoverable *and*
@@ -120,10 +178,25 @@ void stCaf_finish(Flower *flower, stPinchThreadSet *threadSet, int64_t chainLeng
 /*
  * Must be used before any of stCaf_filterByOutgroup,
  * stCaf_relaxedFilterByOutgroup, or stCaf_filterByRepeatSpecies are
- * used.
+ * used. Builds a table from thread names to species and chromosomes
+ * for the filters, which is freed by the next call (pass NULL to
+ * just free it).
  */
 void stCaf_setFlowerForAlignmentFiltering(Flower *input);
 
+/*
+ * The alignment filters cache a summary of the species in each block
+ * they see, which is checked against the degree and first segment of
+ * the block on every use. Pinches made directly, rather than through a
+ * filter, between filter calls are caught by that check. A destroyed
+ * block or segment can have its memory reused by a new one that passes
+ * the check, so this must be called after blocks or segments are
+ * destroyed (by undoing pinches, melting, joining trivial boundaries or
+ * destroying the thread set) before the filters are used again. The
+ * annealing functions call it.
+ */
+void stCaf_clearAlignmentFilteringCache(void);
+
 /*
  * Filters incoming alignments by presence of outgroup, to ensure at
  * most one outgroup segment is in any block.
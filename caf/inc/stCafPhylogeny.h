@@ -201,6 +201,19 @@ void stCaf_buildTreesToRemoveAncientHomologies(stPinchThreadSet *threadSet,
  */
 stHash *stCaf_getThreadStrings(Flower *flower, stPinchThreadSet *threadSet);
 
+/*
+ * Gets the substitution distance matrix between the segments of a chain homology unit,
+ * corrected as given by the parameters.
+ */
+stMatrix *stCaf_getDistanceMatrixForUnit(HomologyUnit *unit, stHash *threadStrings, stCaf_PhylogenyParameters *params);
+
+/*
+ * Gets a hash from each chain homology unit to its distance matrix (as
+ * stCaf_getDistanceMatrixForUnit), computing the matrices on a pool of
+ * params->numTreeBuildingThreads threads.
+ */
+stHash *stCaf_getDistanceMatricesForUnits(stSet *homologyUnits, stHash *threadStrings, stCaf_PhylogenyParameters *params);
+
 /*
  * Gets the sub-set of threads that are part of outgroup events.
  */
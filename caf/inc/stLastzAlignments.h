@@ -15,8 +15,27 @@ stList *stCaf_selfAlignFlower(Flower *flower, int64_t minimumSequenceLength, con
         bool realign, const char *realignArgs,
         char *tempFile1);
 
+/*
+ * As stCaf_selfAlignFlower, but streams the alignments into a binary pinch file (see
+ * stPinchIterator_writeBinaryFile) as lastz produces them, rather than holding them in memory.
+ * If sortAlignments is set the alignments are spooled next to the output and sorted by
+ * descending score with stCaf_sortCigarsFile. Returns the number of alignments.
+ */
+int64_t stCaf_selfAlignFlowerToBinaryPinchFile(Flower *flower, int64_t minimumSequenceLength, const char *lastzArgs,
+        bool realign, const char *realignArgs, char *tempFile1, const char *binaryPinchFile,
+        bool sortAlignments, int64_t threadNumber, int64_t memoryBudget);
+
 void stCaf_sortCigarsByScoreInDescendingOrder(stList *cigars);
 
 void stCaf_sortCigarsFileByScoreInDescendingOrder(char *cigarsFile, char *sortedFile);
 
+/*
+ * Sorts a cigar file by descending score, ties kept in input order, writing either the sorted
+ * cigars or, if binaryPinchOutput is set, a binary pinch file (see stPinchIterator_writeBinaryFile).
+ * Sorting uses up to threadNumber threads and memoryBudget bytes for keys, spilling runs next to
+ * the output file; a non-positive value for either picks a default.
+ */
+void stCaf_sortCigarsFile(const char *cigarsFile, const char *outputFile, bool binaryPinchOutput,
+        int64_t threadNumber, int64_t memoryBudget);
+
 #endif /* ST_LASTZALIGNMENT_H_ */
@@ -13,6 +13,8 @@
 
 typedef struct _stPinchIterator stPinchIterator;
 
+struct PairwiseAlignment;
+
 /*
  * Get next alignment from iterator.
  */
@@ -37,6 +39,25 @@ void stPinchIterator_destruct(
 stPinchIterator *stPinchIterator_constructFromFile(
         const char *alignmentFile);
 
+/*
+ * Converts a cigar alignment file into a binary pinch file of fixed-size, untrimmed
+ * pinch records, in the same order as the alignments. Returns the number of pinches written.
+ */
+int64_t stPinchIterator_writeBinaryFile(const char *alignmentFile, const char *binaryFile);
+
+/*
+ * As stPinchIterator_writeBinaryFile, but takes the pairwise alignments from successive calls
+ * to getNextAlignment(alignmentArg) until it returns NULL. Each alignment is destructed once converted.
+ */
+int64_t stPinchIterator_writeBinaryFileFromAlignments(void *alignmentArg,
+        struct PairwiseAlignment *(*getNextAlignment)(void *), const char *binaryFile);
+
+/*
+ * Get a pinch iterator from a binary pinch file written by stPinchIterator_writeBinaryFile.
+ * The file is memory mapped, so resets are free and getNext does no allocation or parsing.
+ */
+stPinchIterator *stPinchIterator_constructFromBinaryFile(const char *binaryFile);
+
 /*
  * Get a pairwise alignment iterator from a list of alignments.
  * Does not cleanup the list or modify the list.
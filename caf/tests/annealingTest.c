@@ -14,6 +14,9 @@ void stCaf_anneal2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *
 void stCaf_annealBetweenAdjacencyComponents2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *),
         void *extraArg, bool (*filterFn)(stPinchSegment *, stPinchSegment *));
 
+void stCaf_annealInParallel2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *), void *extraArg,
+        int64_t threadNumber, int64_t chunkSize);
+
 static stPinch *randomPinch(void *extraArg) {
     if(st_random() < 0.01) {
         return NULL;
@@ -41,9 +44,169 @@ static void testAnnealingBetweenAdjacencyComponents(CuTest *testCase) {
     }
 }
 
+static stPinch *listPinch(stListIterator *it) {
+    return stList_getNext(it);
+}
+
+/*
+ * Makes two copies of the same random graph, with many threads, and a list of random pinches for them.
+ */
+static stList *getTestGraphsAndPinches(stPinchThreadSet **threadSet1, stPinchThreadSet **threadSet2, int64_t threadNumber,
+        int64_t pinchNumber) {
+    *threadSet1 = stPinchThreadSet_construct();
+    *threadSet2 = stPinchThreadSet_construct();
+    for (int64_t i = 0; i < threadNumber; i++) {
+        int64_t start = st_randomInt(0, 100), length = st_randomInt(1, 100);
+        stPinchThreadSet_addThread(*threadSet1, i, start, length);
+        stPinchThreadSet_addThread(*threadSet2, i, start, length);
+    }
+    stList *pinches = stList_construct3(0, free);
+    for (int64_t i = 0; i < pinchNumber; i++) {
+        stPinch *pinch = st_malloc(sizeof(stPinch));
+        *pinch = stPinchThreadSet_getRandomPinch(*threadSet1);
+        stList_append(pinches, pinch);
+    }
+    return pinches;
+}
+
+static void checkGraphsAreEqual(CuTest *testCase, stPinchThreadSet *threadSet1, stPinchThreadSet *threadSet2, int64_t threadNumber) {
+    //The graphs must be identical, including the first segment and orientation of each block
+    CuAssertIntEquals(testCase, stPinchThreadSet_getTotalBlockNumber(threadSet1), stPinchThreadSet_getTotalBlockNumber(threadSet2));
+    for (int64_t i = 0; i < threadNumber; i++) {
+        stPinchSegment *segment1 = stPinchThread_getFirst(stPinchThreadSet_getThread(threadSet1, i));
+        stPinchSegment *segment2 = stPinchThread_getFirst(stPinchThreadSet_getThread(threadSet2, i));
+        while (segment1 != NULL) {
+            CuAssertTrue(testCase, segment2 != NULL);
+            CuAssertIntEquals(testCase, stPinchSegment_getStart(segment1), stPinchSegment_getStart(segment2));
+            CuAssertIntEquals(testCase, stPinchSegment_getLength(segment1), stPinchSegment_getLength(segment2));
+            stPinchBlock *block1 = stPinchSegment_getBlock(segment1), *block2 = stPinchSegment_getBlock(segment2);
+            CuAssertIntEquals(testCase, block1 == NULL, block2 == NULL);
+            if (block1 != NULL) {
+                CuAssertIntEquals(testCase, stPinchBlock_getDegree(block1), stPinchBlock_getDegree(block2));
+                CuAssertIntEquals(testCase, stPinchSegment_getName(stPinchBlock_getFirst(block1)),
+                        stPinchSegment_getName(stPinchBlock_getFirst(block2)));
+                CuAssertIntEquals(testCase, stPinchSegment_getStart(stPinchBlock_getFirst(block1)),
+                        stPinchSegment_getStart(stPinchBlock_getFirst(block2)));
+                CuAssertIntEquals(testCase, stPinchSegment_getBlockOrientation(segment1),
+                        stPinchSegment_getBlockOrientation(segment2));
+            }
+            segment1 = stPinchSegment_get3Prime(segment1);
+            segment2 = stPinchSegment_get3Prime(segment2);
+        }
+        CuAssertPtrEquals(testCase, NULL, segment2);
+    }
+}
+
+static void testAnnealingInParallel(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting parallel annealing random test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet, *parallelThreadSet;
+        int64_t threadNumber = st_randomInt(1, 50);
+        stList *pinches = getTestGraphsAndPinches(&threadSet, &parallelThreadSet, threadNumber, st_randomInt(0, 100));
+        stListIterator *it = stList_getIterator(pinches);
+        stCaf_anneal2(threadSet, (stPinch *(*)(void *)) listPinch, it);
+        stList_destructIterator(it);
+        it = stList_getIterator(pinches);
+        //Small chunks, so that most tests anneal the pinches in several chunks
+        stCaf_annealInParallel2(parallelThreadSet, (stPinch *(*)(void *)) listPinch, it, st_randomInt(2, 5),
+                st_randomInt(1, 50));
+        stList_destructIterator(it);
+        checkGraphsAreEqual(testCase, threadSet, parallelThreadSet, threadNumber);
+        stList_destruct(pinches);
+        stPinchThreadSet_destruct(threadSet);
+        stPinchThreadSet_destruct(parallelThreadSet);
+    }
+}
+
+static void testAnnealingMatchesPinching(CuTest *testCase) {
+    //Checks that annealing gives exactly the same graph as applying the pinches one by one, in order.
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting annealing order random test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet, *annealedThreadSet;
+        int64_t threadNumber = st_randomInt(1, 50);
+        stList *pinches = getTestGraphsAndPinches(&threadSet, &annealedThreadSet, threadNumber, st_randomInt(0, 10000));
+        for (int64_t i = 0; i < stList_length(pinches); i++) {
+            stPinch *pinch = stList_get(pinches, i);
+            stPinchThread_pinch(stPinchThreadSet_getThread(threadSet, pinch->name1), stPinchThreadSet_getThread(threadSet, pinch->name2),
+                    pinch->start1, pinch->start2, pinch->length, pinch->strand);
+        }
+        stListIterator *it = stList_getIterator(pinches);
+        stCaf_anneal2(annealedThreadSet, (stPinch *(*)(void *)) listPinch, it);
+        stList_destructIterator(it);
+        checkGraphsAreEqual(testCase, threadSet, annealedThreadSet, threadNumber);
+        stList_destruct(pinches);
+        stPinchThreadSet_destruct(threadSet);
+        stPinchThreadSet_destruct(annealedThreadSet);
+    }
+}
+
+static int64_t getRandomPosition(stPinchSegment *segment) {
+    //Biased to the ends and midpoint of the segment, where the labels of aligned segments change
+    int64_t start = stPinchSegment_getStart(segment), length = stPinchSegment_getLength(segment);
+    switch (st_randomInt(0, 5)) {
+        case 0:
+            return start;
+        case 1:
+            return start + length - 1;
+        case 2:
+            return start + length / 2;
+        case 3:
+            return start + (length / 2 > 0 ? length / 2 - 1 : 0);
+        default:
+            return start + st_randomInt(0, length);
+    }
+}
+
+static void testAdjacencyComponentIntervals(CuTest *testCase) {
+    //Positions must be in the same component exactly when the generic pinch graph labelling says so,
+    //both in unaligned segments and either side of the midpoint of aligned segments.
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting adjacency component intervals random test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet = stPinchThreadSet_getRandomGraph();
+        stCaf_AdjacencyComponentIntervals *adjacencyComponentIntervals = stCaf_adjacencyComponentIntervals_construct(threadSet);
+        stHash *pinchEndsToAdjacencyComponents;
+        stList *adjacencyComponents = stPinchThreadSet_getAdjacencyComponents2(threadSet, &pinchEndsToAdjacencyComponents);
+        stSortedSet *labelIntervals = stPinchThreadSet_getLabelIntervals(threadSet, pinchEndsToAdjacencyComponents);
+        stList *unalignedSegments = stList_construct();
+        stList *alignedSegments = stList_construct();
+        stPinchThreadSetSegmentIt segmentIt = stPinchThreadSet_getSegmentIt(threadSet);
+        stPinchSegment *segment;
+        while ((segment = stPinchThreadSetSegmentIt_getNext(&segmentIt)) != NULL) {
+            stList_append(stPinchSegment_getBlock(segment) == NULL ? unalignedSegments : alignedSegments, segment);
+        }
+        for (int64_t i = 0; i < 200; i++) {
+            //Pairs of unaligned, mixed and aligned positions
+            stList *segments1 = i % 3 == 2 ? alignedSegments : unalignedSegments;
+            stList *segments2 = i % 3 == 0 ? unalignedSegments : alignedSegments;
+            if (stList_length(segments1) == 0 || stList_length(segments2) == 0) {
+                continue;
+            }
+            stPinchSegment *segment1 = st_randomChoice(segments1);
+            stPinchSegment *segment2 = st_randomChoice(segments2);
+            int64_t position1 = getRandomPosition(segment1);
+            int64_t position2 = getRandomPosition(segment2);
+            bool sameComponent = stPinchInterval_getLabel(stPinchIntervals_getInterval(labelIntervals, stPinchSegment_getName(segment1), position1))
+                    == stPinchInterval_getLabel(stPinchIntervals_getInterval(labelIntervals, stPinchSegment_getName(segment2), position2));
+            CuAssertIntEquals(testCase, sameComponent,
+                    stCaf_adjacencyComponentIntervals_getLabel(adjacencyComponentIntervals, stPinchSegment_getThread(segment1), position1)
+                            == stCaf_adjacencyComponentIntervals_getLabel(adjacencyComponentIntervals, stPinchSegment_getThread(segment2), position2));
+        }
+        stList_destruct(unalignedSegments);
+        stList_destruct(alignedSegments);
+        stSortedSet_destruct(labelIntervals);
+        stHash_destruct(pinchEndsToAdjacencyComponents);
+        stList_destruct(adjacencyComponents);
+        stCaf_adjacencyComponentIntervals_destruct(adjacencyComponentIntervals);
+        stPinchThreadSet_destruct(threadSet);
+    }
+}
+
 CuSuite* annealingTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testAnnealing);
     SUITE_ADD_TEST(suite, testAnnealingBetweenAdjacencyComponents);
+    SUITE_ADD_TEST(suite, testAdjacencyComponentIntervals);
+    SUITE_ADD_TEST(suite, testAnnealingInParallel);
+    SUITE_ADD_TEST(suite, testAnnealingMatchesPinching);
     return suite;
 }
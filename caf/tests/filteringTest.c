@@ -349,11 +349,283 @@ static void testHGVMFiltering(CuTest *testCase) {
     }
 }
 
+// Checks the species counted in a block containing one ingroup1 and one
+// outgroup1 segment.
+static void checkContainsRequiredSpecies(CuTest *testCase, stPinchBlock *block) {
+    CuAssertTrue(testCase, stCaf_containsRequiredSpecies(block, flower, 1, 1, 2, 2));
+    CuAssertTrue(testCase, !stCaf_containsRequiredSpecies(block, flower, 2, 0, 0, 0));
+    CuAssertTrue(testCase, !stCaf_containsRequiredSpecies(block, flower, 0, 2, 0, 0));
+    CuAssertTrue(testCase, !stCaf_containsRequiredSpecies(block, flower, 0, 0, 3, 0));
+    CuAssertTrue(testCase, !stCaf_containsRequiredSpecies(block, flower, 0, 0, 0, 3));
+}
+
+static void testSpeciesFilters(CuTest *testCase) {
+    setup(true);
+    Name ingroup1Seq1 = addThreadToFlower(flower, ingroup1, 100);
+    Name ingroup1Seq2 = addThreadToFlower(flower, ingroup1, 100);
+    Name ingroup2Seq1 = addThreadToFlower(flower, ingroup2, 100);
+    Name outgroup1Seq1 = addThreadToFlower(flower, outgroup1, 100);
+    Name outgroup2Seq1 = addThreadToFlower(flower, outgroup2, 100);
+
+    stPinchThreadSet *threadSet = stCaf_setup(flower);
+    stCaf_setFlowerForAlignmentFiltering(flower);
+
+    stPinchThread *ingroup1Thread1 = stPinchThreadSet_getThread(threadSet, ingroup1Seq1);
+    stPinchThread *ingroup1Thread2 = stPinchThreadSet_getThread(threadSet, ingroup1Seq2);
+    stPinchThread *ingroup2Thread1 = stPinchThreadSet_getThread(threadSet, ingroup2Seq1);
+    stPinchThread *outgroup1Thread1 = stPinchThreadSet_getThread(threadSet, outgroup1Seq1);
+    stPinchThread *outgroup2Thread1 = stPinchThreadSet_getThread(threadSet, outgroup2Seq1);
+
+    CuAssertTrue(testCase, stCaf_getEvent(stPinchThread_getFirst(ingroup2Thread1), flower) == ingroup2);
+
+    // Unaligned segments.
+    stPinchSegment *ingroup1Segment1 = stPinchThread_getSegment(ingroup1Thread1, 50);
+    stPinchSegment *ingroup1Segment2 = stPinchThread_getSegment(ingroup1Thread2, 50);
+    stPinchSegment *outgroup1Segment = stPinchThread_getSegment(outgroup1Thread1, 50);
+    stPinchSegment *outgroup2Segment = stPinchThread_getSegment(outgroup2Thread1, 50);
+    CuAssertTrue(testCase, stCaf_filterByRepeatSpecies(ingroup1Segment1, ingroup1Segment2));
+    CuAssertTrue(testCase, stCaf_singleCopyIngroup(ingroup1Segment1, ingroup1Segment2));
+    CuAssertTrue(testCase, !stCaf_singleCopyChr(ingroup1Segment1, ingroup1Segment2));
+    CuAssertTrue(testCase, !stCaf_filterByRepeatSpecies(ingroup1Segment1, outgroup1Segment));
+    CuAssertTrue(testCase, !stCaf_singleCopyIngroup(outgroup1Segment, outgroup2Segment));
+    CuAssertTrue(testCase, stCaf_filterByOutgroup(outgroup1Segment, outgroup2Segment));
+    CuAssertTrue(testCase, !stCaf_filterByOutgroup(ingroup1Segment1, outgroup2Segment));
+
+    // A block containing ingroup1 and outgroup1.
+    stPinchThread_pinch(ingroup1Thread1, outgroup1Thread1, 10, 10, 10, true);
+    stPinchSegment *blockSegment = stPinchThread_getSegment(ingroup1Thread1, 10);
+    CuAssertTrue(testCase, stCaf_filterByOutgroup(blockSegment, stPinchThread_getSegment(outgroup2Thread1, 10)));
+    CuAssertTrue(testCase, !stCaf_filterByOutgroup(blockSegment, stPinchThread_getSegment(ingroup2Thread1, 10)));
+    CuAssertTrue(testCase, stCaf_filterByRepeatSpecies(blockSegment, stPinchThread_getSegment(ingroup1Thread2, 10)));
+    CuAssertTrue(testCase, !stCaf_filterByRepeatSpecies(blockSegment, stPinchThread_getSegment(ingroup2Thread1, 10)));
+    CuAssertTrue(testCase, stCaf_singleCopyChr(blockSegment, stPinchThread_getSegment(ingroup1Thread1, 50)));
+    CuAssertTrue(testCase, !stCaf_singleCopyChr(blockSegment, stPinchThread_getSegment(ingroup2Thread1, 10)));
+    CuAssertTrue(testCase, !stCaf_singleCopyIngroup(blockSegment, outgroup2Segment));
+
+    // The species are counted the same with and without the thread table.
+    checkContainsRequiredSpecies(testCase, stPinchSegment_getBlock(blockSegment));
+    stCaf_setFlowerForAlignmentFiltering(NULL);
+    checkContainsRequiredSpecies(testCase, stPinchSegment_getBlock(blockSegment));
+
+    stPinchThreadSet_destruct(threadSet);
+    teardown();
+}
+
+// Checks that no block contains two segments from the same event, or
+// more than one outgroup segment if onlyOutgroups is set.
+static void checkBlocksHaveDistinctEvents(CuTest *testCase, stPinchThreadSet *threadSet, bool onlyOutgroups) {
+    stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+    stPinchBlock *block;
+    while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+        stSet *events = stSet_construct();
+        int64_t outgroupSegments = 0;
+        stPinchBlockIt segmentIt = stPinchBlock_getSegmentIterator(block);
+        stPinchSegment *segment;
+        while ((segment = stPinchBlockIt_getNext(&segmentIt)) != NULL) {
+            Event *event = stCaf_getEvent(segment, flower);
+            if (event_isOutgroup(event)) {
+                outgroupSegments++;
+            }
+            if (!onlyOutgroups) {
+                CuAssertTrue(testCase, stSet_search(events, event) == NULL);
+                stSet_insert(events, event);
+            }
+        }
+        CuAssertTrue(testCase, outgroupSegments <= 1);
+        stSet_destruct(events);
+    }
+}
+
+static void testSpeciesFiltersWhileAnnealing(CuTest *testCase) {
+    for (int64_t testNum = 0; testNum < 20; testNum++) {
+        bool onlyOutgroups = testNum % 2;
+        setup(true);
+        addThreadToFlower(flower, ingroup1, 100);
+        addThreadToFlower(flower, ingroup1, 100);
+        addThreadToFlower(flower, ingroup2, 100);
+        addThreadToFlower(flower, outgroup1, 100);
+        addThreadToFlower(flower, outgroup2, 100);
+        stPinchThreadSet *threadSet = stCaf_setup(flower);
+        stCaf_setFlowerForAlignmentFiltering(flower);
+
+        // The summaries of the blocks are updated as the pinches are
+        // made, so check that they stay in sync with the blocks.
+        for (int64_t i = 0; i < 500; i++) {
+            stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet);
+            stPinchThread_filterPinch(stPinchThreadSet_getThread(threadSet, pinch.name1),
+                                      stPinchThreadSet_getThread(threadSet, pinch.name2),
+                                      pinch.start1, pinch.start2, pinch.length, pinch.strand,
+                                      onlyOutgroups ? stCaf_filterByOutgroup : stCaf_filterByRepeatSpecies);
+        }
+        checkBlocksHaveDistinctEvents(testCase, threadSet, onlyOutgroups);
+
+        stCaf_setFlowerForAlignmentFiltering(NULL);
+        stPinchThreadSet_destruct(threadSet);
+        teardown();
+    }
+}
+
+static void testSpeciesFiltersAfterDirectPinches(CuTest *testCase) {
+    for (int64_t testNum = 0; testNum < 20; testNum++) {
+        setup(true);
+        addThreadToFlower(flower, ingroup1, 100);
+        addThreadToFlower(flower, ingroup1, 100);
+        addThreadToFlower(flower, ingroup2, 100);
+        addThreadToFlower(flower, outgroup1, 100);
+        addThreadToFlower(flower, outgroup2, 100);
+        stPinchThreadSet *threadSet = stCaf_setup(flower);
+        stCaf_setFlowerForAlignmentFiltering(flower);
+
+        // Mixes filtered pinches with pinches made directly, without
+        // clearing the cache, and checks the verdicts of the filters
+        // against those computed from an empty cache.
+        for (int64_t i = 0; i < 200; i++) {
+            stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet);
+            stPinchThread *thread1 = stPinchThreadSet_getThread(threadSet, pinch.name1);
+            stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet, pinch.name2);
+            stPinchSegment *segment1 = stPinchThread_getSegment(thread1, pinch.start1);
+            stPinchSegment *segment2 = stPinchThread_getSegment(thread2, pinch.start2);
+            bool repeatSpecies = stCaf_filterByRepeatSpecies(segment1, segment2);
+            bool outgroup = stCaf_filterByOutgroup(segment1, segment2);
+            stCaf_clearAlignmentFilteringCache();
+            CuAssertIntEquals(testCase, stCaf_filterByRepeatSpecies(segment1, segment2), repeatSpecies);
+            CuAssertIntEquals(testCase, stCaf_filterByOutgroup(segment1, segment2), outgroup);
+            if (st_random() > 0.5) {
+                stPinchThread_pinch(thread1, thread2, pinch.start1, pinch.start2, pinch.length, pinch.strand);
+            } else {
+                stPinchThread_filterPinch(thread1, thread2, pinch.start1, pinch.start2, pinch.length, pinch.strand,
+                                          stCaf_filterByRepeatSpecies);
+            }
+        }
+
+        stCaf_setFlowerForAlignmentFiltering(NULL);
+        stPinchThreadSet_destruct(threadSet);
+        teardown();
+    }
+}
+
+// The outgroup filters as they were before the blocks were summarised, which
+// walk the blocks and put the first outgroup segment found first.
+static bool containsOutgroupSegment(stPinchBlock *block) {
+    stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
+    stPinchSegment *segment;
+    while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
+        if (event_isOutgroup(stCaf_getEvent(segment, flower))) {
+            stPinchSegment_putSegmentFirstInBlock(segment);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static bool walkingFilterByOutgroup(stPinchSegment *segment1, stPinchSegment *segment2) {
+    stPinchBlock *block1 = stPinchSegment_getBlock(segment1);
+    stPinchBlock *block2 = stPinchSegment_getBlock(segment2);
+    if (block1 != NULL) {
+        if (block2 != NULL) {
+            if (block1 == block2) {
+                return stPinchBlock_getLength(block1) == 1 ? 0 : containsOutgroupSegment(block1);
+            }
+            if (stPinchBlock_getDegree(block1) < stPinchBlock_getDegree(block2)) {
+                return containsOutgroupSegment(block1) && containsOutgroupSegment(block2);
+            }
+            return containsOutgroupSegment(block2) && containsOutgroupSegment(block1);
+        }
+        return event_isOutgroup(stCaf_getEvent(segment2, flower)) && containsOutgroupSegment(block1);
+    }
+    if (block2 != NULL) {
+        return event_isOutgroup(stCaf_getEvent(segment1, flower)) && containsOutgroupSegment(block2);
+    }
+    return event_isOutgroup(stCaf_getEvent(segment1, flower)) && event_isOutgroup(stCaf_getEvent(segment2, flower));
+}
+
+static bool walkingRelaxedFilterByOutgroup(stPinchSegment *segment1, stPinchSegment *segment2) {
+    return stPinchSegment_getBlock(segment1) != NULL && stPinchSegment_getBlock(segment2) != NULL
+           && walkingFilterByOutgroup(segment1, segment2);
+}
+
+// Checks that the two thread sets have the same segments, and that their
+// blocks hold the same segments in the same order, so the same segment is
+// first in each block.
+static void checkBlocksAreIdentical(CuTest *testCase, stPinchThreadSet *threadSet1, stPinchThreadSet *threadSet2) {
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet1);
+    stPinchThread *thread1;
+    while ((thread1 = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet2, stPinchThread_getName(thread1));
+        stPinchSegment *segment1 = stPinchThread_getFirst(thread1);
+        while (segment1 != NULL) {
+            stPinchSegment *segment2 = stPinchThread_getSegment(thread2, stPinchSegment_getStart(segment1));
+            CuAssertIntEquals(testCase, stPinchSegment_getStart(segment1), stPinchSegment_getStart(segment2));
+            CuAssertIntEquals(testCase, stPinchSegment_getLength(segment1), stPinchSegment_getLength(segment2));
+            stPinchBlock *block1 = stPinchSegment_getBlock(segment1);
+            stPinchBlock *block2 = stPinchSegment_getBlock(segment2);
+            CuAssertTrue(testCase, (block1 == NULL) == (block2 == NULL));
+            if (block1 != NULL) {
+                CuAssertIntEquals(testCase, stPinchBlock_getDegree(block1), stPinchBlock_getDegree(block2));
+                stPinchBlockIt it1 = stPinchBlock_getSegmentIterator(block1);
+                stPinchBlockIt it2 = stPinchBlock_getSegmentIterator(block2);
+                stPinchSegment *blockSegment1, *blockSegment2;
+                while ((blockSegment1 = stPinchBlockIt_getNext(&it1)) != NULL) {
+                    blockSegment2 = stPinchBlockIt_getNext(&it2);
+                    CuAssertTrue(testCase, blockSegment2 != NULL);
+                    CuAssertIntEquals(testCase, stPinchSegment_getName(blockSegment1),
+                                      stPinchSegment_getName(blockSegment2));
+                    CuAssertIntEquals(testCase, stPinchSegment_getStart(blockSegment1),
+                                      stPinchSegment_getStart(blockSegment2));
+                    CuAssertIntEquals(testCase, stPinchSegment_getBlockOrientation(blockSegment1),
+                                      stPinchSegment_getBlockOrientation(blockSegment2));
+                }
+            }
+            segment1 = stPinchSegment_get3Prime(segment1);
+        }
+    }
+}
+
+static void testOutgroupFiltersMatchWalkingFilters(CuTest *testCase) {
+    for (int64_t testNum = 0; testNum < 20; testNum++) {
+        bool relaxed = testNum % 2;
+        setup(true);
+        addThreadToFlower(flower, ingroup1, 100);
+        addThreadToFlower(flower, ingroup1, 100);
+        addThreadToFlower(flower, ingroup2, 100);
+        addThreadToFlower(flower, outgroup1, 100);
+        addThreadToFlower(flower, outgroup2, 100);
+        stPinchThreadSet *threadSet1 = stCaf_setup(flower);
+        stPinchThreadSet *threadSet2 = stCaf_setup(flower);
+        stCaf_setFlowerForAlignmentFiltering(flower);
+
+        // Makes the same pinches in both thread sets, filtered by the
+        // summarised filter in one and the walking filter in the other,
+        // which must leave the blocks, and so the cactus graph, the same.
+        for (int64_t i = 0; i < 500; i++) {
+            stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet1);
+            stPinchThread_filterPinch(stPinchThreadSet_getThread(threadSet1, pinch.name1),
+                                      stPinchThreadSet_getThread(threadSet1, pinch.name2),
+                                      pinch.start1, pinch.start2, pinch.length, pinch.strand,
+                                      relaxed ? stCaf_relaxedFilterByOutgroup : stCaf_filterByOutgroup);
+            stPinchThread_filterPinch(stPinchThreadSet_getThread(threadSet2, pinch.name1),
+                                      stPinchThreadSet_getThread(threadSet2, pinch.name2),
+                                      pinch.start1, pinch.start2, pinch.length, pinch.strand,
+                                      relaxed ? walkingRelaxedFilterByOutgroup : walkingFilterByOutgroup);
+        }
+        checkBlocksAreIdentical(testCase, threadSet1, threadSet2);
+
+        stCaf_setFlowerForAlignmentFiltering(NULL);
+        stPinchThreadSet_destruct(threadSet1);
+        stPinchThreadSet_destruct(threadSet2);
+        teardown();
+    }
+}
+
 CuSuite* filteringTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testChainHasUnequalNumberOfIngroupCopies);
     SUITE_ADD_TEST(suite, testChainHasUnequalNumberOfIngroupCopiesOrNoOutgroup);
     SUITE_ADD_TEST(suite, testChainHasUnequalNumberOfIngroupCopiesOrNoOutgroup_noOutgroups);
     SUITE_ADD_TEST(suite, testHGVMFiltering);
+    SUITE_ADD_TEST(suite, testSpeciesFilters);
+    SUITE_ADD_TEST(suite, testSpeciesFiltersWhileAnnealing);
+    SUITE_ADD_TEST(suite, testSpeciesFiltersAfterDirectPinches);
+    SUITE_ADD_TEST(suite, testOutgroupFiltersMatchWalkingFilters);
     return suite;
 }
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "CuTest.h"
+#include "sonLib.h"
+#include "stCaf.h"
+#include "stPinchGraphs.h"
+
+static bool hasOddDegreeAndLength(stPinchBlock *block, int64_t *minimumLength) {
+    return stPinchBlock_getDegree(block) % 2 == 1 && stPinchBlock_getLength(block) >= *minimumLength;
+}
+
+static void testScanBlocks(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting block scan random test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet = stPinchThreadSet_getRandomGraph();
+        int64_t minimumLength = st_randomInt(1, 10);
+        stList *blocks = stCaf_getBlocks(threadSet);
+        CuAssertIntEquals(testCase, stPinchThreadSet_getTotalBlockNumber(threadSet), stList_length(blocks));
+        bool *results = stCaf_scanBlocks(blocks, (bool (*)(stPinchBlock *, void *)) hasOddDegreeAndLength,
+                &minimumLength, st_randomInt(1, 5));
+        for (int64_t i = 0; i < stList_length(blocks); i++) {
+            CuAssertIntEquals(testCase, hasOddDegreeAndLength(stList_get(blocks, i), &minimumLength), results[i]);
+        }
+        free(results);
+        stList_destruct(blocks);
+        stPinchThreadSet_destruct(threadSet);
+    }
+}
+
+
+static void getDegree(stPinchBlock *block, int64_t index, int64_t *degrees) {
+    degrees[index] = stPinchBlock_getDegree(block);
+}
+
+static void testMapBlocks(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting block map random test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet = stPinchThreadSet_getRandomGraph();
+        stList *blocks = stCaf_getBlocks(threadSet);
+        int64_t *degrees = st_calloc(stList_length(blocks) + 1, sizeof(int64_t));
+        stCaf_mapBlocks(blocks, (void (*)(stPinchBlock *, int64_t, void *)) getDegree, degrees, st_randomInt(1, 5));
+        for (int64_t i = 0; i < stList_length(blocks); i++) {
+            CuAssertIntEquals(testCase, stPinchBlock_getDegree(stList_get(blocks, i)), degrees[i]);
+        }
+        free(degrees);
+        stList_destruct(blocks);
+        stPinchThreadSet_destruct(threadSet);
+    }
+}
+
+// Checks the two graphs have the same segments, grouped into blocks in the same way.
+static void checkGraphsAreEquivalent(CuTest *testCase, stPinchThreadSet *threadSet1, stPinchThreadSet *threadSet2) {
+    CuAssertIntEquals(testCase, stPinchThreadSet_getTotalBlockNumber(threadSet1), stPinchThreadSet_getTotalBlockNumber(threadSet2));
+    stHash *blocks1To2 = stHash_construct();
+    stHash *orientations1To2 = stHash_construct();
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet1);
+    stPinchThread *thread;
+    while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        stPinchSegment *segment1 = stPinchThread_getFirst(thread);
+        stPinchSegment *segment2 = stPinchThread_getFirst(stPinchThreadSet_getThread(threadSet2, stPinchThread_getName(thread)));
+        while (segment1 != NULL && segment2 != NULL) {
+            CuAssertIntEquals(testCase, stPinchSegment_getStart(segment1), stPinchSegment_getStart(segment2));
+            CuAssertIntEquals(testCase, stPinchSegment_getLength(segment1), stPinchSegment_getLength(segment2));
+            stPinchBlock *block1 = stPinchSegment_getBlock(segment1), *block2 = stPinchSegment_getBlock(segment2);
+            CuAssertTrue(testCase, (block1 == NULL) == (block2 == NULL));
+            if (block1 != NULL) {
+                // The blocks must correspond one to one, with the same relative orientation for all their segments.
+                stPinchBlock *mappedBlock = stHash_search(blocks1To2, block1);
+                bool sameOrientation = stPinchSegment_getBlockOrientation(segment1) == stPinchSegment_getBlockOrientation(segment2);
+                if (mappedBlock == NULL) {
+                    stHash_insert(blocks1To2, block1, block2);
+                    if (sameOrientation) {
+                        stHash_insert(orientations1To2, block1, block2);
+                    }
+                } else {
+                    CuAssertPtrEquals(testCase, mappedBlock, block2);
+                    CuAssertTrue(testCase, sameOrientation == (stHash_search(orientations1To2, block1) != NULL));
+                }
+            }
+            segment1 = stPinchSegment_get3Prime(segment1);
+            segment2 = stPinchSegment_get3Prime(segment2);
+        }
+        CuAssertTrue(testCase, segment1 == NULL && segment2 == NULL);
+    }
+    stHash_destruct(blocks1To2);
+    stHash_destruct(orientations1To2);
+}
+
+static void testMeltInRoundsMatchesRepeatedMelting(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting melting in rounds random test %" PRIi64 "\n", test);
+        CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+        eventTree_construct2(cactusDisk);
+        // A top level flower, so melts that split a thread component are exercised.
+        Flower *flower = flower_construct2(0, cactusDisk);
+        group_construct2(flower);
+        flower_check(flower);
+        int64_t threadNumber = st_randomInt(2, 6);
+        for (int64_t i = 0; i < threadNumber; i++) {
+            char *header = stString_print("%" PRIi64, i);
+            testCommon_addThreadToFlower(flower, header, st_randomInt(50, 300));
+            free(header);
+        }
+
+        // Make the same random pinches in two copies of the graph.
+        stPinchThreadSet *threadSet1 = stCaf_setup(flower);
+        stPinchThreadSet *threadSet2 = stCaf_setup(flower);
+        int64_t pinchNumber = st_randomInt(0, 100);
+        for (int64_t i = 0; i < pinchNumber; i++) {
+            stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet1);
+            pinch.length = pinch.length < 20 ? pinch.length : st_randomInt(1, 20);
+            stPinchThread_pinch(stPinchThreadSet_getThread(threadSet1, pinch.name1), stPinchThreadSet_getThread(threadSet1, pinch.name2),
+                    pinch.start1, pinch.start2, pinch.length, pinch.strand);
+            stPinchThread_pinch(stPinchThreadSet_getThread(threadSet2, pinch.name1), stPinchThreadSet_getThread(threadSet2, pinch.name2),
+                    pinch.start1, pinch.start2, pinch.length, pinch.strand);
+        }
+
+        // Melt one in rounds and the other with a call to stCaf_melt per round.
+        int64_t roundNumber = st_randomInt(0, 5);
+        int64_t *minimumChainLengths = st_calloc(roundNumber + 1, sizeof(int64_t));
+        for (int64_t i = 0; i < roundNumber; i++) {
+            minimumChainLengths[i] = (i > 0 ? minimumChainLengths[i - 1] : 0) + st_randomInt(0, 30);
+        }
+        stCaf_meltInRounds(flower, threadSet1, minimumChainLengths, roundNumber);
+        for (int64_t i = 0; i < roundNumber; i++) {
+            stCaf_melt(flower, threadSet2, NULL, 0, minimumChainLengths[i], 0, INT64_MAX);
+        }
+        checkGraphsAreEquivalent(testCase, threadSet1, threadSet2);
+
+        free(minimumChainLengths);
+        stPinchThreadSet_destruct(threadSet1);
+        stPinchThreadSet_destruct(threadSet2);
+        testCommon_deleteTemporaryCactusDisk(cactusDisk);
+    }
+}
+
+CuSuite* meltingTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testScanBlocks);
+    SUITE_ADD_TEST(suite, testMapBlocks);
+    SUITE_ADD_TEST(suite, testMeltInRoundsMatchesRepeatedMelting);
+    return suite;
+}
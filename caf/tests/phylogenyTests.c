@@ -1,3 +1,4 @@
+#include <math.h>
 #include "CuTest.h"
 #include "sonLib.h"
 #include "cactus.h"
@@ -394,6 +395,75 @@ static void test_stCaf_getHomologyUnits(CuTest *testCase) {
     }
 }
 
+static bool cellsAreEqual(double cell1, double cell2) {
+    return cell1 == cell2 || (isnan(cell1) && isnan(cell2));
+}
+
+static void test_stCaf_getDistanceMatricesForUnitsP(CuTest *testCase, stPinchThreadSet *(*setup)(Flower *, stList **)) {
+    CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+    eventTree_construct2(cactusDisk);
+    Flower *flower = flower_construct2(0, cactusDisk);
+    group_construct2(flower);
+
+    stList *chain = NULL;
+    stPinchThreadSet *threadSet = setup(flower, &chain);
+    stHash *threadStrings = stCaf_getThreadStrings(flower, threadSet);
+    stHash *blocksToHomologyUnits = stHash_construct();
+    stSet *homologyUnits = stCaf_getHomologyUnits(flower, threadSet, blocksToHomologyUnits, CHAIN);
+
+    stCaf_PhylogenyParameters params;
+    memset(&params, 0, sizeof(params));
+    params.distanceCorrectionMethod = st_random() > 0.5 ? JUKES_CANTOR : NONE;
+    params.maxBaseDistance = st_randomInt64(0, 1000);
+    params.maxBlockDistance = st_randomInt64(0, 100);
+    params.ignoreUnalignedBases = st_random() > 0.5;
+    params.onlyIncludeCompleteFeatureBlocks = st_random() > 0.5;
+
+    // The matrices made on the pool, with one thread and with several,
+    // must be the same as those made one at a time on this thread.
+    int64_t threadNumbers[] = { 1, st_randomInt64(2, 9) };
+    for (int64_t i = 0; i < 2; i++) {
+        params.numTreeBuildingThreads = threadNumbers[i];
+        stHash *unitToDistanceMatrix = stCaf_getDistanceMatricesForUnits(homologyUnits, threadStrings, &params);
+        CuAssertIntEquals(testCase, stSet_size(homologyUnits), stHash_size(unitToDistanceMatrix));
+        stSetIterator *unitIt = stSet_getIterator(homologyUnits);
+        HomologyUnit *unit;
+        while ((unit = stSet_getNext(unitIt)) != NULL) {
+            stMatrix *distanceMatrix = stHash_search(unitToDistanceMatrix, unit);
+            CuAssertTrue(testCase, distanceMatrix != NULL);
+            stMatrix *serialDistanceMatrix = stCaf_getDistanceMatrixForUnit(unit, threadStrings, &params);
+            CuAssertIntEquals(testCase, stMatrix_m(serialDistanceMatrix), stMatrix_m(distanceMatrix));
+            CuAssertIntEquals(testCase, stMatrix_n(serialDistanceMatrix), stMatrix_n(distanceMatrix));
+            for (int64_t j = 0; j < stMatrix_m(distanceMatrix); j++) {
+                for (int64_t k = 0; k < stMatrix_n(distanceMatrix); k++) {
+                    CuAssertTrue(testCase, cellsAreEqual(*stMatrix_getCell(serialDistanceMatrix, j, k),
+                                                         *stMatrix_getCell(distanceMatrix, j, k)));
+                }
+            }
+            stMatrix_destruct(serialDistanceMatrix);
+        }
+        stSet_destructIterator(unitIt);
+        stHash_destruct(unitToDistanceMatrix);
+    }
+
+    stHash_destruct(blocksToHomologyUnits);
+    stSet_destruct(homologyUnits);
+    stHash_destruct(threadStrings);
+    stList_destruct(chain);
+    stPinchThreadSet_destruct(threadSet);
+    testCommon_deleteTemporaryCactusDisk(cactusDisk);
+}
+
+// Test that building the distance matrices in parallel doesn't change them.
+static void test_stCaf_getDistanceMatricesForUnits(CuTest *testCase) {
+    test_stCaf_getDistanceMatricesForUnitsP(testCase, setupTestChain);
+    test_stCaf_getDistanceMatricesForUnitsP(testCase, setupTestChainWithChildChains);
+    test_stCaf_getDistanceMatricesForUnitsP(testCase, setupTestChainWithTandemDup);
+    for (int64_t i = 0; i < 5; i++) {
+        test_stCaf_getDistanceMatricesForUnitsP(testCase, setupRandom);
+    }
+}
+
 static void test_stCaf_findAndRemoveSplitBranches(CuTest *testCase) {
     stTree *speciesTree = stTree_parseNewickString("((human,(mouse,rat)Anc3)Anc2,(cow,dog)Anc1)Anc0;");
     // Here the reference event is Anc3.
@@ -493,6 +563,7 @@ CuSuite *phylogenyTestSuite(void) {
     SUITE_ADD_TEST(suite, test_stCaf_splitChain);
     SUITE_ADD_TEST(suite, test_stCaf_findAndRemoveSplitBranches);
     SUITE_ADD_TEST(suite, test_stCaf_getHomologyUnits);
+    SUITE_ADD_TEST(suite, test_stCaf_getDistanceMatricesForUnits);
     SUITE_ADD_TEST(suite, test_stCaf_correctChainOrientation);
 
     return suite;
@@ -7,7 +7,9 @@
 #include "CuTest.h"
 #include "sonLib.h"
 #include "stPinchIterator.h"
+#include "stLastzAlignments.h"
 #include "pairwiseAlignment.h"
+#include "cactus.h"
 #include <math.h>
 
 static void testIterator(CuTest *testCase, stPinchIterator *pinchIterator, stList *randomPairwiseAlignments) {
@@ -106,6 +108,61 @@ static void testPinchIteratorFromFile(CuTest *testCase) {
     }
 }
 
+static void testPinchIteratorFromBinaryFile(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        stList *pairwiseAlignments = getRandomPairwiseAlignments();
+        st_logInfo("Doing a random pinch iterator from binary file test %" PRIi64 " with %" PRIi64 " alignments\n", test, stList_length(pairwiseAlignments));
+        //Put alignments in a file and convert it
+        char *tempFile = "tempFileForPinchIteratorTest.cig";
+        char *tempBinaryFile = "tempFileForPinchIteratorTest.pinches";
+        FILE *fileHandle = fopen(tempFile, "w");
+        for (int64_t i = 0; i < stList_length(pairwiseAlignments); i++) {
+            cigarWrite(fileHandle, stList_get(pairwiseAlignments, i), 0);
+        }
+        fclose(fileHandle);
+        stPinchIterator_writeBinaryFile(tempFile, tempBinaryFile);
+        //Get an iterator
+        stPinchIterator *pinchIterator = stPinchIterator_constructFromBinaryFile(tempBinaryFile);
+        //Now test it
+        testIterator(testCase, pinchIterator, pairwiseAlignments);
+        //Cleanup
+        stPinchIterator_destruct(pinchIterator);
+        stFile_rmrf(tempFile);
+        stFile_rmrf(tempBinaryFile);
+        stList_destruct(pairwiseAlignments);
+    }
+}
+
+static void testPinchIteratorFromSortedFile(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        stList *pairwiseAlignments = getRandomPairwiseAlignments();
+        st_logInfo("Doing a random sorted pinch iterator test %" PRIi64 " with %" PRIi64 " alignments\n", test, stList_length(pairwiseAlignments));
+        //Give the alignments distinct scores and write them out unsorted
+        char *tempFile = "tempFileForPinchIteratorTest.cig";
+        char *tempSortedFile = "tempFileForPinchIteratorTest.sorted";
+        FILE *fileHandle = fopen(tempFile, "w");
+        for (int64_t i = 0; i < stList_length(pairwiseAlignments); i++) {
+            struct PairwiseAlignment *pairwiseAlignment = stList_get(pairwiseAlignments, i);
+            pairwiseAlignment->score = (i * 7919) % 10007;
+            cigarWrite(fileHandle, pairwiseAlignment, 0);
+        }
+        fclose(fileHandle);
+        stCaf_sortCigarsByScoreInDescendingOrder(pairwiseAlignments);
+        //Sort with a tiny memory budget, so that runs get spilled and merged, to both output formats
+        for (int64_t binary = 0; binary < 2; binary++) {
+            stCaf_sortCigarsFile(tempFile, tempSortedFile, binary, st_randomInt(1, 4), st_randomInt(1, 5) * 24);
+            stPinchIterator *pinchIterator = binary ? stPinchIterator_constructFromBinaryFile(tempSortedFile) :
+                    stPinchIterator_constructFromFile(tempSortedFile);
+            testIterator(testCase, pinchIterator, pairwiseAlignments);
+            stPinchIterator_destruct(pinchIterator);
+            stFile_rmrf(tempSortedFile);
+        }
+        //Cleanup
+        stFile_rmrf(tempFile);
+        stList_destruct(pairwiseAlignments);
+    }
+}
+
 static void testPinchIteratorFromList(CuTest *testCase) {
     for (int64_t test = 0; test < 100; test++) {
         stList *pairwiseAlignments = getRandomPairwiseAlignments();
@@ -120,9 +177,112 @@ static void testPinchIteratorFromList(CuTest *testCase) {
     }
 }
 
+// Adds a sequence with the given nucleotides to the flower.
+static void addSequenceToFlower(Flower *flower, Event *event, const char *dna) {
+    int64_t length = strlen(dna);
+    MetaSequence *metaSequence = metaSequence_construct(2, length, (char *) dna, "", event_getName(event),
+            flower_getCactusDisk(flower));
+    Sequence *sequence = sequence_construct(metaSequence, flower);
+    Cap *cap1 = cap_construct2(end_construct2(0, 0, flower), 1, 1, sequence);
+    Cap *cap2 = cap_construct2(end_construct2(1, 0, flower), length + 2, 1, sequence);
+    cap_makeAdjacent(cap1, cap2);
+}
+
+static int comparePinches(const stPinch *pinch1, const stPinch *pinch2) {
+    int64_t fields1[] = { pinch1->name1, pinch1->name2, pinch1->start1, pinch1->start2, pinch1->length, pinch1->strand };
+    int64_t fields2[] = { pinch2->name1, pinch2->name2, pinch2->start1, pinch2->start2, pinch2->length, pinch2->strand };
+    for (int64_t i = 0; i < 6; i++) {
+        if (fields1[i] != fields2[i]) {
+            return fields1[i] < fields2[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// Copies out the pinches of the iterator, and destructs it.
+static stList *getPinches(stPinchIterator *pinchIterator) {
+    stList *pinches = stList_construct3(0, free);
+    stPinch *pinch;
+    while ((pinch = stPinchIterator_getNext(pinchIterator)) != NULL) {
+        stPinch *pinchCopy = st_malloc(sizeof(stPinch));
+        *pinchCopy = *pinch;
+        stList_append(pinches, pinchCopy);
+    }
+    stPinchIterator_destruct(pinchIterator);
+    return pinches;
+}
+
+static void checkPinchesAreEqual(CuTest *testCase, stList *pinches1, stList *pinches2) {
+    CuAssertIntEquals(testCase, stList_length(pinches1), stList_length(pinches2));
+    for (int64_t i = 0; i < stList_length(pinches1); i++) {
+        CuAssertIntEquals(testCase, 0, comparePinches(stList_get(pinches1, i), stList_get(pinches2, i)));
+    }
+}
+
+static void testSelfAlignFlowerToBinaryPinchFile(CuTest *testCase) {
+    CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+    EventTree *eventTree = eventTree_construct2(cactusDisk);
+    Event *event = event_construct3("species", 0.2, eventTree_getRootEvent(eventTree), eventTree);
+    Flower *flower = flower_construct(cactusDisk);
+    // Copies of a random sequence, one with some substitutions, so lastz has something to align.
+    char *dna = stRandom_getRandomDNAString(1000, true, false, false);
+    char *mutatedDna = stString_copy(dna);
+    for (int64_t i = 0; i < 1000; i += 50) {
+        mutatedDna[i] = mutatedDna[i] == 'A' ? 'C' : 'A';
+    }
+    addSequenceToFlower(flower, event, dna);
+    addSequenceToFlower(flower, event, dna);
+    addSequenceToFlower(flower, event, mutatedDna);
+    char *tempFile = "tempFileForPinchIteratorTest.fa";
+    char *tempBinaryFile = "tempFileForPinchIteratorTest.pinches";
+
+    // The pinches of the alignments made by the text path, in lastz order and sorted by score.
+    stList *cigars = stCaf_selfAlignFlower(flower, 0, "", 0, "", tempFile);
+    CuAssertTrue(testCase, stList_length(cigars) > 0);
+    stList *pinches = getPinches(stPinchIterator_constructFromList(cigars));
+    stCaf_sortCigarsByScoreInDescendingOrder(cigars);
+    stList *sortedPinches = getPinches(stPinchIterator_constructFromList(cigars));
+
+    for (int64_t sortAlignments = 0; sortAlignments < 2; sortAlignments++) {
+        int64_t alignmentNumber = stCaf_selfAlignFlowerToBinaryPinchFile(flower, 0, "", 0, "", tempFile, tempBinaryFile,
+                sortAlignments, st_randomInt(1, 4), 0);
+        CuAssertIntEquals(testCase, stList_length(cigars), alignmentNumber);
+        stList *binaryPinches = getPinches(stPinchIterator_constructFromBinaryFile(tempBinaryFile));
+        if (sortAlignments) {
+            // Alignments with equal scores may be ordered differently by the two sorts,
+            // so the sorted pinches are compared as sets.
+            stList_sort(binaryPinches, (int (*)(const void *, const void *)) comparePinches);
+            stList_sort(sortedPinches, (int (*)(const void *, const void *)) comparePinches);
+            checkPinchesAreEqual(testCase, sortedPinches, binaryPinches);
+        } else {
+            checkPinchesAreEqual(testCase, pinches, binaryPinches);
+        }
+        stList_destruct(binaryPinches);
+    }
+
+    // No sequence is long enough to align, so the pinch file is empty.
+    CuAssertIntEquals(testCase, 0, stCaf_selfAlignFlowerToBinaryPinchFile(flower, 2000, "", 0, "", tempFile,
+            tempBinaryFile, 0, 1, 0));
+    stList *binaryPinches = getPinches(stPinchIterator_constructFromBinaryFile(tempBinaryFile));
+    CuAssertIntEquals(testCase, 0, stList_length(binaryPinches));
+
+    stList_destruct(binaryPinches);
+    stList_destruct(pinches);
+    stList_destruct(sortedPinches);
+    stList_destruct(cigars);
+    stFile_rmrf(tempFile);
+    stFile_rmrf(tempBinaryFile);
+    free(dna);
+    free(mutatedDna);
+    testCommon_deleteTemporaryCactusDisk(cactusDisk);
+}
+
 CuSuite* pinchIteratorTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testPinchIteratorFromFile);
+    SUITE_ADD_TEST(suite, testPinchIteratorFromBinaryFile);
+    SUITE_ADD_TEST(suite, testPinchIteratorFromSortedFile);
     SUITE_ADD_TEST(suite, testPinchIteratorFromList);
+    SUITE_ADD_TEST(suite, testSelfAlignFlowerToBinaryPinchFile);
     return suite;
 }
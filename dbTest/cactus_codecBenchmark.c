@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "cactus.h"
+#include "sonLib.h"
+
+/*
+ * Benchmarks the record compression codecs on the flower records of an existing cactus disk,
+ * reporting the total compressed size (a proxy for the database size) and the compression and
+ * decompression throughput of each codec available in this build.
+ */
+
+void usage() {
+    fprintf(stderr, "cactus_codecBenchmark, version 0.1\n");
+    fprintf(stderr, "-a --logLevel : Set the log level\n");
+    fprintf(stderr, "-c --cactusDisk : The location of the flower disk directory\n");
+    fprintf(stderr, "-i --iterations : Number of times to compress and decompress each record (default 3)\n");
+    fprintf(stderr, "-h --help : Print this help screen\n");
+}
+
+static double getSeconds(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1.0e9;
+}
+
+static stList *getFlowerNames(CactusDisk *cactusDisk) {
+    /*
+     * Gets the names of all the flowers in the tree, unloading each flower once its children are known.
+     */
+    stList *flowerNames = stList_construct3(0, (void (*)(void *)) stIntTuple_destruct);
+    stList *stack = stList_construct3(0, (void (*)(void *)) stIntTuple_destruct);
+    stList_append(stack, stIntTuple_construct1(0));
+    while (stList_length(stack) > 0) {
+        stIntTuple *flowerName = stList_pop(stack);
+        Flower *flower = cactusDisk_getFlower(cactusDisk, stIntTuple_get(flowerName, 0));
+        if (flower == NULL) {
+            st_errAbort("Could not find the flower %" PRIi64 " in the cactus disk", stIntTuple_get(flowerName, 0));
+        }
+        stList_append(flowerNames, flowerName);
+        Flower_GroupIterator *groupIt = flower_getGroupIterator(flower);
+        Group *group;
+        while ((group = flower_getNextGroup(groupIt)) != NULL) {
+            if (!group_isLeaf(group)) {
+                stList_append(stack, stIntTuple_construct1(group_getName(group)));
+            }
+        }
+        flower_destructGroupIterator(groupIt);
+        flower_unload(flower);
+    }
+    stList_destruct(stack);
+    return flowerNames;
+}
+
+int main(int argc, char *argv[]) {
+    char * logLevelString = NULL;
+    char * cactusDiskDatabaseString = NULL;
+    int64_t iterations = 3;
+
+    while (1) {
+        static struct option long_options[] = { { "logLevel", required_argument, 0, 'a' },
+                { "cactusDisk", required_argument, 0, 'c' }, { "iterations", required_argument, 0, 'i' },
+                { "help", no_argument, 0, 'h' }, { 0, 0, 0, 0 } };
+
+        int option_index = 0;
+
+        int key = getopt_long(argc, argv, "a:c:i:h", long_options, &option_index);
+
+        if (key == -1) {
+            break;
+        }
+
+        switch (key) {
+            case 'a':
+                logLevelString = stString_copy(optarg);
+                break;
+            case 'c':
+                cactusDiskDatabaseString = stString_copy(optarg);
+                break;
+            case 'i':
+                sscanf(optarg, "%" PRIi64 "", &iterations);
+                break;
+            case 'h':
+                usage();
+                return 0;
+            default:
+                usage();
+                return 1;
+        }
+    }
+
+    if (cactusDiskDatabaseString == NULL || iterations < 1) {
+        usage();
+        return 1;
+    }
+
+    st_setLogLevelFromString(logLevelString);
+
+    //////////////////////////////////////////////
+    //Get the names of the flowers, then read their records directly from the database
+    //////////////////////////////////////////////
+
+    stKVDatabaseConf *kvDatabaseConf = stKVDatabaseConf_constructFromString(cactusDiskDatabaseString);
+    CactusDisk *cactusDisk = cactusDisk_construct(kvDatabaseConf, false, false);
+    stList *flowerNames = getFlowerNames(cactusDisk);
+    cactusDisk_destruct(cactusDisk);
+    st_logInfo("Found %" PRIi64 " flowers\n", stList_length(flowerNames));
+
+    stKVDatabase *database = stKVDatabase_construct(kvDatabaseConf, false);
+    stList *records = stList_construct3(0, free);
+    stList *recordSizes = stList_construct3(0, (void (*)(void *)) stIntTuple_destruct);
+    int64_t storedBytes = 0, totalBytes = 0;
+    for (int64_t i = 0; i < stList_length(flowerNames); i++) {
+        int64_t storedSize, recordSize;
+        void *stored = stKVDatabase_getRecord2(database, stIntTuple_get(stList_get(flowerNames, i), 0), &storedSize);
+        assert(stored != NULL);
+        stList_append(records, cactusCompression_decompress(stored, storedSize, &recordSize));
+        stList_append(recordSizes, stIntTuple_construct1(recordSize));
+        storedBytes += storedSize;
+        totalBytes += recordSize;
+        free(stored);
+    }
+    stKVDatabase_destruct(database);
+
+    //////////////////////////////////////////////
+    //Benchmark each codec
+    //////////////////////////////////////////////
+
+    fprintf(stdout, "Records: %" PRIi64 ", uncompressed bytes: %" PRIi64 ", bytes as stored: %" PRIi64 "\n",
+            stList_length(records), totalBytes, storedBytes);
+    fprintf(stdout, "%-10s %15s %8s %14s %16s %10s %12s %14s\n", "codec", "compressedBytes", "ratio", "compressMB/s",
+            "decompressMB/s", "sizeVsZlib", "compVsZlib", "decompVsZlib");
+    //The zlib row is measured first and every other codec is reported relative to it as well, so
+    //results from different disks and machines can be compared.
+    double zlibBytes = 0.0, zlibCompressRate = 0.0, zlibDecompressRate = 0.0;
+    for (int64_t codec = CACTUS_CODEC_ZLIB; codec <= CACTUS_CODEC_ZSTD; codec++) {
+        if (!cactusCompression_isAvailable(codec)) {
+            fprintf(stdout, "%-10s not available in this build\n", cactusCompression_getCodecName(codec));
+            continue;
+        }
+        int64_t compressedBytes = 0;
+        double compressTime = 0.0, decompressTime = 0.0;
+        for (int64_t i = 0; i < stList_length(records); i++) {
+            void *record = stList_get(records, i);
+            int64_t recordSize = stIntTuple_get(stList_get(recordSizes, i), 0);
+            for (int64_t j = 0; j < iterations; j++) {
+                int64_t compressedSize, uncompressedSize;
+                double startTime = getSeconds();
+                void *compressed = cactusCompression_compress(codec, record, recordSize, &compressedSize);
+                double midTime = getSeconds();
+                void *uncompressed = cactusCompression_decompress(compressed, compressedSize, &uncompressedSize);
+                double endTime = getSeconds();
+                if (uncompressedSize != recordSize || memcmp(uncompressed, record, recordSize) != 0) {
+                    st_errAbort("The %s codec did not round trip a record", cactusCompression_getCodecName(codec));
+                }
+                compressTime += midTime - startTime;
+                decompressTime += endTime - midTime;
+                if (j == 0) {
+                    compressedBytes += compressedSize;
+                }
+                free(compressed);
+                free(uncompressed);
+            }
+        }
+        double megabytes = ((double) totalBytes * iterations) / 1.0e6;
+        double compressRate = compressTime > 0.0 ? megabytes / compressTime : 0.0;
+        double decompressRate = decompressTime > 0.0 ? megabytes / decompressTime : 0.0;
+        if (codec == CACTUS_CODEC_ZLIB) {
+            zlibBytes = compressedBytes;
+            zlibCompressRate = compressRate;
+            zlibDecompressRate = decompressRate;
+        }
+        fprintf(stdout, "%-10s %15" PRIi64 " %8.3f %14.1f %16.1f %10.3f %12.2f %14.2f\n",
+                cactusCompression_getCodecName(codec), compressedBytes,
+                totalBytes > 0 ? (double) compressedBytes / totalBytes : 0.0, compressRate, decompressRate,
+                zlibBytes > 0.0 ? compressedBytes / zlibBytes : 0.0,
+                zlibCompressRate > 0.0 ? compressRate / zlibCompressRate : 0.0,
+                zlibDecompressRate > 0.0 ? decompressRate / zlibDecompressRate : 0.0);
+    }
+
+    stList_destruct(records);
+    stList_destruct(recordSizes);
+    stList_destruct(flowerNames);
+    stKVDatabaseConf_destruct(kvDatabaseConf);
+    free(cactusDiskDatabaseString);
+    free(logLevelString);
+
+    return 0;
+}
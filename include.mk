@@ -11,5 +11,15 @@ include ${sonLibRootPath}/include.mk
 dataSetsPath=/Users/benedictpaten/Dropbox/Documents/work/myPapers/genomeCactusPaper/dataSets
 
 cflags += -I ${sonLibPath}
-basicLibs = ${sonLibPath}/sonLib.a ${sonLibPath}/cuTest.a ${dblibs}
+basicLibs = ${sonLibPath}/sonLib.a ${sonLibPath}/cuTest.a ${dblibs} -lz -lpthread
 basicLibsDependencies = ${sonLibPath}/sonLib.a ${sonLibPath}/cuTest.a 
+
+#Optional record compression codecs, enable with e.g. make HAVE_LZ4=1 HAVE_ZSTD=1
+ifdef HAVE_LZ4
+cflags += -DHAVE_LZ4
+basicLibs += -llz4
+endif
+ifdef HAVE_ZSTD
+cflags += -DHAVE_ZSTD
+basicLibs += -lzstd
+endif
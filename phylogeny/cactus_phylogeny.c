@@ -668,6 +668,7 @@ int main(int argc, char *argv[]) {
 
     stKVDatabaseConf *kvDatabaseConf = stKVDatabaseConf_constructFromString(cactusDiskDatabaseString);
     cactusDisk = cactusDisk_construct(kvDatabaseConf, false, true);
+    cactusDisk_setOptionsFromConfString(cactusDisk, cactusDiskDatabaseString);
     st_logInfo("Set up the flower disk\n");
 
     //////////////////////////////////////////////
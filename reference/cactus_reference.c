@@ -224,6 +224,7 @@ int main(int argc, char *argv[]) {
 
     stKVDatabaseConf *kvDatabaseConf = stKVDatabaseConf_constructFromString(cactusDiskDatabaseString);
     CactusDisk *cactusDisk = cactusDisk_construct(kvDatabaseConf, false, true);
+    cactusDisk_setOptionsFromConfString(cactusDisk, cactusDiskDatabaseString);
     st_logInfo("Set up the flower disk\n");
 
     ///////////////////////////////////////////////////////////////////////////
@@ -234,7 +235,8 @@ int main(int argc, char *argv[]) {
     useSimulatedAnnealing ? exponentiallyDecreasingTemperatureFn
     : constantTemperatureFn;
 
-    FlowerStream *flowerStream = flowerWriter_getFlowerStream(cactusDisk, stdin);
+    FlowerStream *flowerStream = flowerWriter_getDecompressingFlowerStream(cactusDisk, stdin,
+            FLOWER_STREAM_DEFAULT_DECOMPRESSION_BATCHES, 1);
     Flower *flower;
     while ((flower = flowerStream_getNext(flowerStream)) != NULL) {
         st_logInfo("Processing flower %" PRIi64 "\n", flower_getName(flower));
@@ -12,15 +12,27 @@
 #include "cactus.h"
 #include "sonLib.h"
 
-static void *compress(char *string, int64_t *dataSize) {
-    void *data = stCompression_compress(string, strlen(string) + 1, dataSize, 1); //going with least, fastest compression-1);
+static CactusCodec getCodec(stList *caps) {
+    /*
+     * The thread records are transient, so unless a different codec was chosen for the cactus disk
+     * we go with the least, fastest zlib compression.
+     */
+    if (stList_length(caps) == 0) {
+        return CACTUS_CODEC_ZLIB_FAST;
+    }
+    CactusCodec codec = cactusDisk_getCodec(flower_getCactusDisk(end_getFlower(cap_getEnd(stList_get(caps, 0)))));
+    return codec == CACTUS_CODEC_ZLIB ? CACTUS_CODEC_ZLIB_FAST : codec;
+}
+
+static void *compress(CactusCodec codec, char *string, int64_t *dataSize) {
+    void *data = cactusCompression_compress(codec, string, strlen(string) + 1, dataSize);
     free(string);
     return data;
 }
 
 static char *decompress(void *data, int64_t dataSize) {
     int64_t uncompressedSize;
-    char *string = stCompression_decompress(data, dataSize, &uncompressedSize);
+    char *string = cactusCompression_decompress(data, dataSize, &uncompressedSize);
     assert(strlen(string)+1 == uncompressedSize);
     free(data);
     return string;
@@ -31,6 +43,7 @@ static void cacheNonNestedRecords(stCache *cache, stList *caps, char *(*segmentW
     /*
      * Caches the set of terminal adjacency and segment records present in the threads.
      */
+    CactusCodec codec = getCodec(caps);
     for (int64_t i = 0; i < stList_length(caps); i++) {
         Cap *cap = stList_get(caps, i);
         int64_t recordSize;
@@ -40,7 +53,7 @@ static void cacheNonNestedRecords(stCache *cache, stList *caps, char *(*segmentW
             Group *group = end_getGroup(cap_getEnd(cap));
             assert(group != NULL);
             if (group_isLeaf(group)) { //Record must not be in the database already
-                void *data = compress(terminalAdjacencyWriteFn(cap), &recordSize);
+                void *data = compress(codec, terminalAdjacencyWriteFn(cap), &recordSize);
                 assert(!stCache_containsRecord(cache, cap_getName(cap), 0, INT64_MAX));
                 stCache_setRecord(cache, cap_getName(cap), 0, recordSize, data);
                 free(data);
@@ -50,7 +63,7 @@ static void cacheNonNestedRecords(stCache *cache, stList *caps, char *(*segmentW
             }
             Segment *segment = cap_getSegment(adjacentCap);
             assert(!stCache_containsRecord(cache, segment_getName(segment), 0, INT64_MAX));
-            void *data = compress(segmentWriteFn(segment), &recordSize);
+            void *data = compress(codec, segmentWriteFn(segment), &recordSize);
             stCache_setRecord(cache, segment_getName(segment), 0, recordSize, data);
             free(data);
         }
@@ -182,13 +195,14 @@ void buildRecursiveThreads(stKVDatabase *database, stList *caps, char *(*segment
     stCache *cache = cacheRecords(database, caps, segmentWriteFn, terminalAdjacencyWriteFn);
 
     //Build new threads
+    CactusCodec codec = getCodec(caps);
     stList *records = stList_construct3(0, (void(*)(void *)) stKVDatabaseBulkRequest_destruct);
     for (int64_t i = 0; i < stList_length(caps); i++) {
         Cap *cap = stList_get(caps, i);
         char *string = getThread(cache, cap);
         assert(string != NULL);
         int64_t recordSize;
-        void *data = compress(string, &recordSize);
+        void *data = compress(codec, string, &recordSize);
         stList_append(records, stKVDatabaseBulkRequest_constructInsertRequest(cap_getName(cap), data, recordSize));
         free(data);
     }
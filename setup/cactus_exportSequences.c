@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include "cactus.h"
+#include "sonLib.h"
+
+/*
+ * Exports the strings of all the sequences in the cactus disk to a read-only sequence store
+ * file, which cactus_caf and cactus_bar can then map with --sequenceStore instead of fetching
+ * the sequences from the database.
+ */
+
+void usage() {
+    fprintf(stderr, "cactus_exportSequences, version 0.1\n");
+    fprintf(stderr, "-a --logLevel : Set the log level\n");
+    fprintf(stderr, "-c --cactusDisk : The location of the flower disk directory\n");
+    fprintf(stderr, "-o --outputFile : The sequence store file to write\n");
+    fprintf(stderr, "-h --help : Print this help screen\n");
+}
+
+int main(int argc, char *argv[]) {
+    char * logLevelString = NULL;
+    char * cactusDiskDatabaseString = NULL;
+    char * outputFile = NULL;
+
+    while (1) {
+        static struct option long_options[] = { { "logLevel", required_argument, 0, 'a' },
+                { "cactusDisk", required_argument, 0, 'c' }, { "outputFile", required_argument, 0, 'o' },
+                { "help", no_argument, 0, 'h' }, { 0, 0, 0, 0 } };
+
+        int option_index = 0;
+
+        int key = getopt_long(argc, argv, "a:c:o:h", long_options, &option_index);
+
+        if (key == -1) {
+            break;
+        }
+
+        switch (key) {
+            case 'a':
+                logLevelString = stString_copy(optarg);
+                break;
+            case 'c':
+                cactusDiskDatabaseString = stString_copy(optarg);
+                break;
+            case 'o':
+                outputFile = stString_copy(optarg);
+                break;
+            case 'h':
+                usage();
+                return 0;
+            default:
+                usage();
+                return 1;
+        }
+    }
+
+    if (cactusDiskDatabaseString == NULL || outputFile == NULL) {
+        usage();
+        return 1;
+    }
+
+    st_setLogLevelFromString(logLevelString);
+
+    stKVDatabaseConf *kvDatabaseConf = stKVDatabaseConf_constructFromString(cactusDiskDatabaseString);
+    CactusDisk *cactusDisk = cactusDisk_construct(kvDatabaseConf, false, true);
+    st_logInfo("Set up the flower disk\n");
+
+    //The root flower contains all the sequences.
+    Flower *flower = cactusDisk_getFlower(cactusDisk, 0);
+    if (flower == NULL) {
+        st_errAbort("The cactus disk does not contain a root flower");
+    }
+    stList *metaSequences = stList_construct();
+    Flower_SequenceIterator *sequenceIt = flower_getSequenceIterator(flower);
+    Sequence *sequence;
+    while ((sequence = flower_getNextSequence(sequenceIt)) != NULL) {
+        stList_append(metaSequences, sequence_getMetaSequence(sequence));
+    }
+    flower_destructSequenceIterator(sequenceIt);
+
+    cactusDisk_writeSequenceStore(cactusDisk, metaSequences, outputFile);
+    st_logInfo("Wrote %" PRIi64 " sequences to %s\n", stList_length(metaSequences), outputFile);
+
+    stList_destruct(metaSequences);
+    cactusDisk_destruct(cactusDisk);
+    stKVDatabaseConf_destruct(kvDatabaseConf);
+    free(cactusDiskDatabaseString);
+    free(outputFile);
+    free(logLevelString);
+
+    return 0;
+}
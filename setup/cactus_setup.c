@@ -283,6 +283,7 @@ int main(int argc, char *argv[]) {
     } else {
         cactusDisk = cactusDisk_construct(kvDatabaseConf, true, true);
     }
+    cactusDisk_setOptionsFromConfString(cactusDisk, cactusDiskDatabaseString);
     st_logInfo("Set up the flower disk\n");
 
     //////////////////////////////////////////////